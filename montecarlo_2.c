@@ -1,516 +1,8368 @@
 // montecarlo_fixed.c
-#include <windows.h>
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#ifdef MC_PROFILE
+#include <linux/perf_event.h>
+#endif
+#endif
+extern char** environ;
+#endif
+
+// ==================== CONFIGURACIÓN ====================
+#define MAX_PROCESSES 1024
+#define MAP_NAME_MAX 256
+#define MC_PATH_MAX 1024
+#define MC_CACHE_LINE 64
+#define MC_PAGE_SIZE 4096
+
+#ifdef _MSC_VER
+#define MC_ALIGN(n) __declspec(align(n))
+#else
+#define MC_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#ifdef _WIN32
+#define MC_SHM_PREFIX "Local\\"
+#define MC_PLATFORM_NAME "WINDOWS"
+#else
+#define MC_SHM_PREFIX "/"
+#define MC_PLATFORM_NAME "POSIX"
+#endif
+
+// ==================== CAPA DE PLATAFORMA ====================
+// Todo lo que depende del sistema operativo vive aqui: tiempo, hilos,
+// memoria compartida con nombre, archivos mapeados, espera entre procesos,
+// lanzamiento de procesos hijos y sockets TCP y locales. El resto del programa solo usa las
+// funciones mc_*.
+#ifdef _WIN32
+typedef HANDLE mc_thread_t;
+typedef DWORD mc_thread_ret_t;
+#define MC_THREAD_API WINAPI
+
+typedef struct {
+    HANDLE hMap;
+    void* addr;
+    size_t size;
+} mc_shm_t;
+
+typedef struct {
+    HANDLE hFile;
+    HANDLE hMap;
+    void* addr;
+    size_t size;
+} mc_file_map_t;
+
+typedef CRITICAL_SECTION mc_lock_t;
+typedef CONDITION_VARIABLE mc_cond_t;
+
+typedef struct {
+    HANDLE hProcess;
+    HANDLE hThread;
+    unsigned long pid;
+} mc_process_t;
+
+typedef SOCKET mc_socket_t;
+#define MC_INVALID_SOCKET INVALID_SOCKET
+#else
+typedef pthread_t mc_thread_t;
+typedef void* mc_thread_ret_t;
+#define MC_THREAD_API
+
+typedef struct {
+    int fd;
+    void* addr;
+    size_t size;
+    int owner;
+    char name[MAP_NAME_MAX];
+} mc_shm_t;
+
+typedef struct {
+    int fd;
+    void* addr;
+    size_t size;
+} mc_file_map_t;
+
+typedef pthread_mutex_t mc_lock_t;
+typedef pthread_cond_t mc_cond_t;
+
+typedef struct {
+    pid_t pid;
+} mc_process_t;
+
+typedef int mc_socket_t;
+#define MC_INVALID_SOCKET (-1)
+#endif
+
+typedef mc_thread_ret_t (MC_THREAD_API *mc_thread_fn)(void*);
+
+// Ultimo codigo de error del sistema (GetLastError / errno)
+static unsigned long mc_last_error(void) {
+#ifdef _WIN32
+    return GetLastError();
+#else
+    return (unsigned long)errno;
+#endif
+}
+
+// Tiempo monotono en segundos (QueryPerformanceCounter / CLOCK_MONOTONIC)
+static double mc_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Milisegundos desde un origen arbitrario (equivalente a GetTickCount)
+static unsigned long mc_tick_count(void) {
+#ifdef _WIN32
+    return GetTickCount();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000ul + (unsigned long)(ts.tv_nsec / 1000000);
+#endif
+}
+
+static void mc_sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+#endif
+}
+
+static unsigned long mc_process_id(void) {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+// ---------- Hilos ----------
+static int mc_thread_create(mc_thread_t* thread, mc_thread_fn fn, void* arg) {
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *thread != NULL ? 0 : -1;
+#else
+    int rc = pthread_create(thread, NULL, fn, arg);
+    if (rc != 0) errno = rc;
+    return rc == 0 ? 0 : -1;
+#endif
+}
+
+static void mc_thread_join(mc_thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// Procesadores logicos disponibles para este proceso
+static int mc_cpu_count(void) {
+#ifdef _WIN32
+    DWORD n = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    return n > 0 ? (int)n : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Nombre de la maquina, solo letras, digitos, '-' y '_' (para nombres de archivo)
+static void mc_host_name(char* buf, size_t size) {
+#ifdef _WIN32
+    DWORD len = (DWORD)size;
+    if (!GetComputerNameA(buf, &len)) buf[0] = '\0';
+#else
+    if (gethostname(buf, size) != 0) buf[0] = '\0';
+    buf[size - 1] = '\0';
+#endif
+    for (char* c = buf; *c != '\0'; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+              (*c >= '0' && *c <= '9') || *c == '-' || *c == '_')) {
+            *c = '_';
+        }
+    }
+    if (buf[0] == '\0') snprintf(buf, size, "local");
+}
+
+// Memoria alineada (p. ej. a linea de cache); se libera con mc_aligned_free
+static void* mc_aligned_alloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, alignment, size) == 0 ? p : NULL;
+#endif
+}
+
+static void mc_aligned_free(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// ---------- Topologia y afinidad ----------
+// Procesadores logicos que puede usar el proceso, con su nucleo fisico,
+// paquete y nodo NUMA. En Linux se leen de /sys/devices/system/{cpu,node};
+// en Windows de GetLogicalProcessorInformation (solo el primer grupo de 64
+// procesadores). Sin esa informacion cada procesador cuenta como un nucleo
+// del nodo 0.
+#define MC_MAX_CPUS 1024
+
+typedef struct {
+    int cpu;       // numero de procesador logico (para la afinidad)
+    int core;      // nucleo fisico, numerado en todo el sistema
+    int package;
+    int node;
+    int smt;       // posicion entre los hilos SMT del mismo nucleo
+} mc_cpu_info_t;
+
+typedef struct {
+    int count;
+    int cores;
+    int nodes;
+    mc_cpu_info_t cpus[MC_MAX_CPUS];
+} mc_topology_t;
+
+#ifndef _WIN32
+// Entero de un archivo de /sys; -1 si no existe
+static int mc_sysfs_int(const char* path) {
+    FILE* f = fopen(path, "r");
+    int v = -1;
+    if (f == NULL) return -1;
+    if (fscanf(f, "%d", &v) != 1) v = -1;
+    fclose(f);
+    return v;
+}
+
+// Lista de /sys con el formato "0-3,8-11": pone 'value' en mark[c] para cada
+// procesador c de la lista. Devuelve cuantos hubo o -1 si no existe.
+static int mc_sysfs_cpulist(const char* path, int* mark, int value) {
+    char buf[4096];
+    FILE* f = fopen(path, "r");
+    int n = 0;
+    if (f == NULL) return -1;
+    if (fgets(buf, sizeof(buf), f) == NULL) buf[0] = '\0';
+    fclose(f);
+    for (char* p = buf; *p >= '0' && *p <= '9';) {
+        char* end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < MC_MAX_CPUS; c++, n++) mark[c] = value;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+#endif
+
+// Agrega el procesador 'cpu'; los hilos con el mismo (paquete, core_id) son
+// hermanos SMT de un mismo nucleo
+static void mc_topology_add(mc_topology_t* t, int* raw_core, int cpu, int core_id,
+                            int package, int node) {
+    mc_cpu_info_t* info = &t->cpus[t->count];
+    info->cpu = cpu;
+    info->package = package;
+    info->node = node;
+    info->core = -1;
+    info->smt = 0;
+    for (int k = 0; k < t->count; k++) {
+        if (t->cpus[k].package == package && raw_core[k] == core_id) {
+            info->core = t->cpus[k].core;
+            info->smt++;
+        }
+    }
+    if (info->core < 0) info->core = t->cores++;
+    raw_core[t->count++] = core_id;
+}
+
+static void mc_topology_detect(mc_topology_t* t) {
+    static int raw_core[MC_MAX_CPUS];
+
+    memset(t, 0, sizeof(*t));
+#ifdef _WIN32
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info = NULL;
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    DWORD len = 0;
+    int core_of[64], package_of[64], node_of[64];
+    int cores = 0, packages = 0;
+
+    for (int c = 0; c < 64; c++) core_of[c] = package_of[c] = node_of[c] = -1;
+    GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask);
+    GetLogicalProcessorInformation(NULL, &len);
+    if (len > 0) info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(len);
+    if (info != NULL && GetLogicalProcessorInformation(info, &len)) {
+        for (DWORD e = 0; e < len / sizeof(*info); e++) {
+            ULONG_PTR mask = info[e].ProcessorMask;
+            for (int c = 0; c < (int)(sizeof(ULONG_PTR) * 8) && c < 64; c++) {
+                if (!(mask & ((ULONG_PTR)1 << c))) continue;
+                if (info[e].Relationship == RelationProcessorCore) core_of[c] = cores;
+                else if (info[e].Relationship == RelationProcessorPackage) package_of[c] = packages;
+                else if (info[e].Relationship == RelationNumaNode) node_of[c] = (int)info[e].NumaNode.NodeNumber;
+            }
+            if (info[e].Relationship == RelationProcessorCore) cores++;
+            else if (info[e].Relationship == RelationProcessorPackage) packages++;
+        }
+        for (int c = 0; c < 64 && c < (int)(sizeof(DWORD_PTR) * 8); c++) {
+            if (core_of[c] < 0 || !(process_mask & ((DWORD_PTR)1 << c))) continue;
+            mc_topology_add(t, raw_core, c, core_of[c], package_of[c] < 0 ? 0 : package_of[c],
+                            node_of[c] < 0 ? 0 : node_of[c]);
+        }
+    }
+    free(info);
+#else
+    static int online[MC_MAX_CPUS], node_online[MC_MAX_CPUS], node_of[MC_MAX_CPUS];
+    char path[128];
+
+    memset(online, 0, sizeof(online));
+    memset(node_online, 0, sizeof(node_online));
+    memset(node_of, 0, sizeof(node_of));
+    if (mc_sysfs_cpulist("/sys/devices/system/cpu/online", online, 1) > 0) {
+#ifdef __linux__
+        // Respetar la afinidad heredada (taskset, cpusets)
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int c = 0; c < MC_MAX_CPUS && c < CPU_SETSIZE; c++) {
+                if (!CPU_ISSET(c, &allowed)) online[c] = 0;
+            }
+        }
+#endif
+        mc_sysfs_cpulist("/sys/devices/system/node/online", node_online, 1);
+        for (int n = 0; n < MC_MAX_CPUS; n++) {
+            if (!node_online[n]) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+            mc_sysfs_cpulist(path, node_of, n);
+        }
+        for (int c = 0; c < MC_MAX_CPUS; c++) {
+            if (!online[c]) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+            int core_id = mc_sysfs_int(path);
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+            int package = mc_sysfs_int(path);
+            if (core_id < 0) core_id = c;
+            if (package < 0) package = 0;
+            mc_topology_add(t, raw_core, c, core_id, package, node_of[c]);
+        }
+    }
+#endif
+    if (t->count == 0) {
+        int n = mc_cpu_count();
+        for (int c = 0; c < n && c < MC_MAX_CPUS; c++) mc_topology_add(t, raw_core, c, c, 0, 0);
+    }
+    for (int k = 0; k < t->count; k++) {
+        int seen = 0;
+        for (int j = 0; j < k && !seen; j++) seen = t->cpus[j].node == t->cpus[k].node;
+        if (!seen) t->nodes++;
+    }
+}
+
+// Fija el hilo actual al procesador 'cpu'. Con cpu < 0 le devuelve la
+// afinidad con la que arranco el proceso (los hijos del pool fijan tambien
+// su hilo principal).
+static int mc_pin_current_thread(int cpu) {
+#ifdef _WIN32
+    DWORD_PTR process_mask, system_mask;
+    if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) return -1;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) return -1;
+    DWORD_PTR mask = cpu < 0 ? process_mask : (DWORD_PTR)1 << cpu;
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0 ? 0 : -1;
+#elif defined(__linux__)
+    static cpu_set_t initial;
+    static int have_initial = 0;
+    cpu_set_t set;
+    // La primera llamada llega antes de fijar ningun hilo
+    if (!have_initial) {
+        if (sched_getaffinity(0, sizeof(initial), &initial) != 0) return -1;
+        have_initial = 1;
+    }
+    if (cpu < 0) {
+        set = initial;
+    } else {
+        if (cpu >= CPU_SETSIZE) return -1;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+// ---------- Sincronizacion dentro del proceso ----------
+static void mc_lock_init(mc_lock_t* lock) {
+#ifdef _WIN32
+    InitializeCriticalSection(lock);
+#else
+    pthread_mutex_init(lock, NULL);
+#endif
+}
+
+static void mc_lock(mc_lock_t* lock) {
+#ifdef _WIN32
+    EnterCriticalSection(lock);
+#else
+    pthread_mutex_lock(lock);
+#endif
+}
+
+static void mc_unlock(mc_lock_t* lock) {
+#ifdef _WIN32
+    LeaveCriticalSection(lock);
+#else
+    pthread_mutex_unlock(lock);
+#endif
+}
+
+static void mc_cond_init(mc_cond_t* cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static void mc_cond_wait(mc_cond_t* cond, mc_lock_t* lock) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, lock, INFINITE);
+#else
+    pthread_cond_wait(cond, lock);
+#endif
+}
+
+static void mc_cond_broadcast(mc_cond_t* cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+// ---------- Operaciones atomicas de 64 bits ----------
+static inline long long mc_atomic_load(volatile long long* p) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64(p, 0, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void mc_atomic_store(volatile long long* p, long long v) {
+#ifdef _MSC_VER
+    InterlockedExchange64(p, v);
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline long long mc_atomic_add(volatile long long* p, long long v) {
+#ifdef _MSC_VER
+    return InterlockedExchangeAdd64(p, v) + v;
+#else
+    return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Contadores de avance: los escribe solo su dueno y el monitor los lee sin
+// imponer orden (en x64 un acceso alineado de 64 bits ya es atomico)
+static inline long long mc_atomic_load_relaxed(volatile long long* p) {
+#ifdef _MSC_VER
+    return *p;
+#else
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void mc_atomic_store_relaxed(volatile long long* p, long long v) {
+#ifdef _MSC_VER
+    *p = v;
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+#endif
+}
+
+// Devuelve 1 si *p valia 'expected' y se reemplazo por 'desired'
+static inline int mc_atomic_cas(volatile long long* p, long long expected, long long desired) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64(p, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// ---------- Memoria compartida con nombre ----------
+static int mc_shm_create(mc_shm_t* shm, const char* name, size_t size) {
+    memset(shm, 0, sizeof(*shm));
+    shm->size = size;
+#ifdef _WIN32
+    shm->hMap = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   0, (DWORD)size, name);
+    if (shm->hMap == NULL) return -1;
+    shm->addr = MapViewOfFile(shm->hMap, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (shm->addr == NULL) {
+        CloseHandle(shm->hMap);
+        return -1;
+    }
+#else
+    shm->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm->fd < 0) return -1;
+    snprintf(shm->name, sizeof(shm->name), "%s", name);
+    shm->owner = 1;
+    if (ftruncate(shm->fd, (off_t)size) != 0) {
+        close(shm->fd);
+        shm_unlink(name);
+        return -1;
+    }
+    shm->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->addr == MAP_FAILED) {
+        close(shm->fd);
+        shm_unlink(name);
+        return -1;
+    }
+#endif
+    memset(shm->addr, 0, size);
+    return 0;
+}
+
+static int mc_shm_open(mc_shm_t* shm, const char* name, size_t size) {
+    memset(shm, 0, sizeof(*shm));
+    shm->size = size;
+#ifdef _WIN32
+    shm->hMap = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (shm->hMap == NULL) return -1;
+    shm->addr = MapViewOfFile(shm->hMap, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (shm->addr == NULL) {
+        CloseHandle(shm->hMap);
+        return -1;
+    }
+#else
+    shm->fd = shm_open(name, O_RDWR, 0600);
+    if (shm->fd < 0) return -1;
+    shm->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->addr == MAP_FAILED) {
+        close(shm->fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// Borra los mappings "<prefix><pid>_*" cuyo proceso creador ya no existe: un
+// padre que murio con SIGKILL no llega a borrar el suyo (Linux). En Windows
+// el mapping desaparece con el ultimo handle y no hace falta.
+static void mc_shm_sweep(const char* prefix) {
+#ifdef __linux__
+    DIR* dir = opendir("/dev/shm");
+    struct dirent* entry;
+    size_t len = strlen(prefix);
+
+    if (dir == NULL) return;
+    while ((entry = readdir(dir)) != NULL) {
+        char* end;
+        if (strncmp(entry->d_name, prefix, len) != 0) continue;
+        unsigned long pid = strtoul(entry->d_name + len, &end, 10);
+        if (*end != '_' || pid == 0 || pid == mc_process_id()) continue;
+        if (kill((pid_t)pid, 0) == 0 || errno != ESRCH) continue;
+        char name[MAP_NAME_MAX + 1];
+        snprintf(name, sizeof(name), "/%s", entry->d_name);
+        shm_unlink(name);
+    }
+    closedir(dir);
+#else
+    (void)prefix;
+#endif
+}
+
+static void mc_shm_close(mc_shm_t* shm) {
+#ifdef _WIN32
+    if (shm->addr) UnmapViewOfFile(shm->addr);
+    if (shm->hMap) CloseHandle(shm->hMap);
+#else
+    if (shm->addr && shm->addr != MAP_FAILED) munmap(shm->addr, shm->size);
+    if (shm->fd >= 0) close(shm->fd);
+    if (shm->owner) shm_unlink(shm->name);
+#endif
+    shm->addr = NULL;
+}
+
+// ---------- Archivos mapeados en memoria ----------
+// Proyecta el archivo completo; si es mas chico que 'size' primero se
+// agranda con ceros. Varios procesos que mapean el mismo archivo ven las
+// mismas paginas.
+static int mc_file_view(mc_file_map_t* fm, size_t size) {
+#ifdef _WIN32
+    LARGE_INTEGER cur;
+    if (!GetFileSizeEx(fm->hFile, &cur)) return -1;
+    if ((unsigned long long)cur.QuadPart > size) size = (size_t)cur.QuadPart;
+    if (size == 0) return -1;
+    fm->hMap = CreateFileMappingA(fm->hFile, NULL, PAGE_READWRITE,
+                                  (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+    if (fm->hMap == NULL) return -1;
+    fm->addr = MapViewOfFile(fm->hMap, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (fm->addr == NULL) {
+        CloseHandle(fm->hMap);
+        fm->hMap = NULL;
+        return -1;
+    }
+#else
+    struct stat sb;
+    if (fstat(fm->fd, &sb) != 0) return -1;
+    if ((size_t)sb.st_size > size) size = (size_t)sb.st_size;
+    if (size == 0) return -1;
+    if ((size_t)sb.st_size < size && ftruncate(fm->fd, (off_t)size) != 0) return -1;
+    fm->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fm->fd, 0);
+    if (fm->addr == MAP_FAILED) {
+        fm->addr = NULL;
+        return -1;
+    }
+#endif
+    fm->size = size;
+    return 0;
+}
+
+static void mc_file_unview(mc_file_map_t* fm) {
+#ifdef _WIN32
+    if (fm->addr) UnmapViewOfFile(fm->addr);
+    if (fm->hMap) CloseHandle(fm->hMap);
+    fm->hMap = NULL;
+#else
+    if (fm->addr) munmap(fm->addr, fm->size);
+#endif
+    fm->addr = NULL;
+}
+
+// Abre (o crea, con 'create') el archivo y lo mapea con al menos 'size' bytes.
+// El descriptor no se hereda: los hijos del pool se lanzan con el registro ya
+// bloqueado y, si el padre muere, el bloqueo tiene que irse con el.
+static int mc_file_map(mc_file_map_t* fm, const char* path, size_t size, int create) {
+    memset(fm, 0, sizeof(*fm));
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, FALSE };
+    fm->hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            &sa, create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fm->hFile == INVALID_HANDLE_VALUE) return -1;
+    if (mc_file_view(fm, size) != 0) {
+        CloseHandle(fm->hFile);
+        return -1;
+    }
+#else
+    fm->fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fm->fd < 0) return -1;
+    if (mc_file_view(fm, size) != 0) {
+        close(fm->fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// Agranda el archivo a 'size' bytes y lo vuelve a mapear (la direccion cambia)
+static int mc_file_grow(mc_file_map_t* fm, size_t size) {
+    mc_file_unview(fm);
+    return mc_file_view(fm, size);
+}
+
+// Lleva a disco las paginas modificadas del mapeo
+static int mc_file_sync(mc_file_map_t* fm) {
+#ifdef _WIN32
+    if (!FlushViewOfFile(fm->addr, 0)) return -1;
+    return FlushFileBuffers(fm->hFile) ? 0 : -1;
+#else
+    return msync(fm->addr, fm->size, MS_SYNC);
+#endif
+}
+
+// Bloqueo exclusivo sin espera entre procesos que lo pidan: 0 = obtenido
+static int mc_file_lock(mc_file_map_t* fm) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    return LockFileEx(fm->hFile, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+                      0, 1, 0, &ov) ? 0 : -1;
+#else
+    return flock(fm->fd, LOCK_EX | LOCK_NB);
+#endif
+}
+
+// Abre el archivo solo para lectura y sin proyectarlo: las partes se piden
+// despues con mc_file_window. 'size' queda con el tamano del archivo.
+static int mc_file_open_read(mc_file_map_t* fm, const char* path) {
+    memset(fm, 0, sizeof(*fm));
+#ifdef _WIN32
+    LARGE_INTEGER cur;
+    fm->hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fm->hFile == INVALID_HANDLE_VALUE) return -1;
+    if (!GetFileSizeEx(fm->hFile, &cur) || cur.QuadPart == 0 ||
+        (fm->hMap = CreateFileMappingA(fm->hFile, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL) {
+        CloseHandle(fm->hFile);
+        return -1;
+    }
+    fm->size = (size_t)cur.QuadPart;
+#else
+    struct stat sb;
+    fm->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fm->fd < 0) return -1;
+    if (fstat(fm->fd, &sb) != 0) {
+        close(fm->fd);
+        return -1;
+    }
+    fm->size = (size_t)sb.st_size;
+#endif
+    return 0;
+}
+
+// Proyecta [offset, offset + size) de un archivo abierto con mc_file_open_read.
+// 'offset' tiene que ser multiplo de 64 KiB (granularidad de Windows).
+static const void* mc_file_window(mc_file_map_t* fm, long long offset, size_t size) {
+#ifdef _WIN32
+    return MapViewOfFile(fm->hMap, FILE_MAP_READ, (DWORD)((unsigned long long)offset >> 32),
+                         (DWORD)offset, size);
+#else
+#ifdef MAP_POPULATE
+    const int flags = MAP_SHARED | MAP_POPULATE;   // las paginas entran en una sola llamada
+#else
+    const int flags = MAP_SHARED;
+#endif
+    void* addr = mmap(NULL, size, PROT_READ, flags, fm->fd, (off_t)offset);
+    return addr == MAP_FAILED ? NULL : addr;
+#endif
+}
+
+static void mc_file_window_close(const void* addr, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(addr);
+#else
+    munmap((void*)addr, size);
+#endif
+}
+
+static void mc_file_unmap(mc_file_map_t* fm) {
+    mc_file_unview(fm);
+#ifdef _WIN32
+    if (fm->hFile && fm->hFile != INVALID_HANDLE_VALUE) CloseHandle(fm->hFile);
+    fm->hFile = NULL;
+#else
+    if (fm->fd >= 0) close(fm->fd);
+    fm->fd = -1;
+#endif
+}
+
+// ---------- Espera sobre memoria compartida (estilo futex) ----------
+// Sirve entre procesos que comparten un mapping. En Linux se usa el futex
+// compartido del kernel; en el resto se cede el procesador y se reintenta.
+static inline int mc_atomic_load32(volatile int* p) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline int mc_atomic_add32(volatile int* p, int v) {
+#ifdef _MSC_VER
+    return InterlockedExchangeAdd((volatile LONG*)p, v) + v;
+#else
+    return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Duerme mientras *addr == expected, como maximo timeout_ms
+static void mc_futex_wait(volatile int* addr, int expected, int timeout_ms) {
+#if defined(__linux__)
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, (int*)addr, FUTEX_WAIT, expected, &ts, NULL, 0);
+#elif defined(_WIN32)
+    if (mc_atomic_load32(addr) == expected) Sleep(timeout_ms < 1 ? 0 : 1);
+#else
+    if (mc_atomic_load32(addr) == expected) usleep(timeout_ms < 1 ? 0 : 1000);
+#endif
+}
+
+static void mc_futex_wake_all(volatile int* addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, (int*)addr, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif
+}
+
+// ---------- Procesos hijos ----------
+// Relanza el ejecutable actual con los argumentos dados (argv[0] se ignora)
+static int mc_process_spawn(mc_process_t* proc, char* const argv[]) {
+#ifdef _WIN32
+    char cmdline[1024];
+    char exe_path[MAX_PATH];
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    size_t len;
+
+    // Obtener ruta del ejecutable actual
+    GetModuleFileNameA(NULL, exe_path, MAX_PATH);
+    len = (size_t)snprintf(cmdline, sizeof(cmdline), "\"%s\"", exe_path);
+    for (int i = 1; argv[i] != NULL && len < sizeof(cmdline); i++) {
+        len += (size_t)snprintf(cmdline + len, sizeof(cmdline) - len, " %s", argv[i]);
+    }
+
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+    if (!CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
+        memset(proc, 0, sizeof(*proc));
+        return -1;
+    }
+    proc->hProcess = pi.hProcess;
+    proc->hThread = pi.hThread;
+    proc->pid = pi.dwProcessId;
+    return 0;
+#else
+    // Vaciar buffers antes de que el hijo comparta la salida estandar
+    fflush(stdout);
+    fflush(stderr);
+    int rc = posix_spawn(&proc->pid, "/proc/self/exe", NULL, NULL, argv, environ);
+    if (rc != 0) {
+        proc->pid = 0;
+        errno = rc;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+static unsigned long mc_process_pid(const mc_process_t* proc) {
+#ifdef _WIN32
+    return proc->pid;
+#else
+    return (unsigned long)proc->pid;
+#endif
+}
+
+// Devuelve 1 si el hijo ya termino (o nunca se lanzo) sin bloquear
+static int mc_process_exited(mc_process_t* proc) {
+#ifdef _WIN32
+    if (proc->hProcess == NULL) return 1;
+    return WaitForSingleObject(proc->hProcess, 0) == WAIT_OBJECT_0;
+#else
+    if (proc->pid <= 0) return 1;
+    int status;
+    if (waitpid(proc->pid, &status, WNOHANG) == proc->pid) {
+        proc->pid = 0;
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+// Devuelve 1 si el proceso 'parent' ya no existe: un hijo del pool que quedo
+// huerfano termina en lugar de esperar trabajos que nunca van a llegar
+static int mc_parent_gone(unsigned long parent) {
+#ifdef _WIN32
+    HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)parent);
+    if (h == NULL) return 1;
+    int gone = WaitForSingleObject(h, 0) == WAIT_OBJECT_0;
+    CloseHandle(h);
+    return gone;
+#else
+    return (unsigned long)getppid() != parent;
+#endif
+}
+
+// Hace que el hijo muera junto con su padre aunque este termine con SIGKILL
+// (Linux). En el resto, el hijo lo nota con mc_parent_gone.
+static void mc_die_with_parent(void) {
+#ifdef __linux__
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+}
+
+// Espera al hijo y libera sus recursos; no hace nada si nunca se lanzo
+static void mc_process_wait(mc_process_t* proc) {
+#ifdef _WIN32
+    if (proc->hProcess) {
+        WaitForSingleObject(proc->hProcess, INFINITE);
+        CloseHandle(proc->hProcess);
+        CloseHandle(proc->hThread);
+        proc->hProcess = NULL;
+    }
+#else
+    if (proc->pid > 0) {
+        int status;
+        while (waitpid(proc->pid, &status, 0) < 0 && errno == EINTR) {}
+        proc->pid = 0;
+    }
+#endif
+}
+
+// ---------- Sockets TCP ----------
+// Winsock en Windows y sockets BSD en POSIX. Las funciones devuelven
+// MC_INVALID_SOCKET o -1 en error; el codigo queda en mc_net_error().
+static unsigned long mc_net_error(void) {
+#ifdef _WIN32
+    return (unsigned long)WSAGetLastError();
+#else
+    return (unsigned long)errno;
+#endif
+}
+
+static int mc_net_init(void) {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0 ? 0 : -1;
+#else
+    signal(SIGPIPE, SIG_IGN);   // un par caido se ve como error de send, no como senal
+    return 0;
+#endif
+}
+
+static void mc_socket_close(mc_socket_t s) {
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+static void mc_socket_nodelay(mc_socket_t s) {
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+// Escucha en todas las interfaces
+static mc_socket_t mc_tcp_listen(int port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    mc_socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == MC_INVALID_SOCKET) return MC_INVALID_SOCKET;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)port);
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0) {
+        mc_socket_close(s);
+        return MC_INVALID_SOCKET;
+    }
+    return s;
+}
+
+// Acepta una conexion y deja en 'peer' la direccion remota (ip:puerto)
+static mc_socket_t mc_tcp_accept(mc_socket_t listener, char* peer, size_t peer_size) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    mc_socket_t s = accept(listener, (struct sockaddr*)&addr, &len);
+    if (s == MC_INVALID_SOCKET) return MC_INVALID_SOCKET;
+    mc_socket_nodelay(s);
+    snprintf(peer, peer_size, "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    return s;
+}
+
+static mc_socket_t mc_tcp_connect(const char* host, int port) {
+    struct addrinfo hints, *res, *ai;
+    char service[16];
+    mc_socket_t s = MC_INVALID_SOCKET;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0) return MC_INVALID_SOCKET;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == MC_INVALID_SOCKET) continue;
+        if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) break;
+        mc_socket_close(s);
+        s = MC_INVALID_SOCKET;
+    }
+    freeaddrinfo(res);
+    if (s != MC_INVALID_SOCKET) mc_socket_nodelay(s);
+    return s;
+}
+
+static int mc_socket_send_all(mc_socket_t s, const char* buf, int len) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (len > 0) {
+        int sent = (int)send(s, buf, len, flags);
+        if (sent <= 0) return -1;
+        buf += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+// Bytes recibidos, 0 si el otro extremo cerro, -1 en error
+static int mc_socket_recv(mc_socket_t s, char* buf, int len) {
+    return (int)recv(s, buf, len, 0);
+}
+
+// Espera hasta 'timeout_ms' a que alguno de los sockets tenga datos (o
+// conexiones pendientes). ready[i] queda en 1 para los que estan listos.
+static int mc_socket_poll(const mc_socket_t* socks, int n, int* ready, int timeout_ms) {
+    fd_set set;
+    struct timeval tv;
+    mc_socket_t max_fd = 0;
+
+    FD_ZERO(&set);
+    for (int i = 0; i < n; i++) {
+        ready[i] = 0;
+        if (socks[i] == MC_INVALID_SOCKET) continue;
+        FD_SET(socks[i], &set);
+        if (socks[i] > max_fd) max_fd = socks[i];
+    }
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int r = select((int)max_fd + 1, &set, NULL, NULL, &tv);
+    if (r <= 0) return r;
+    for (int i = 0; i < n; i++) {
+        if (socks[i] != MC_INVALID_SOCKET && FD_ISSET(socks[i], &set)) ready[i] = 1;
+    }
+    return r;
+}
+
+// ---------- Sockets locales ----------
+// Socket de dominio Unix con una ruta en el sistema de archivos (AF_UNIX
+// tambien existe en Windows 10). Solo lo alcanzan procesos de la misma maquina.
+static mc_socket_t mc_local_listen(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return MC_INVALID_SOCKET;
+    mc_socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == MC_INVALID_SOCKET) return MC_INVALID_SOCKET;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0) {
+        mc_socket_close(s);
+        return MC_INVALID_SOCKET;
+    }
+    return s;
+}
+
+static mc_socket_t mc_local_connect(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return MC_INVALID_SOCKET;
+    mc_socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == MC_INVALID_SOCKET) return MC_INVALID_SOCKET;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        mc_socket_close(s);
+        return MC_INVALID_SOCKET;
+    }
+    return s;
+}
+
+// Borra la ruta del socket (queda en el sistema de archivos al cerrarlo)
+static void mc_local_unlink(const char* path) {
+#ifdef _WIN32
+    DeleteFileA(path);
+#else
+    unlink(path);
+#endif
+}
+
+// ==================== INSTRUMENTACIÓN ====================
+// Perfilado opcional: se activa compilando con -DMC_PROFILE. Sin esa bandera
+// MC_PROF(...) no genera codigo y las estructuras no cambian de tamano.
+// Por worker se registran el instante de inicio y fin, las muestras
+// procesadas y, en Linux, ciclos, instrucciones y fallos de prediccion de
+// saltos (perf_event_open, solo modo usuario) alrededor de cada llamada al
+// kernel. Los motores informan ademas el despacho (cuanto tarda en arrancar
+// cada worker), la reduccion (del ultimo worker al total) y el desbalance.
+#ifdef MC_PROFILE
+#define MC_PROF(stmt) stmt
+#else
+#define MC_PROF(stmt)
+#endif
+
+#ifdef MC_PROFILE
+enum { MC_PERF_CYCLES = 0, MC_PERF_INSTRUCTIONS, MC_PERF_BRANCH_MISSES, MC_PERF_COUNT };
+
+typedef struct {
+    double start;                       // mc_now() antes del primer kernel (0 = sin trabajo)
+    double finish;                      // mc_now() despues del ultimo
+    long long samples;
+    long long kernel_calls;
+    long long counters[MC_PERF_COUNT];
+    int counters_ok;
+} mc_prof_worker_t;
+
+// Contadores del hilo que los abre; fds[0] es el lider del grupo
+typedef struct {
+    int fds[MC_PERF_COUNT];
+    long long last[MC_PERF_COUNT];
+} mc_perf_t;
+
+#ifdef __linux__
+static int mc_perf_event(unsigned long long config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+static void mc_perf_close(mc_perf_t* pc) {
+    for (int e = 0; e < MC_PERF_COUNT; e++) {
+#ifdef __linux__
+        if (pc->fds[e] >= 0) close(pc->fds[e]);
+#endif
+        pc->fds[e] = -1;
+    }
+}
+
+static void mc_perf_open(mc_perf_t* pc) {
+    for (int e = 0; e < MC_PERF_COUNT; e++) pc->fds[e] = -1;
+#ifdef __linux__
+    static const unsigned long long events[MC_PERF_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int e = 0; e < MC_PERF_COUNT; e++) {
+        pc->fds[e] = mc_perf_event(events[e], e == 0 ? -1 : pc->fds[0]);
+        if (pc->fds[e] < 0) {
+            mc_perf_close(pc);   // sin permisos o sin PMU (VM, contenedor)
+            return;
+        }
+    }
+#endif
+}
+
+static int mc_perf_read(mc_perf_t* pc, long long values[MC_PERF_COUNT]) {
+#ifdef __linux__
+    unsigned long long buf[1 + MC_PERF_COUNT];
+    if (pc->fds[0] < 0 || read(pc->fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) return 0;
+    for (int e = 0; e < MC_PERF_COUNT; e++) values[e] = (long long)buf[1 + e];
+    return 1;
+#else
+    (void)pc;
+    (void)values;
+    return 0;
+#endif
+}
+
+static void mc_prof_kernel_begin(mc_perf_t* pc, mc_prof_worker_t* w) {
+    if (w->start == 0.0) w->start = mc_now();
+    mc_perf_read(pc, pc->last);
+}
+
+static void mc_prof_kernel_end(mc_perf_t* pc, mc_prof_worker_t* w, long long samples) {
+    long long now[MC_PERF_COUNT];
+    if (mc_perf_read(pc, now)) {
+        for (int e = 0; e < MC_PERF_COUNT; e++) w->counters[e] += now[e] - pc->last[e];
+        w->counters_ok = 1;
+    }
+    w->samples += samples;
+    w->kernel_calls++;
+    w->finish = mc_now();
+}
+
+// 'dispatched': cuando se publico el trabajo; 'reduced': cuando el total
+// quedo sumado; 'setup': costo previo fuera de la medicion (crear el pool)
+static void mc_prof_report(const char* engine, const mc_prof_worker_t* w, int n,
+                           double dispatched, double reduced, double setup) {
+    double first_start = 0.0, last_start = 0.0, first_finish = 0.0, last_finish = 0.0;
+    double busy_sum = 0.0, busy_max = 0.0;
+    int active = 0;
+
+    printf("\n--- PERFIL %s ---\n", engine);
+    if (setup > 0.0) printf("Preparacion (fuera de la medicion): %.3f ms\n", setup * 1e3);
+    for (int i = 0; i < n; i++) {
+        double busy = w[i].finish - w[i].start;
+        if (w[i].start == 0.0) {
+            printf("  worker %d: sin trabajo\n", i);
+            continue;
+        }
+        printf("  worker %d: inicio +%.3f ms, fin +%.3f ms, %lld muestras en %lld kernels, %.2f ns/muestra",
+               i, (w[i].start - dispatched) * 1e3, (w[i].finish - dispatched) * 1e3,
+               w[i].samples, w[i].kernel_calls, w[i].samples > 0 ? busy * 1e9 / w[i].samples : 0.0);
+        if (w[i].counters_ok && w[i].counters[MC_PERF_CYCLES] > 0) {
+            printf(", IPC %.2f, %.2f GHz, %lld fallos de salto",
+                   (double)w[i].counters[MC_PERF_INSTRUCTIONS] / w[i].counters[MC_PERF_CYCLES],
+                   busy > 0 ? w[i].counters[MC_PERF_CYCLES] / busy * 1e-9 : 0.0,
+                   w[i].counters[MC_PERF_BRANCH_MISSES]);
+        }
+        printf("\n");
+
+        if (active == 0 || w[i].start < first_start) first_start = w[i].start;
+        if (active == 0 || w[i].start > last_start) last_start = w[i].start;
+        if (active == 0 || w[i].finish < first_finish) first_finish = w[i].finish;
+        if (active == 0 || w[i].finish > last_finish) last_finish = w[i].finish;
+        busy_sum += busy;
+        if (busy > busy_max) busy_max = busy;
+        active++;
+    }
+    if (active == 0) return;
+    printf("Despacho: primer worker +%.3f ms, ultimo +%.3f ms\n",
+           (first_start - dispatched) * 1e3, (last_start - dispatched) * 1e3);
+    printf("Reduccion: %.3f ms despues del ultimo worker\n", (reduced - last_finish) * 1e3);
+    printf("Desbalance: %.3f ms entre el primero y el ultimo en terminar, "
+           "ocupacion maxima %.1f%% sobre la media\n",
+           (last_finish - first_finish) * 1e3,
+           busy_sum > 0 ? (busy_max / (busy_sum / active) - 1.0) * 100.0 : 0.0);
+    if (!w[0].counters_ok) printf("Contadores de hardware no disponibles\n");
+}
+#endif
+
+// ==================== ESTRUCTURAS DE DATOS ====================
+// Parametros que determinan el resultado de una estimacion. Con los mismos
+// parametros y el mismo total de puntos la cuenta es identica en serial,
+// threads y procesos, sin importar cuantos workers se usen.
+typedef struct {
+    int method;
+    int rng;
+    int sampling;
+    int precision;
+    unsigned long long seed;
+    double needle_length;
+    double line_spacing;
+} mc_params_t;
+
+// Resultado de un proceso worker, en su propia pagina: cada hijo escribe solo
+// su slot y lo publica con 'done' (la generacion del trabajo atendido), sin
+// locks entre procesos. El padre no toca las paginas de los slots, asi que
+// las asigna el hijo (ya fijado a su procesador) en su nodo NUMA.
+typedef struct {
+    MC_ALIGN(MC_PAGE_SIZE) long long points_inside;
+    long long points_done;
+    volatile long long done;
+    unsigned long pid;
+    volatile long long range_points;  // avance del rango en curso (monitor)
+    volatile long long range_hits;
+#ifdef MC_PROFILE
+    mc_prof_worker_t prof;
+#endif
+} mc_result_slot_t;
+
+// Rango de un trabajo del pool de procesos. Un worker lo toma con CAS sobre
+// 'state' (id + 1 del worker); si muere antes de terminarlo, el padre lo
+// devuelve a libre y lo cuenta otro. Con registro, el rango son los
+// segmentos [seg, seg_end) del archivo en lugar de muestras sueltas.
+#define MC_PROC_RANGES 4096
+#define MC_RANGES_PER_WORKER 4
+enum { MC_PROC_RANGE_FREE = 0, MC_PROC_RANGE_DONE = -1 };
+
+typedef struct {
+    MC_ALIGN(MC_CACHE_LINE) long long first;
+    long long count;
+    long long seg;
+    long long seg_end;
+    long long hits;
+    long long points;
+    volatile long long state;
+} mc_proc_range_t;
+
+// Lo que el padre asigna a cada hijo antes de publicar un trabajo
+typedef struct {
+    volatile int generation;  // trabajo que le toca atender
+    int cpu;                  // procesador en ese trabajo (-1 = sin afinidad)
+} mc_proc_assign_t;
+
+// Memoria compartida del pool de procesos: la cola de un solo trabajo (sus
+// parametros y rangos) mas un slot por worker. El padre escribe el trabajo y
+// lo publica incrementando 'generation'; los hijos duermen sobre ese contador.
+typedef struct {
+    long long total_points;
+    int num_workers;          // workers que participan del trabajo actual
+    int method;
+    double needle_length;
+    double line_spacing;
+    int rng;
+    int sampling;
+    int precision;
+    unsigned long long seed;
+    int threads;              // hilos del equipo de cada hijo (modo hibrido; 1 = uno)
+    int placement;            // politica de ubicacion del padre, para los equipos
+    volatile int remaining;   // workers que aun no publicaron (espera tipo futex)
+    volatile int generation;  // numero del trabajo publicado
+    volatile int ready;       // hijos que ya abrieron el mapping
+    volatile int shutdown;    // el pool se cierra
+    unsigned long parent;     // PID del padre
+    char ledger[MC_PATH_MAX]; // registro persistente ("" = sin registro)
+    char replay[MC_PATH_MAX]; // flujo grabado ("" = generadores)
+    int num_ranges;
+    volatile long long next_range;    // proximo rango sin repartir
+    mc_proc_range_t ranges[MC_PROC_RANGES];
+    mc_proc_assign_t assign[MAX_PROCESSES];
+    mc_result_slot_t slots[]; // uno por worker
+} shared_data_t;
+
+// Resultado de una corrida. 'elapsed' es el tiempo de computo que mide el
+// propio motor (sin la creacion del pool ni la salida por consola).
+typedef struct {
+    double pi;
+    long long hits;
+    long long points;
+    double elapsed;
+} mc_run_t;
+
+static size_t mc_shared_size(int num_workers) {
+    return sizeof(shared_data_t) + sizeof(mc_result_slot_t) * (size_t)num_workers;
+}
+
+// ==================== GENERACIÓN DE NÚMEROS ALEATORIOS THREAD-SAFE ====================
+unsigned int rand_win(unsigned int* seed) {
+    *seed = (*seed * 1103515245u + 12345u) & 0x7FFFFFFFu;
+    return *seed;
+}
+
+double rand_double_win(unsigned int* seed) {
+    return (double)rand_win(seed) / (double)0x7FFFFFFF;
+}
+
+// ==================== CAPA DE GENERADORES (RNG) ====================
+// Cada muestra tiene un indice global i en [0, total_points) y sus numeros
+// aleatorios dependen solo de (generador, semilla, i). Un worker que procesa
+// el rango [first, first + count) obtiene exactamente las mismas muestras que
+// la version serial en esas posiciones, asi que la particion del trabajo no
+// cambia el resultado y los sub-flujos de los workers nunca se solapan.
+//
+// Cada muestra es un vector de 'dims' coordenadas (la dimension del integrando,
+// hasta MC_MAX_DIMS; Dartboard y Needles usan 2).
+//
+//  - philox:  Philox4x32-10 (contador = indice de la muestra, clave = semilla).
+//             Cada llamada da dos coordenadas; el par j de la muestra usa el
+//             contador (i, j). Sin dependencia entre muestras: se vectoriza
+//             igual que el kernel.
+//  - xoshiro: xoshiro256**. El flujo se divide en bloques de MC_BLOCK_POINTS
+//             muestras; el bloque b arranca en el estado de la semilla avanzado
+//             (b / MC_JUMPS_PER_LONG) long-jumps (2^192) y (b % MC_JUMPS_PER_LONG)
+//             jumps (2^128), por lo que los bloques son disjuntos por construccion.
+//             Cada muestra consume 'dims' salidas consecutivas.
+//  - lcg:     el LCG de 31 bits original (rand_win). La muestra i usa los
+//             valores dims*i+1 .. dims*i+dims de la secuencia, accesibles con
+//             salto en O(log i). Se conserva para comparar con las versiones
+//             anteriores.
+//
+// Las coordenadas en [0,1) de philox y xoshiro son multiplos exactos de 2^-52,
+// asi que las variantes escalares y SIMD producen los mismos doubles.
+enum { MC_RNG_PHILOX = 0, MC_RNG_XOSHIRO, MC_RNG_LCG, MC_RNG_COUNT };
+static const char* const mc_rng_names[] = { "philox", "xoshiro", "lcg" };
+
+#define MC_BLOCK_POINTS 65536
+#define MC_MAX_DIMS 8
+#define MC_JUMPS_PER_LONG 1024
+#define MC_BATCH 512
+#define MC_TWO_POW_M52 (1.0 / 4503599627370496.0)
+#define MC_TWO_POW_M31 (1.0 / 2147483648.0)
+
+// Estrategias de muestreo (ver ESTRATEGIAS DE MUESTREO)
+enum {
+    MC_SAMPLING_MC = 0, MC_SAMPLING_SOBOL, MC_SAMPLING_HALTON, MC_SAMPLING_STRATIFIED,
+    MC_SAMPLING_LHS, MC_SAMPLING_ANTITHETIC, MC_SAMPLING_COUNT
+};
+static const char* const mc_sampling_names[] = {
+    "mc", "sobol", "halton", "stratified", "lhs", "antithetic"
+};
+
+#define MC_HALTON_DIGITS 64     // digitos en base >= 3 (3^40 > 2^63)
+#define MC_STRATA_SIDE 16
+#define MC_LHS_BITS 9
+#define MC_LHS_BLOCK (1 << MC_LHS_BITS)
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+typedef struct {
+    const mc_params_t* params;
+    long long next;                 // indice de la siguiente muestra del cursor
+    long long block;                // bloque xoshiro de xs_block (-1 = ninguno)
+    unsigned long long xs_block[4]; // estado xoshiro al inicio de 'block'
+    unsigned long long xs[4];       // estado xoshiro en la posicion 'next'
+    unsigned int lcg;               // estado LCG en la posicion 'next'
+    int dims;                       // coordenadas por muestra
+    int antithetic;                 // pareja antitetica del integrando (MC_ANTI_*)
+    int sampling_ready;             // tablas de Sobol/Halton calculadas
+    unsigned long long sobol[MC_MAX_DIMS][64];              // direcciones Sobol con scrambling
+    unsigned long long shift[MC_MAX_DIMS];                  // desplazamientos digitales en base 2
+    unsigned char halton[MC_MAX_DIMS][MC_HALTON_DIGITS];    // desplazamientos en la base de Halton
+} mc_stream_t;
+
+int mc_rng_from_name(const char* name) {
+    for (int r = 0; r < MC_RNG_COUNT; r++) {
+        if (strcmp(name, mc_rng_names[r]) == 0) return r;
+    }
+    return -1;
+}
+
+int mc_sampling_from_name(const char* name) {
+    for (int s = 0; s < MC_SAMPLING_COUNT; s++) {
+        if (strcmp(name, mc_sampling_names[s]) == 0) return s;
+    }
+    return -1;
+}
+
+// ---------- Philox4x32-10 ----------
+static inline void philox4x32_10(unsigned int c[4], unsigned int k0, unsigned int k1) {
+    for (int round = 0; round < 10; round++) {
+        unsigned long long p0 = (unsigned long long)PHILOX_M0 * c[0];
+        unsigned long long p1 = (unsigned long long)PHILOX_M1 * c[2];
+        unsigned int n0 = (unsigned int)(p1 >> 32) ^ c[1] ^ k0;
+        unsigned int n2 = (unsigned int)(p0 >> 32) ^ c[3] ^ k1;
+        c[0] = n0;
+        c[1] = (unsigned int)p1;
+        c[2] = n2;
+        c[3] = (unsigned int)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+// 52 bits uniformes a partir de dos palabras: 31 bits altos de a y 21 de b
+static inline double philox_to_unit(unsigned int a, unsigned int b) {
+    return (double)(((unsigned long long)(a >> 1) << 21) | (b >> 11)) * MC_TWO_POW_M52;
+}
+
+// Par de coordenadas 'pair' de las muestras first .. first + n - 1
+static void philox_fill_scalar(unsigned long long seed, unsigned int pair, long long first, int n,
+                               double* x, double* y) {
+    for (int k = 0; k < n; k++) {
+        unsigned long long i = (unsigned long long)first + (unsigned long long)k;
+        unsigned int c[4] = { (unsigned int)i, (unsigned int)(i >> 32), pair, 0u };
+        philox4x32_10(c, (unsigned int)seed, (unsigned int)(seed >> 32));
+        x[k] = philox_to_unit(c[0], c[1]);
+        y[k] = philox_to_unit(c[2], c[3]);
+    }
+}
+
+// Palabras crudas de 32 bits para los modos float e int: la primera palabra
+// de cada coordenada (sus 31 bits altos son los mismos que los del double)
+static void philox_raw_scalar(unsigned long long seed, unsigned int pair, long long first, int n,
+                              unsigned int* x, unsigned int* y) {
+    for (int k = 0; k < n; k++) {
+        unsigned long long i = (unsigned long long)first + (unsigned long long)k;
+        unsigned int c[4] = { (unsigned int)i, (unsigned int)(i >> 32), pair, 0u };
+        philox4x32_10(c, (unsigned int)seed, (unsigned int)(seed >> 32));
+        x[k] = c[0];
+        y[k] = c[2];
+    }
+}
+
+// ---------- xoshiro256** ----------
+static inline unsigned long long rotl64(unsigned long long v, int k) {
+    return (v << k) | (v >> (64 - k));
+}
+
+static inline unsigned long long xoshiro_next(unsigned long long s[4]) {
+    unsigned long long result = rotl64(s[1] * 5, 7) * 9;
+    unsigned long long t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+static void xoshiro_apply_jump(unsigned long long s[4], const unsigned long long poly[4]) {
+    unsigned long long t[4] = { 0, 0, 0, 0 };
+    for (int w = 0; w < 4; w++) {
+        for (int b = 0; b < 64; b++) {
+            if (poly[w] & (1ull << b)) {
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            xoshiro_next(s);
+        }
+    }
+    memcpy(s, t, sizeof(t));
+}
+
+static const unsigned long long XOSHIRO_JUMP[4] = {
+    0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull
+};
+static const unsigned long long XOSHIRO_LONG_JUMP[4] = {
+    0x76e15d3efefdcbbfull, 0xc5004e441c522fb3ull, 0x77710069854ee241ull, 0x39109bb02acbe635ull
+};
+
+static unsigned long long splitmix64(unsigned long long* x) {
+    unsigned long long z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Estado al inicio del bloque 'block'
+static void xoshiro_block_state(unsigned long long seed, long long block, unsigned long long s[4]) {
+    unsigned long long sm = seed;
+    for (int w = 0; w < 4; w++) s[w] = splitmix64(&sm);
+    for (long long j = 0; j < block / MC_JUMPS_PER_LONG; j++) xoshiro_apply_jump(s, XOSHIRO_LONG_JUMP);
+    for (long long j = 0; j < block % MC_JUMPS_PER_LONG; j++) xoshiro_apply_jump(s, XOSHIRO_JUMP);
+}
+
+static inline double xoshiro_to_unit(unsigned long long v) {
+    return (double)(v >> 12) * MC_TWO_POW_M52;
+}
+
+// ---------- LCG original con salto ----------
+// Avanza 'steps' pasos de rand_win componiendo la transformacion afin
+static unsigned int lcg_skip(unsigned int state, unsigned long long steps) {
+    unsigned int a = 1103515245u, c = 12345u;
+    unsigned int acc_a = 1u, acc_c = 0u;
+    while (steps > 0) {
+        if (steps & 1) {
+            acc_a = acc_a * a;
+            acc_c = acc_c * a + c;
+        }
+        c = c * a + c;
+        a = a * a;
+        steps >>= 1;
+    }
+    return (acc_a * state + acc_c) & 0x7FFFFFFFu;
+}
+
+// ==================== KERNELS VECTORIZADOS ====================
+// Las muestras se procesan por lotes de MC_BATCH: Philox genera las
+// coordenadas de 4/8/16 muestras por iteracion (una por carril de 32 bits)
+// y el kernel Dartboard prueba 4/8/16 puntos por iteracion sin saltos: la
+// comparacion produce una mascara que se acumula (SSE2/AVX2) o se cuenta con
+// popcount (AVX-512). El kernel Needles evalua 2/4/8 agujas por iteracion
+// con un polinomio en lugar de sin(). Todas las variantes devuelven los
+// mismos valores que las escalares de referencia.
+typedef void (*philox_fill_fn)(unsigned long long seed, unsigned int pair, long long first, int n,
+                               double* x, double* y);
+typedef long long (*dartboard_count_fn)(const double* x, const double* y, int n);
+typedef long long (*needles_count_fn)(const double* u, const double* v, int n, double half_ratio);
+
+enum { MC_ISA_SCALAR = 0, MC_ISA_SSE2, MC_ISA_AVX2, MC_ISA_AVX512, MC_ISA_COUNT };
+static const char* const mc_isa_names[] = { "SCALAR", "SSE2", "AVX2", "AVX-512" };
+
+// Cuenta de bits portable (no requiere la instruccion POPCNT)
+static inline int mc_popcount32(unsigned int v) {
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    v = (v + (v >> 4)) & 0x0F0F0F0Fu;
+    return (int)((v * 0x01010101u) >> 24);
+}
+
+static long long dartboard_count_scalar(const double* x, const double* y, int n) {
+    long long count = 0;
+    for (int k = 0; k < n; k++) {
+        count += (x[k] * x[k] + y[k] * y[k] <= 1.0);
+    }
+    return count;
+}
+
+// ---------- Needles sin trigonometria ----------
+// La aguja tiene el centro a distancia u*D de la linea inferior y angulo v*pi.
+// Como |sin(pi*v)| = sin(pi*t) con t = min(v, 1 - v) en [0, 1/2], el seno se
+// evalua con la serie de Taylor de sin(pi*t) hasta t^19 (Horner en t^2): el
+// error absoluto es < 6e-16 en todo el intervalo y no se llama a libm. En
+// unidades de D la aguja cubre [u - h, u + h] con h = (L / 2D) * sin, y el
+// numero de lineas que cruza es floor(u + h) - ceil(u - h) + 1. Para L <= D
+// vale 0 o 1 (la prueba original); para agujas largas cuenta cada cruce, y
+// como E[cruces] = 2L / (pi D) para cualquier L, el estimador no cambia.
+#define NEEDLE_SIN_C0  3.141592653589793
+#define NEEDLE_SIN_C1 -5.16771278004997
+#define NEEDLE_SIN_C2  2.5501640398773455
+#define NEEDLE_SIN_C3 -0.5992645293207921
+#define NEEDLE_SIN_C4  0.08214588661112823
+#define NEEDLE_SIN_C5 -0.0073704309457143504
+#define NEEDLE_SIN_C6  0.00046630280576761255
+#define NEEDLE_SIN_C7 -2.1915353447830217e-05
+#define NEEDLE_SIN_C8  7.952054001475513e-07
+#define NEEDLE_SIN_C9 -2.2948428997269873e-08
+
+static inline double needle_sin_pi(double t) {
+    double t2 = t * t;
+    double r = NEEDLE_SIN_C9;
+    r = r * t2 + NEEDLE_SIN_C8;
+    r = r * t2 + NEEDLE_SIN_C7;
+    r = r * t2 + NEEDLE_SIN_C6;
+    r = r * t2 + NEEDLE_SIN_C5;
+    r = r * t2 + NEEDLE_SIN_C4;
+    r = r * t2 + NEEDLE_SIN_C3;
+    r = r * t2 + NEEDLE_SIN_C2;
+    r = r * t2 + NEEDLE_SIN_C1;
+    r = r * t2 + NEEDLE_SIN_C0;
+    return r * t;
+}
+
+static long long needles_count_scalar(const double* u, const double* v, int n, double half_ratio) {
+    long long count = 0;
+    for (int k = 0; k < n; k++) {
+        double t = v[k] < 0.5 ? v[k] : 1.0 - v[k];
+        double h = half_ratio * needle_sin_pi(t);
+        count += (long long)(floor(u[k] + h) - ceil(u[k] - h) + 1.0);
+    }
+    return count;
+}
+
+// ---------- Precision reducida (float e int) ----------
+// --precision elige la aritmetica de los kernels. 'double' es la referencia.
+// Los otros dos modos leen palabras crudas del generador, w = floor(u * 2^32)
+// (con philox, la primera palabra de cada coordenada; sin conversion a
+// double ni division por 0x7FFFFFFF en el LCG):
+//  - int:   Dartboard prueba x^2 + y^2 < R^2 con x = w >> 1, R = 2^31, en
+//           aritmetica entera de 64 bits. Cuenta los vertices inferiores de
+//           una grilla de 2^31 x 2^31 dentro del circulo: el sesgo de pi es
+//           positivo y menor que 2*sqrt(2)*pi / 2^31 < 4.2e-9.
+//  - float: las coordenadas son centros de una grilla de 2^23 celdas,
+//           ((w >> 9) + 1/2) * 2^-23, exactos en float, y el kernel trabaja
+//           en float con el doble de carriles por vector. Cotas del sesgo de
+//           pi: Dartboard < 1.7e-6 (coordenadas a 2^-24 del valor exacto y
+//           redondeo de x^2 + y^2 cerca del borde); Needles < 1.5e-6 +
+//           1.2e-6 * D/L (seno con error < 2^-22 y extremos de la aguja
+//           redondeados a 2^-24 * (1 + L/2D)).
+// Son cotas del peor caso; los errores de redondeo son simetricos y el sesgo
+// observado es mucho menor. Cada modo da la misma cuenta en todas las ISA y
+// con cualquier particion, pero las cuentas de modos distintos difieren.
+// Los integrandos sin kernel para un modo usan double.
+enum { MC_PREC_DOUBLE = 0, MC_PREC_FLOAT, MC_PREC_INT, MC_PREC_COUNT };
+static const char* const mc_precision_names[] = { "double", "float", "int" };
+
+#define MC_TWO_POW_M24F 5.9604644775390625e-08f
+#define MC_INT_R2 (1ull << 62)
+
+typedef void (*philox_raw_fn)(unsigned long long seed, unsigned int pair, long long first, int n,
+                              unsigned int* x, unsigned int* y);
+
+int mc_precision_from_name(const char* name) {
+    for (int m = 0; m < MC_PREC_COUNT; m++) {
+        if (strcmp(name, mc_precision_names[m]) == 0) return m;
+    }
+    return -1;
+}
+
+static inline float mc_word_to_f32(unsigned int w) {
+    return (float)(((w >> 9) << 1) | 1u) * MC_TWO_POW_M24F;
+}
+
+static long long dartboard_int_scalar(const unsigned int* x, const unsigned int* y, int n) {
+    long long count = 0;
+    for (int k = 0; k < n; k++) {
+        unsigned long long a = x[k] >> 1, b = y[k] >> 1;
+        count += (a * a + b * b < MC_INT_R2);
+    }
+    return count;
+}
+
+static long long dartboard_f32_scalar(const unsigned int* x, const unsigned int* y, int n) {
+    long long count = 0;
+    for (int k = 0; k < n; k++) {
+        float a = mc_word_to_f32(x[k]), b = mc_word_to_f32(y[k]);
+        count += (a * a + b * b <= 1.0f);
+    }
+    return count;
+}
+
+// sin(pi*t) en float: Taylor hasta t^13, error de truncado < 7e-10 en [0, 1/2]
+static inline float needle_sin_pi_f32(float t) {
+    float t2 = t * t;
+    float r = (float)NEEDLE_SIN_C6;
+    r = r * t2 + (float)NEEDLE_SIN_C5;
+    r = r * t2 + (float)NEEDLE_SIN_C4;
+    r = r * t2 + (float)NEEDLE_SIN_C3;
+    r = r * t2 + (float)NEEDLE_SIN_C2;
+    r = r * t2 + (float)NEEDLE_SIN_C1;
+    r = r * t2 + (float)NEEDLE_SIN_C0;
+    return r * t;
+}
+
+static long long needles_f32_scalar(const unsigned int* u, const unsigned int* v, int n, float half_ratio) {
+    long long count = 0;
+    for (int k = 0; k < n; k++) {
+        float uu = mc_word_to_f32(u[k]), vv = mc_word_to_f32(v[k]);
+        float t = vv < 0.5f ? vv : 1.0f - vv;
+        float h = half_ratio * needle_sin_pi_f32(t);
+        count += (long long)(floorf(uu + h) - ceilf(uu - h) + 1.0f);
+    }
+    return count;
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MC_HAVE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MC_TARGET(isa)
+#else
+#define MC_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// ---------- SSE2 ----------
+// mulhilo de Philox en 4 carriles: pmuludq multiplica los carriles pares,
+// los impares se desplazan a posiciones pares y se recombinan con mascaras
+MC_TARGET("sse2")
+static inline void mc_mulhilo_sse2(__m128i a, __m128i m, __m128i* hi, __m128i* lo) {
+    const __m128i even_mask = _mm_set_epi32(0, -1, 0, -1);
+    __m128i pe = _mm_mul_epu32(a, m);
+    __m128i po = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    *lo = _mm_or_si128(_mm_and_si128(pe, even_mask), _mm_slli_epi64(po, 32));
+    *hi = _mm_or_si128(_mm_srli_epi64(pe, 32), _mm_andnot_si128(even_mask, po));
+}
+
+// a*2^-31 + b*2^-52 con a = w0 >> 1 y b = w1 >> 11: exacto, igual que philox_to_unit
+MC_TARGET("sse2")
+static inline void mc_store_unit_sse2(double* out, __m128i w0, __m128i w1) {
+    const __m128d s31 = _mm_set1_pd(MC_TWO_POW_M31);
+    const __m128d s52 = _mm_set1_pd(MC_TWO_POW_M52);
+    __m128i a = _mm_srli_epi32(w0, 1);
+    __m128i b = _mm_srli_epi32(w1, 11);
+    __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(a), s31), _mm_mul_pd(_mm_cvtepi32_pd(b), s52));
+    __m128d hi = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2))), s31),
+                            _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2))), s52));
+    _mm_storeu_pd(out, lo);
+    _mm_storeu_pd(out + 2, hi);
+}
+
+// Diez rondas de Philox sobre 4 contadores consecutivos desde 'index'
+MC_TARGET("sse2")
+static inline void mc_philox_block_sse2(unsigned long long seed, unsigned int pair, unsigned int index,
+                                        __m128i hi_word, __m128i c[4]) {
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32((int)PHILOX_M1);
+    __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)index), _mm_set_epi32(3, 2, 1, 0));
+    __m128i c1 = hi_word;
+    __m128i c2 = _mm_set1_epi32((int)pair);
+    __m128i c3 = _mm_setzero_si128();
+    unsigned int k0 = (unsigned int)seed, k1 = (unsigned int)(seed >> 32);
+    for (int round = 0; round < 10; round++) {
+        __m128i hi0, lo0, hi1, lo1;
+        mc_mulhilo_sse2(c0, m0, &hi0, &lo0);
+        mc_mulhilo_sse2(c2, m1, &hi1, &lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+    c[3] = c3;
+}
+
+MC_TARGET("sse2")
+static void philox_fill_sse2(unsigned long long seed, unsigned int pair, long long first, int n,
+                             double* x, double* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    // El vector de contadores no puede cruzar un acarreo hacia la palabra alta
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m128i hi_word = _mm_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 4 <= n; k += 4) {
+            __m128i c[4];
+            mc_philox_block_sse2(seed, pair, base + (unsigned int)k, hi_word, c);
+            mc_store_unit_sse2(x + k, c[0], c[1]);
+            mc_store_unit_sse2(y + k, c[2], c[3]);
+        }
+    }
+    philox_fill_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+// Palabras crudas: la primera de cada coordenada, sin pasar a double
+MC_TARGET("sse2")
+static void philox_raw_sse2(unsigned long long seed, unsigned int pair, long long first, int n,
+                            unsigned int* x, unsigned int* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m128i hi_word = _mm_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 4 <= n; k += 4) {
+            __m128i c[4];
+            mc_philox_block_sse2(seed, pair, base + (unsigned int)k, hi_word, c);
+            _mm_storeu_si128((__m128i*)(x + k), c[0]);
+            _mm_storeu_si128((__m128i*)(y + k), c[2]);
+        }
+    }
+    philox_raw_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+MC_TARGET("sse2")
+static long long dartboard_count_sse2(const double* x, const double* y, int n) {
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128i acc = _mm_setzero_si128();
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        __m128d x0 = _mm_loadu_pd(x + k), x1 = _mm_loadu_pd(x + k + 2);
+        __m128d y0 = _mm_loadu_pd(y + k), y1 = _mm_loadu_pd(y + k + 2);
+        // Mascara de todos unos (= -1) por punto dentro: restar acumula la cuenta
+        __m128d in0 = _mm_cmple_pd(_mm_add_pd(_mm_mul_pd(x0, x0), _mm_mul_pd(y0, y0)), one);
+        __m128d in1 = _mm_cmple_pd(_mm_add_pd(_mm_mul_pd(x1, x1), _mm_mul_pd(y1, y1)), one);
+        acc = _mm_sub_epi64(acc, _mm_castpd_si128(in0));
+        acc = _mm_sub_epi64(acc, _mm_castpd_si128(in1));
+    }
+
+    long long parts[2];
+    _mm_storeu_si128((__m128i*)parts, acc);
+    return parts[0] + parts[1] + dartboard_count_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("sse2")
+static inline __m128d needle_sin_pi_sse2(__m128d t) {
+    __m128d t2 = _mm_mul_pd(t, t);
+    __m128d r = _mm_set1_pd(NEEDLE_SIN_C9);
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C8));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C7));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C6));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C5));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C4));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C3));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C2));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C1));
+    r = _mm_add_pd(_mm_mul_pd(r, t2), _mm_set1_pd(NEEDLE_SIN_C0));
+    return _mm_mul_pd(r, t);
+}
+
+// SSE2 no tiene floor/ceil: se trunca con cvttpd (|valor| < 2^31) y se corrige
+MC_TARGET("sse2")
+static long long needles_count_sse2(const double* u, const double* v, int n, double half_ratio) {
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d ratio = _mm_set1_pd(half_ratio);
+    __m128d acc = _mm_setzero_pd();
+    int k = 0;
+
+    if (half_ratio < 1073741824.0) {
+        for (; k + 2 <= n; k += 2) {
+            __m128d uu = _mm_loadu_pd(u + k);
+            __m128d vv = _mm_loadu_pd(v + k);
+            __m128d h = _mm_mul_pd(ratio, needle_sin_pi_sse2(_mm_min_pd(vv, _mm_sub_pd(one, vv))));
+            __m128d a = _mm_add_pd(uu, h);
+            __m128d b = _mm_sub_pd(uu, h);
+            __m128d floor_a = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a));       // a >= 0
+            __m128d trunc_b = _mm_cvtepi32_pd(_mm_cvttpd_epi32(b));
+            __m128d ceil_b = _mm_add_pd(trunc_b, _mm_and_pd(_mm_cmpgt_pd(b, trunc_b), one));
+            acc = _mm_add_pd(acc, _mm_add_pd(_mm_sub_pd(floor_a, ceil_b), one));
+        }
+    }
+
+    double parts[2];
+    _mm_storeu_pd(parts, acc);
+    return (long long)(parts[0] + parts[1]) + needles_count_scalar(u + k, v + k, n - k, half_ratio);
+}
+
+// Palabras crudas a float: ((w >> 9) + 1/2) * 2^-23, igual que mc_word_to_f32
+MC_TARGET("sse2")
+static inline __m128 mc_word_to_f32_sse2(__m128i w) {
+    __m128i m = _mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(w, 9), 1), _mm_set1_epi32(1));
+    return _mm_mul_ps(_mm_cvtepi32_ps(m), _mm_set1_ps(MC_TWO_POW_M24F));
+}
+
+// Cuadrados de 64 bits con pmuludq (carriles pares e impares por separado):
+// x^2 + y^2 < 2^63, asi que el bit 62 de la suma marca los puntos fuera
+MC_TARGET("sse2")
+static long long dartboard_int_sse2(const unsigned int* x, const unsigned int* y, int n) {
+    __m128i outside = _mm_setzero_si128();
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        __m128i a = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(x + k)), 1);
+        __m128i b = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(y + k)), 1);
+        __m128i ao = _mm_srli_epi64(a, 32), bo = _mm_srli_epi64(b, 32);
+        __m128i even = _mm_add_epi64(_mm_mul_epu32(a, a), _mm_mul_epu32(b, b));
+        __m128i odd = _mm_add_epi64(_mm_mul_epu32(ao, ao), _mm_mul_epu32(bo, bo));
+        outside = _mm_add_epi64(outside, _mm_srli_epi64(even, 62));
+        outside = _mm_add_epi64(outside, _mm_srli_epi64(odd, 62));
+    }
+
+    long long parts[2];
+    _mm_storeu_si128((__m128i*)parts, outside);
+    return k - parts[0] - parts[1] + dartboard_int_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("sse2")
+static long long dartboard_f32_sse2(const unsigned int* x, const unsigned int* y, int n) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i acc = _mm_setzero_si128();
+    int k = 0;
+
+    // Contadores de 32 bits por carril: a lo sumo MC_BATCH / 4 por lote
+    for (; k + 4 <= n; k += 4) {
+        __m128 a = mc_word_to_f32_sse2(_mm_loadu_si128((const __m128i*)(x + k)));
+        __m128 b = mc_word_to_f32_sse2(_mm_loadu_si128((const __m128i*)(y + k)));
+        acc = _mm_sub_epi32(acc, _mm_castps_si128(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), one)));
+    }
+
+    int parts[4];
+    _mm_storeu_si128((__m128i*)parts, acc);
+    return (long long)(parts[0] + parts[1] + parts[2] + parts[3]) + dartboard_f32_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("sse2")
+static inline __m128 needle_sin_pi_f32_sse2(__m128 t) {
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 r = _mm_set1_ps((float)NEEDLE_SIN_C6);
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C5));
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C4));
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C2));
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C1));
+    r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps((float)NEEDLE_SIN_C0));
+    return _mm_mul_ps(r, t);
+}
+
+// Como en needles_count_sse2, floor y ceil salen de cvttps (a >= 0)
+MC_TARGET("sse2")
+static long long needles_f32_sse2(const unsigned int* u, const unsigned int* v, int n, float half_ratio) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 ratio = _mm_set1_ps(half_ratio);
+    const __m128i ones = _mm_set1_epi32(1);
+    __m128i acc = _mm_setzero_si128();
+    int k = 0;
+
+    // Cruces por carril en 32 bits: alcanza con agujas de menos de 2^23 D
+    if (half_ratio < 4194304.0f) {
+        for (; k + 4 <= n; k += 4) {
+            __m128 uu = mc_word_to_f32_sse2(_mm_loadu_si128((const __m128i*)(u + k)));
+            __m128 vv = mc_word_to_f32_sse2(_mm_loadu_si128((const __m128i*)(v + k)));
+            __m128 h = _mm_mul_ps(ratio, needle_sin_pi_f32_sse2(_mm_min_ps(vv, _mm_sub_ps(one, vv))));
+            __m128 b = _mm_sub_ps(uu, h);
+            __m128i floor_a = _mm_cvttps_epi32(_mm_add_ps(uu, h));
+            __m128i trunc_b = _mm_cvttps_epi32(b);
+            // -1 donde ceil(b) = trunc(b) + 1
+            __m128i up = _mm_castps_si128(_mm_cmpgt_ps(b, _mm_cvtepi32_ps(trunc_b)));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_sub_epi32(floor_a, trunc_b), _mm_add_epi32(up, ones)));
+        }
+    }
+
+    int parts[4];
+    _mm_storeu_si128((__m128i*)parts, acc);
+    return (long long)parts[0] + parts[1] + parts[2] + parts[3]
+           + needles_f32_scalar(u + k, v + k, n - k, half_ratio);
+}
+
+// ---------- AVX2 ----------
+MC_TARGET("avx2")
+static inline void mc_mulhilo_avx2(__m256i a, __m256i m, __m256i* hi, __m256i* lo) {
+    __m256i pe = _mm256_mul_epu32(a, m);
+    __m256i po = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_blend_epi32(pe, _mm256_slli_epi64(po, 32), 0xAA);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(pe, 32), po, 0xAA);
+}
+
+MC_TARGET("avx2")
+static inline void mc_store_unit_avx2(double* out, __m256i w0, __m256i w1) {
+    const __m256d s31 = _mm256_set1_pd(MC_TWO_POW_M31);
+    const __m256d s52 = _mm256_set1_pd(MC_TWO_POW_M52);
+    __m256i a = _mm256_srli_epi32(w0, 1);
+    __m256i b = _mm256_srli_epi32(w1, 11);
+    __m256d lo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)), s31),
+                               _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(b)), s52));
+    __m256d hi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)), s31),
+                               _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1)), s52));
+    _mm256_storeu_pd(out, lo);
+    _mm256_storeu_pd(out + 4, hi);
+}
+
+// Diez rondas de Philox sobre 8 contadores consecutivos desde 'index'
+MC_TARGET("avx2")
+static inline void mc_philox_block_avx2(unsigned long long seed, unsigned int pair, unsigned int index,
+                                        __m256i hi_word, __m256i c[4]) {
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)index), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    __m256i c1 = hi_word;
+    __m256i c2 = _mm256_set1_epi32((int)pair);
+    __m256i c3 = _mm256_setzero_si256();
+    unsigned int k0 = (unsigned int)seed, k1 = (unsigned int)(seed >> 32);
+    for (int round = 0; round < 10; round++) {
+        __m256i hi0, lo0, hi1, lo1;
+        mc_mulhilo_avx2(c0, m0, &hi0, &lo0);
+        mc_mulhilo_avx2(c2, m1, &hi1, &lo1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+    c[3] = c3;
+}
+
+MC_TARGET("avx2")
+static void philox_fill_avx2(unsigned long long seed, unsigned int pair, long long first, int n,
+                             double* x, double* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    // El vector de contadores no puede cruzar un acarreo hacia la palabra alta
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m256i hi_word = _mm256_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 8 <= n; k += 8) {
+            __m256i c[4];
+            mc_philox_block_avx2(seed, pair, base + (unsigned int)k, hi_word, c);
+            mc_store_unit_avx2(x + k, c[0], c[1]);
+            mc_store_unit_avx2(y + k, c[2], c[3]);
+        }
+    }
+    philox_fill_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+// Palabras crudas: la primera de cada coordenada, sin pasar a double
+MC_TARGET("avx2")
+static void philox_raw_avx2(unsigned long long seed, unsigned int pair, long long first, int n,
+                            unsigned int* x, unsigned int* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m256i hi_word = _mm256_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 8 <= n; k += 8) {
+            __m256i c[4];
+            mc_philox_block_avx2(seed, pair, base + (unsigned int)k, hi_word, c);
+            _mm256_storeu_si256((__m256i*)(x + k), c[0]);
+            _mm256_storeu_si256((__m256i*)(y + k), c[2]);
+        }
+    }
+    philox_raw_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+MC_TARGET("avx2")
+static long long dartboard_count_avx2(const double* x, const double* y, int n) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256i acc = _mm256_setzero_si256();
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m256d x0 = _mm256_loadu_pd(x + k), x1 = _mm256_loadu_pd(x + k + 4);
+        __m256d y0 = _mm256_loadu_pd(y + k), y1 = _mm256_loadu_pd(y + k + 4);
+        __m256d in0 = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(x0, x0), _mm256_mul_pd(y0, y0)), one, _CMP_LE_OQ);
+        __m256d in1 = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(x1, x1), _mm256_mul_pd(y1, y1)), one, _CMP_LE_OQ);
+        acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(in0));
+        acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(in1));
+    }
+
+    long long parts[4];
+    _mm256_storeu_si256((__m256i*)parts, acc);
+    return parts[0] + parts[1] + parts[2] + parts[3] + dartboard_count_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx2")
+static inline __m256d needle_sin_pi_avx2(__m256d t) {
+    __m256d t2 = _mm256_mul_pd(t, t);
+    __m256d r = _mm256_set1_pd(NEEDLE_SIN_C9);
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C8));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C7));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C6));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C5));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C4));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C3));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C2));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C1));
+    r = _mm256_add_pd(_mm256_mul_pd(r, t2), _mm256_set1_pd(NEEDLE_SIN_C0));
+    return _mm256_mul_pd(r, t);
+}
+
+MC_TARGET("avx2")
+static long long needles_count_avx2(const double* u, const double* v, int n, double half_ratio) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d ratio = _mm256_set1_pd(half_ratio);
+    __m256d acc = _mm256_setzero_pd();
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        __m256d uu = _mm256_loadu_pd(u + k);
+        __m256d vv = _mm256_loadu_pd(v + k);
+        __m256d h = _mm256_mul_pd(ratio, needle_sin_pi_avx2(_mm256_min_pd(vv, _mm256_sub_pd(one, vv))));
+        __m256d cross = _mm256_sub_pd(_mm256_floor_pd(_mm256_add_pd(uu, h)), _mm256_ceil_pd(_mm256_sub_pd(uu, h)));
+        acc = _mm256_add_pd(acc, _mm256_add_pd(cross, one));
+    }
+
+    double parts[4];
+    _mm256_storeu_pd(parts, acc);
+    return (long long)(parts[0] + parts[1] + parts[2] + parts[3])
+           + needles_count_scalar(u + k, v + k, n - k, half_ratio);
+}
+
+// Palabras crudas a float: ((w >> 9) + 1/2) * 2^-23, igual que mc_word_to_f32
+MC_TARGET("avx2")
+static inline __m256 mc_word_to_f32_avx2(__m256i w) {
+    __m256i m = _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(w, 9), 1), _mm256_set1_epi32(1));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(m), _mm256_set1_ps(MC_TWO_POW_M24F));
+}
+
+MC_TARGET("avx2")
+static long long dartboard_int_avx2(const unsigned int* x, const unsigned int* y, int n) {
+    __m256i outside = _mm256_setzero_si256();
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m256i a = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i*)(x + k)), 1);
+        __m256i b = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i*)(y + k)), 1);
+        __m256i ao = _mm256_srli_epi64(a, 32), bo = _mm256_srli_epi64(b, 32);
+        __m256i even = _mm256_add_epi64(_mm256_mul_epu32(a, a), _mm256_mul_epu32(b, b));
+        __m256i odd = _mm256_add_epi64(_mm256_mul_epu32(ao, ao), _mm256_mul_epu32(bo, bo));
+        outside = _mm256_add_epi64(outside, _mm256_srli_epi64(even, 62));
+        outside = _mm256_add_epi64(outside, _mm256_srli_epi64(odd, 62));
+    }
+
+    long long parts[4];
+    _mm256_storeu_si256((__m256i*)parts, outside);
+    return k - parts[0] - parts[1] - parts[2] - parts[3] + dartboard_int_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx2")
+static long long dartboard_f32_avx2(const unsigned int* x, const unsigned int* y, int n) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i acc = _mm256_setzero_si256();
+    int k = 0;
+
+    // Contadores de 32 bits por carril: a lo sumo MC_BATCH / 8 por lote
+    for (; k + 8 <= n; k += 8) {
+        __m256 a = mc_word_to_f32_avx2(_mm256_loadu_si256((const __m256i*)(x + k)));
+        __m256 b = mc_word_to_f32_avx2(_mm256_loadu_si256((const __m256i*)(y + k)));
+        acc = _mm256_sub_epi32(acc, _mm256_castps_si256(_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b)), one, _CMP_LE_OQ)));
+    }
+
+    int parts[8];
+    _mm256_storeu_si256((__m256i*)parts, acc);
+    return (long long)(parts[0] + parts[1] + parts[2] + parts[3] + parts[4] + parts[5] + parts[6] + parts[7]) + dartboard_f32_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx2")
+static inline __m256 needle_sin_pi_f32_avx2(__m256 t) {
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 r = _mm256_set1_ps((float)NEEDLE_SIN_C6);
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C5));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C4));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C3));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C2));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C1));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t2), _mm256_set1_ps((float)NEEDLE_SIN_C0));
+    return _mm256_mul_ps(r, t);
+}
+
+MC_TARGET("avx2")
+static long long needles_f32_avx2(const unsigned int* u, const unsigned int* v, int n, float half_ratio) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 ratio = _mm256_set1_ps(half_ratio);
+    __m256i acc = _mm256_setzero_si256();
+    int k = 0;
+
+    if (half_ratio < 4194304.0f) {
+        for (; k + 8 <= n; k += 8) {
+            __m256 uu = mc_word_to_f32_avx2(_mm256_loadu_si256((const __m256i*)(u + k)));
+            __m256 vv = mc_word_to_f32_avx2(_mm256_loadu_si256((const __m256i*)(v + k)));
+            __m256 h = _mm256_mul_ps(ratio, needle_sin_pi_f32_avx2(_mm256_min_ps(vv, _mm256_sub_ps(one, vv))));
+            __m256 floor_a = _mm256_floor_ps(_mm256_add_ps(uu, h));
+            __m256 ceil_b = _mm256_ceil_ps(_mm256_sub_ps(uu, h));
+            __m256 cross = _mm256_add_ps(_mm256_sub_ps(floor_a, ceil_b), one);
+            acc = _mm256_add_epi32(acc, _mm256_cvttps_epi32(cross));
+        }
+    }
+
+    int parts[8];
+    _mm256_storeu_si256((__m256i*)parts, acc);
+    return (long long)parts[0] + parts[1] + parts[2] + parts[3] + parts[4] + parts[5] + parts[6] + parts[7]
+           + needles_f32_scalar(u + k, v + k, n - k, half_ratio);
+}
+
+// ---------- AVX-512 ----------
+MC_TARGET("avx512f")
+static inline void mc_mulhilo_avx512(__m512i a, __m512i m, __m512i* hi, __m512i* lo) {
+    __m512i pe = _mm512_mul_epu32(a, m);
+    __m512i po = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), m);
+    *lo = _mm512_mask_blend_epi32(0xAAAA, pe, _mm512_slli_epi64(po, 32));
+    *hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(pe, 32), po);
+}
+
+MC_TARGET("avx512f")
+static inline void mc_store_unit_avx512(double* out, __m512i w0, __m512i w1) {
+    const __m512d s31 = _mm512_set1_pd(MC_TWO_POW_M31);
+    const __m512d s52 = _mm512_set1_pd(MC_TWO_POW_M52);
+    __m512i a = _mm512_srli_epi32(w0, 1);
+    __m512i b = _mm512_srli_epi32(w1, 11);
+    __m512d lo = _mm512_add_pd(_mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(a)), s31),
+                               _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(b)), s52));
+    __m512d hi = _mm512_add_pd(_mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(a, 1)), s31),
+                               _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(b, 1)), s52));
+    _mm512_storeu_pd(out, lo);
+    _mm512_storeu_pd(out + 8, hi);
+}
+
+// Diez rondas de Philox sobre 16 contadores consecutivos desde 'index'
+MC_TARGET("avx512f")
+static inline void mc_philox_block_avx512(unsigned long long seed, unsigned int pair, unsigned int index,
+                                        __m512i hi_word, __m512i c[4]) {
+    const __m512i m0 = _mm512_set1_epi32((int)PHILOX_M0);
+    const __m512i m1 = _mm512_set1_epi32((int)PHILOX_M1);
+    __m512i c0 = _mm512_add_epi32(_mm512_set1_epi32((int)index),
+                                 _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    __m512i c1 = hi_word;
+    __m512i c2 = _mm512_set1_epi32((int)pair);
+    __m512i c3 = _mm512_setzero_si512();
+    unsigned int k0 = (unsigned int)seed, k1 = (unsigned int)(seed >> 32);
+    for (int round = 0; round < 10; round++) {
+        __m512i hi0, lo0, hi1, lo1;
+        mc_mulhilo_avx512(c0, m0, &hi0, &lo0);
+        mc_mulhilo_avx512(c2, m1, &hi1, &lo1);
+        c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32((int)k1));
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+    c[3] = c3;
+}
+
+MC_TARGET("avx512f")
+static void philox_fill_avx512(unsigned long long seed, unsigned int pair, long long first, int n,
+                             double* x, double* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    // El vector de contadores no puede cruzar un acarreo hacia la palabra alta
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m512i hi_word = _mm512_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 16 <= n; k += 16) {
+            __m512i c[4];
+            mc_philox_block_avx512(seed, pair, base + (unsigned int)k, hi_word, c);
+            mc_store_unit_avx512(x + k, c[0], c[1]);
+            mc_store_unit_avx512(y + k, c[2], c[3]);
+        }
+    }
+    philox_fill_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+// Palabras crudas: la primera de cada coordenada, sin pasar a double
+MC_TARGET("avx512f")
+static void philox_raw_avx512(unsigned long long seed, unsigned int pair, long long first, int n,
+                            unsigned int* x, unsigned int* y) {
+    unsigned int base = (unsigned int)first;
+    int k = 0;
+
+    if ((unsigned long long)base + (unsigned int)n <= 0x100000000ull) {
+        __m512i hi_word = _mm512_set1_epi32((int)((unsigned long long)first >> 32));
+        for (; k + 16 <= n; k += 16) {
+            __m512i c[4];
+            mc_philox_block_avx512(seed, pair, base + (unsigned int)k, hi_word, c);
+            _mm512_storeu_si512((__m512i*)(x + k), c[0]);
+            _mm512_storeu_si512((__m512i*)(y + k), c[2]);
+        }
+    }
+    philox_raw_scalar(seed, pair, first + k, n - k, x + k, y + k);
+}
+
+MC_TARGET("avx512f")
+static long long dartboard_count_avx512(const double* x, const double* y, int n) {
+    const __m512d one = _mm512_set1_pd(1.0);
+    long long count = 0;
+    int k = 0;
+
+    for (; k + 16 <= n; k += 16) {
+        __m512d x0 = _mm512_loadu_pd(x + k), x1 = _mm512_loadu_pd(x + k + 8);
+        __m512d y0 = _mm512_loadu_pd(y + k), y1 = _mm512_loadu_pd(y + k + 8);
+        __mmask8 in0 = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(x0, x0), _mm512_mul_pd(y0, y0)), one, _CMP_LE_OQ);
+        __mmask8 in1 = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(x1, x1), _mm512_mul_pd(y1, y1)), one, _CMP_LE_OQ);
+        count += mc_popcount32(((unsigned int)in1 << 8) | in0);
+    }
+
+    return count + dartboard_count_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx512f")
+static inline __m512d needle_sin_pi_avx512(__m512d t) {
+    __m512d t2 = _mm512_mul_pd(t, t);
+    __m512d r = _mm512_set1_pd(NEEDLE_SIN_C9);
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C8));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C7));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C6));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C5));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C4));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C3));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C2));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C1));
+    r = _mm512_add_pd(_mm512_mul_pd(r, t2), _mm512_set1_pd(NEEDLE_SIN_C0));
+    return _mm512_mul_pd(r, t);
+}
+
+MC_TARGET("avx512f")
+static long long needles_count_avx512(const double* u, const double* v, int n, double half_ratio) {
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d ratio = _mm512_set1_pd(half_ratio);
+    __m512d acc = _mm512_setzero_pd();
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m512d uu = _mm512_loadu_pd(u + k);
+        __m512d vv = _mm512_loadu_pd(v + k);
+        __m512d h = _mm512_mul_pd(ratio, needle_sin_pi_avx512(_mm512_min_pd(vv, _mm512_sub_pd(one, vv))));
+        __m512d floor_a = _mm512_roundscale_pd(_mm512_add_pd(uu, h), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        __m512d ceil_b = _mm512_roundscale_pd(_mm512_sub_pd(uu, h), _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+        acc = _mm512_add_pd(acc, _mm512_add_pd(_mm512_sub_pd(floor_a, ceil_b), one));
+    }
+
+    return (long long)_mm512_reduce_add_pd(acc) + needles_count_scalar(u + k, v + k, n - k, half_ratio);
+}
+// Palabras crudas a float: ((w >> 9) + 1/2) * 2^-23, igual que mc_word_to_f32
+MC_TARGET("avx512f")
+static inline __m512 mc_word_to_f32_avx512(__m512i w) {
+    __m512i m = _mm512_or_si512(_mm512_slli_epi32(_mm512_srli_epi32(w, 9), 1), _mm512_set1_epi32(1));
+    return _mm512_mul_ps(_mm512_cvtepi32_ps(m), _mm512_set1_ps(MC_TWO_POW_M24F));
+}
+
+MC_TARGET("avx512f")
+static long long dartboard_int_avx512(const unsigned int* x, const unsigned int* y, int n) {
+    __m512i outside = _mm512_setzero_si512();
+    int k = 0;
+
+    for (; k + 16 <= n; k += 16) {
+        __m512i a = _mm512_srli_epi32(_mm512_loadu_si512((const __m512i*)(x + k)), 1);
+        __m512i b = _mm512_srli_epi32(_mm512_loadu_si512((const __m512i*)(y + k)), 1);
+        __m512i ao = _mm512_srli_epi64(a, 32), bo = _mm512_srli_epi64(b, 32);
+        __m512i even = _mm512_add_epi64(_mm512_mul_epu32(a, a), _mm512_mul_epu32(b, b));
+        __m512i odd = _mm512_add_epi64(_mm512_mul_epu32(ao, ao), _mm512_mul_epu32(bo, bo));
+        outside = _mm512_add_epi64(outside, _mm512_srli_epi64(even, 62));
+        outside = _mm512_add_epi64(outside, _mm512_srli_epi64(odd, 62));
+    }
+
+    return k - _mm512_reduce_add_epi64(outside) + dartboard_int_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx512f")
+static long long dartboard_f32_avx512(const unsigned int* x, const unsigned int* y, int n) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    long long count = 0;
+    int k = 0;
+
+    for (; k + 16 <= n; k += 16) {
+        __m512 a = mc_word_to_f32_avx512(_mm512_loadu_si512((const __m512i*)(x + k)));
+        __m512 b = mc_word_to_f32_avx512(_mm512_loadu_si512((const __m512i*)(y + k)));
+        __mmask16 in = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(a, a), _mm512_mul_ps(b, b)), one, _CMP_LE_OQ);
+        count += mc_popcount32((unsigned int)in);
+    }
+
+    return count + dartboard_f32_scalar(x + k, y + k, n - k);
+}
+
+MC_TARGET("avx512f")
+static inline __m512 needle_sin_pi_f32_avx512(__m512 t) {
+    __m512 t2 = _mm512_mul_ps(t, t);
+    __m512 r = _mm512_set1_ps((float)NEEDLE_SIN_C6);
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C5));
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C4));
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C3));
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C2));
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C1));
+    r = _mm512_add_ps(_mm512_mul_ps(r, t2), _mm512_set1_ps((float)NEEDLE_SIN_C0));
+    return _mm512_mul_ps(r, t);
+}
+
+MC_TARGET("avx512f")
+static long long needles_f32_avx512(const unsigned int* u, const unsigned int* v, int n, float half_ratio) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 ratio = _mm512_set1_ps(half_ratio);
+    __m512i acc = _mm512_setzero_si512();
+    int k = 0;
+
+    if (half_ratio < 4194304.0f) {
+        for (; k + 16 <= n; k += 16) {
+            __m512 uu = mc_word_to_f32_avx512(_mm512_loadu_si512((const __m512i*)(u + k)));
+            __m512 vv = mc_word_to_f32_avx512(_mm512_loadu_si512((const __m512i*)(v + k)));
+            __m512 h = _mm512_mul_ps(ratio, needle_sin_pi_f32_avx512(_mm512_min_ps(vv, _mm512_sub_ps(one, vv))));
+            __m512 floor_a = _mm512_roundscale_ps(_mm512_add_ps(uu, h), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+            __m512 ceil_b = _mm512_roundscale_ps(_mm512_sub_ps(uu, h), _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+            __m512 cross = _mm512_add_ps(_mm512_sub_ps(floor_a, ceil_b), one);
+            acc = _mm512_add_epi32(acc, _mm512_cvttps_epi32(cross));
+        }
+    }
+
+    return (long long)_mm512_reduce_add_epi32(acc) + needles_f32_scalar(u + k, v + k, n - k, half_ratio);
+}
+
+#endif
+
+static int g_isa = MC_ISA_SCALAR;
+static philox_fill_fn g_philox_fill = philox_fill_scalar;
+static philox_raw_fn g_philox_raw = philox_raw_scalar;
+
+// ISA mas ancha que soportan la CPU y el sistema operativo
+static int mc_detect_isa(void) {
+#if defined(MC_HAVE_X86) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    int has_sse2 = (regs[3] >> 26) & 1;
+    int has_osxsave = (regs[2] >> 27) & 1;
+    int has_avx2 = 0, has_avx512 = 0;
+    if (has_osxsave && max_leaf >= 7) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(regs, 7, 0);
+        has_avx2 = ((regs[1] >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+        has_avx512 = ((regs[1] >> 16) & 1) && (xcr0 & 0xE6) == 0xE6;
+    }
+    if (has_avx512) return MC_ISA_AVX512;
+    if (has_avx2) return MC_ISA_AVX2;
+    if (has_sse2) return MC_ISA_SSE2;
+#elif defined(MC_HAVE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return MC_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return MC_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2")) return MC_ISA_SSE2;
+#endif
+    return MC_ISA_SCALAR;
+}
+
+// Activa los kernels de 'isa' (o de la mas ancha soportada, si es menor).
+// Los integrandos con variantes SIMD toman la de g_isa (ver mc_integrand_kernel).
+void mc_set_isa(int isa) {
+    int best = mc_detect_isa();
+    if (isa > best) isa = best;
+
+    g_isa = isa;
+    switch (isa) {
+#ifdef MC_HAVE_X86
+        case MC_ISA_AVX512:
+            g_philox_fill = philox_fill_avx512;
+            g_philox_raw = philox_raw_avx512;
+            break;
+        case MC_ISA_AVX2:
+            g_philox_fill = philox_fill_avx2;
+            g_philox_raw = philox_raw_avx2;
+            break;
+        case MC_ISA_SSE2:
+            g_philox_fill = philox_fill_sse2;
+            g_philox_raw = philox_raw_sse2;
+            break;
+#endif
+        default:
+            g_philox_fill = philox_fill_scalar;
+            g_philox_raw = philox_raw_scalar;
+            break;
+    }
+}
+
+// Elige los kernels al arrancar. MC_ISA=scalar|sse2|avx2|avx512 permite forzar
+// una ISA menor para comparar (nunca una que la CPU no soporte); forzada, el
+// perfil de 'programa tune' no la cambia.
+static int g_isa_forced = 0;
+
+void mc_select_kernels(void) {
+    int isa = mc_detect_isa();
+    const char* forced = getenv("MC_ISA");
+
+    if (forced != NULL) {
+        g_isa_forced = 1;
+        if (strcmp(forced, "scalar") == 0) isa = MC_ISA_SCALAR;
+        else if (strcmp(forced, "sse2") == 0) isa = MC_ISA_SSE2;
+        else if (strcmp(forced, "avx2") == 0) isa = MC_ISA_AVX2;
+        else if (strcmp(forced, "avx512") == 0) isa = MC_ISA_AVX512;
+        else g_isa_forced = 0;
+    }
+    mc_set_isa(isa);
+}
+
+// ==================== INTEGRANDOS ====================
+// Un integrando es la funcion cuya esperanza se estima sobre el cubo unitario
+// [0,1)^dims. Su kernel recibe un lote de n vectores aleatorios en columnas
+// (u[d][k] es la coordenada d de la muestra k) y devuelve la suma de los
+// aportes de las n muestras como entero:
+//  - conteo (scale = 1): el aporte es un entero, p. ej. 1 si el punto cae
+//    dentro (Dartboard) o el numero de lineas que cruza la aguja (Needles).
+//  - suma (scale > 1): el aporte es round(f(u) * scale), una suma en punto
+//    fijo. Como cada muestra aporta un entero, el total no depende del orden
+//    ni de la particion, igual que en los conteos. La resolucion es 1 / scale
+//    y el total de la corrida debe quedar por debajo de 2^63 / scale.
+// Los motores (serial, threads, procesos, adaptativo, TCP) solo ven estos
+// enteros y el numero de muestras; la media por muestra (aciertos / scale /
+// puntos) se convierte en el resultado con 'estimate'.
+//
+// El kernel se llama una vez por lote de MC_BATCH muestras. MC_COUNT_KERNEL y
+// MC_SUM_KERNEL generan uno a partir de una expresion por muestra, que queda
+// dentro del bucle (el compilador la puede vectorizar); dentro de ella
+// MC_U(d) es la coordenada d y MC_P los parametros. Dartboard y Needles
+// tienen ademas variantes SIMD escritas a mano, una por ISA.
+//
+// Con --precision float o int el kernel recibe en cambio las palabras crudas
+// de 32 bits (w[d][k]); solo Dartboard y Needles tienen esas variantes.
+//
+// Para agregar un integrando: definir su kernel, su 'estimate' (y 'range' si
+// el aporte por muestra no esta en [0, 1]), sumar una constante MC_METHOD_*,
+// su nombre en mc_method_names y su entrada en mc_integrands.
+typedef long long (*mc_batch_fn)(double* const* u, int n, const mc_params_t* p);
+typedef long long (*mc_raw_batch_fn)(unsigned int* const* w, int n, const mc_params_t* p);
+
+// Pareja de la muestra en --sampling antithetic
+enum { MC_ANTI_REFLECT = 0, MC_ANTI_SHIFT };
+
+typedef struct {
+    const char* title;                  // nombre en los menus
+    const char* label;                  // que cuentan los aciertos
+    int dims;                           // coordenadas por muestra (<= MC_MAX_DIMS)
+    double scale;                       // 1 = conteo; si no, suma en punto fijo
+    int antithetic;                     // MC_ANTI_REFLECT: 1 - u; MC_ANTI_SHIFT: u + 1/2 mod 1
+    mc_batch_fn kernels[MC_ISA_COUNT];  // una variante por ISA (NULL = la escalar)
+    mc_raw_batch_fn kernels_f32[MC_ISA_COUNT];  // --precision float (todas NULL = double)
+    mc_raw_batch_fn kernels_int[MC_ISA_COUNT];  // --precision int
+    // Cotas del aporte por muestra (NULL = [0, 1]); las usa el modo adaptativo
+    void (*range)(const mc_params_t* p, double* lo, double* hi);
+    // Resultado a partir de la media por muestra
+    double (*estimate)(const mc_params_t* p, double mean);
+    // Derivada de 'estimate' para el metodo delta (NULL = diferencias centradas)
+    double (*slope)(const mc_params_t* p, double mean);
+} mc_integrand_t;
+
+#define MC_U(d) (u_[d][k_])
+#define MC_P p_
+
+#define MC_COUNT_KERNEL(name, expr)                                          \
+    static long long name(double* const* u_, int n_, const mc_params_t* p_) { \
+        long long acc_ = 0;                                                  \
+        (void)p_;                                                            \
+        for (int k_ = 0; k_ < n_; k_++) acc_ += (long long)(expr);           \
+        return acc_;                                                         \
+    }
+
+#define MC_SUM_KERNEL(name, scale, expr)                                     \
+    static long long name(double* const* u_, int n_, const mc_params_t* p_) { \
+        long long acc_ = 0;                                                  \
+        (void)p_;                                                            \
+        for (int k_ = 0; k_ < n_; k_++) {                                    \
+            acc_ += (long long)floor((expr) * (scale) + 0.5);                \
+        }                                                                    \
+        return acc_;                                                         \
+    }
+
+// Variantes por ISA de los kernels Dartboard y Needles
+#define MC_DARTBOARD_BATCH(isa)                                                          \
+    static long long dartboard_batch_##isa(double* const* u, int n, const mc_params_t* p) { \
+        (void)p;                                                                         \
+        return dartboard_count_##isa(u[0], u[1], n);                                     \
+    }
+#define MC_NEEDLES_BATCH(isa)                                                            \
+    static long long needles_batch_##isa(double* const* u, int n, const mc_params_t* p) {   \
+        return needles_count_##isa(u[0], u[1], n, p->needle_length / (2.0 * p->line_spacing)); \
+    }
+
+#define MC_RAW_BATCH(name, call)                                                         \
+    static long long name(unsigned int* const* w, int n, const mc_params_t* p) {         \
+        (void)p;                                                                         \
+        return call;                                                                     \
+    }
+#define MC_DARTBOARD_RAW_BATCH(isa)                                                      \
+    MC_RAW_BATCH(dartboard_int_batch_##isa, dartboard_int_##isa(w[0], w[1], n))          \
+    MC_RAW_BATCH(dartboard_f32_batch_##isa, dartboard_f32_##isa(w[0], w[1], n))
+#define MC_NEEDLES_RAW_BATCH(isa)                                                        \
+    MC_RAW_BATCH(needles_f32_batch_##isa, needles_f32_##isa(w[0], w[1], n,              \
+                 (float)(p->needle_length / (2.0 * p->line_spacing))))
+
+MC_DARTBOARD_BATCH(scalar)
+MC_NEEDLES_BATCH(scalar)
+MC_DARTBOARD_RAW_BATCH(scalar)
+MC_NEEDLES_RAW_BATCH(scalar)
+#ifdef MC_HAVE_X86
+MC_DARTBOARD_BATCH(sse2)
+MC_DARTBOARD_BATCH(avx2)
+MC_DARTBOARD_BATCH(avx512)
+MC_NEEDLES_BATCH(sse2)
+MC_NEEDLES_BATCH(avx2)
+MC_NEEDLES_BATCH(avx512)
+MC_DARTBOARD_RAW_BATCH(sse2)
+MC_DARTBOARD_RAW_BATCH(avx2)
+MC_DARTBOARD_RAW_BATCH(avx512)
+MC_NEEDLES_RAW_BATCH(sse2)
+MC_NEEDLES_RAW_BATCH(avx2)
+MC_NEEDLES_RAW_BATCH(avx512)
+#define MC_ISA_KERNELS(name) { name##_scalar, name##_sse2, name##_avx2, name##_avx512 }
+#else
+#define MC_ISA_KERNELS(name) { name##_scalar, NULL, NULL, NULL }
+#endif
+#define MC_NO_KERNELS { NULL, NULL, NULL, NULL }
+
+// Volumen de la bola unitaria en el primer ortante: pi/6 en 3D, pi^2/32 en 4D
+MC_COUNT_KERNEL(ball3_batch, MC_U(0) * MC_U(0) + MC_U(1) * MC_U(1) + MC_U(2) * MC_U(2) <= 1.0)
+MC_COUNT_KERNEL(ball4_batch, MC_U(0) * MC_U(0) + MC_U(1) * MC_U(1) +
+                             MC_U(2) * MC_U(2) + MC_U(3) * MC_U(3) <= 1.0)
+
+// Integral de 1/(1 + x^2) en [0, 1] = pi/4, como suma en punto fijo (2^-24)
+#define MC_ARCTAN_SCALE 16777216.0
+MC_SUM_KERNEL(arctan_batch, MC_ARCTAN_SCALE, 1.0 / (1.0 + MC_U(0) * MC_U(0)))
+
+static double dartboard_estimate(const mc_params_t* p, double mean) {
+    (void)p;
+    return 4.0 * mean;
+}
+
+static double dartboard_slope(const mc_params_t* p, double mean) {
+    (void)p;
+    (void)mean;
+    return 4.0;
+}
+
+// E[cruces] = 2L / (pi D) por aguja, valido tambien para L > D
+static double needles_estimate(const mc_params_t* p, double mean) {
+    // evitar división por cero
+    if (mean <= 0.0) return 0.0;
+    return 2.0 * p->needle_length / (p->line_spacing * mean);
+}
+
+// pi = 2L / (D m): |d pi / dm| = pi / m
+static double needles_slope(const mc_params_t* p, double mean) {
+    return mean > 0.0 ? needles_estimate(p, mean) / mean : 0.0;
+}
+
+// Una aguja cruza a lo sumo ceil(L / D) lineas
+static void needles_range(const mc_params_t* p, double* lo, double* hi) {
+    *lo = 0.0;
+    *hi = ceil(p->needle_length / p->line_spacing);
+}
+
+static double ball3_estimate(const mc_params_t* p, double mean) {
+    (void)p;
+    return 6.0 * mean;
+}
+
+static double ball4_estimate(const mc_params_t* p, double mean) {
+    (void)p;
+    return sqrt(32.0 * mean);
+}
+
+enum {
+    MC_METHOD_DARTBOARD = 1, MC_METHOD_NEEDLES, MC_METHOD_BALL3, MC_METHOD_BALL4,
+    MC_METHOD_ARCTAN, MC_METHOD_COUNT
+};
+static const char* const mc_method_names[] = {
+    "", "dartboard", "needles", "ball3", "ball4", "arctan"
+};
+
+// Indexado por mc_params_t.method (el 0 no se usa). Todos estiman pi.
+static const mc_integrand_t mc_integrands[] = {
+    { NULL, NULL, 0, 0.0, 0, MC_NO_KERNELS, MC_NO_KERNELS, MC_NO_KERNELS, NULL, NULL, NULL },
+    { "Dartboard", "puntos dentro", 2, 1.0, MC_ANTI_REFLECT,
+      MC_ISA_KERNELS(dartboard_batch), MC_ISA_KERNELS(dartboard_f32_batch),
+      MC_ISA_KERNELS(dartboard_int_batch), NULL, dartboard_estimate, dartboard_slope },
+    // Reflejar no sirve en Needles (los cruces son simetricos en u y en v):
+    // la pareja corre el centro media separacion y gira la aguja 90 grados
+    { "Needles", "cruces", 2, 1.0, MC_ANTI_SHIFT,
+      MC_ISA_KERNELS(needles_batch), MC_ISA_KERNELS(needles_f32_batch), MC_NO_KERNELS,
+      needles_range, needles_estimate, needles_slope },
+    { "Bola 3D", "puntos dentro", 3, 1.0, MC_ANTI_REFLECT,
+      { ball3_batch, NULL, NULL, NULL }, MC_NO_KERNELS, MC_NO_KERNELS, NULL, ball3_estimate, NULL },
+    { "Bola 4D", "puntos dentro", 4, 1.0, MC_ANTI_REFLECT,
+      { ball4_batch, NULL, NULL, NULL }, MC_NO_KERNELS, MC_NO_KERNELS, NULL, ball4_estimate, NULL },
+    // 4 * media de 1/(1 + x^2), la misma conversion que Dartboard
+    { "Integral de 4/(1+x^2)", "suma (2^-24)", 1, MC_ARCTAN_SCALE, MC_ANTI_REFLECT,
+      { arctan_batch, NULL, NULL, NULL }, MC_NO_KERNELS, MC_NO_KERNELS,
+      NULL, dartboard_estimate, dartboard_slope },
+};
+
+int mc_method_valid(int method) {
+    return method > 0 && method < MC_METHOD_COUNT;
+}
+
+// Nombre ("dartboard") o numero ("1") de un metodo; -1 si no existe
+int mc_method_from_name(const char* name) {
+    for (int m = 1; m < MC_METHOD_COUNT; m++) {
+        if (strcmp(name, mc_method_names[m]) == 0) return m;
+    }
+    int m = atoi(name);
+    return mc_method_valid(m) ? m : -1;
+}
+
+static const mc_integrand_t* mc_integrand(const mc_params_t* p) {
+    return &mc_integrands[p->method];
+}
+
+// Variante del kernel para la ISA elegida en mc_select_kernels
+static mc_batch_fn mc_integrand_kernel(const mc_integrand_t* it) {
+    return it->kernels[g_isa] != NULL ? it->kernels[g_isa] : it->kernels[MC_ISA_SCALAR];
+}
+
+// Kernel sobre palabras crudas para 'precision' (NULL = el integrando usa double)
+static mc_raw_batch_fn mc_integrand_raw_kernel(const mc_integrand_t* it, int precision) {
+    const mc_raw_batch_fn* table;
+    if (precision == MC_PREC_FLOAT) table = it->kernels_f32;
+    else if (precision == MC_PREC_INT) table = it->kernels_int;
+    else return NULL;
+    return table[g_isa] != NULL ? table[g_isa] : table[MC_ISA_SCALAR];
+}
+
+// Precision con la que corre realmente el integrando de 'p'
+static int mc_effective_precision(const mc_params_t* p) {
+    return mc_integrand_raw_kernel(mc_integrand(p), p->precision) != NULL ? p->precision
+                                                                           : MC_PREC_DOUBLE;
+}
+
+// ==================== CURSOR SOBRE EL FLUJO GLOBAL ====================
+void mc_stream_init(mc_stream_t* st, const mc_params_t* params) {
+    memset(st, 0, sizeof(*st));
+    st->params = params;
+    st->next = -1;
+    st->block = -1;
+    st->dims = mc_integrand(params)->dims;
+    st->antithetic = mc_integrand(params)->antithetic;
+}
+
+// Coloca xs al inicio de 'block'; el bloque siguiente es un jump del actual
+static void xoshiro_enter_block(mc_stream_t* st, long long block) {
+    if (st->block >= 0 && block == st->block + 1 && block % MC_JUMPS_PER_LONG != 0) {
+        xoshiro_apply_jump(st->xs_block, XOSHIRO_JUMP);
+    } else if (block != st->block) {
+        xoshiro_block_state(st->params->seed, block, st->xs_block);
+    }
+    st->block = block;
+    memcpy(st->xs, st->xs_block, sizeof(st->xs));
+}
+
+// Reposiciona el cursor en la muestra 'index' (solo generadores con estado)
+static void mc_stream_seek(mc_stream_t* st, long long index) {
+    const mc_params_t* p = st->params;
+
+    if (p->rng == MC_RNG_XOSHIRO) {
+        long long block = index / MC_BLOCK_POINTS;
+        long long skip;
+        if (st->next >= 0 && index >= st->next && block == st->block) {
+            skip = index - st->next;  // mismo bloque y mas adelante: basta con avanzar
+        } else {
+            xoshiro_enter_block(st, block);
+            skip = index % MC_BLOCK_POINTS;
+        }
+        for (long long k = 0; k < st->dims * skip; k++) xoshiro_next(st->xs);
+    } else if (p->rng == MC_RNG_LCG) {
+        unsigned int base = (unsigned int)(p->seed & 0x7FFFFFFFu);
+        st->lcg = lcg_skip(base, (unsigned long long)st->dims * (unsigned long long)index);
+    }
+    st->next = index;
+}
+
+// Uniformes del generador para las muestras first .. first + n - 1 (n <= MC_BATCH)
+static void mc_rng_fill(mc_stream_t* st, long long first, int n, double* const* u) {
+    const mc_params_t* p = st->params;
+
+    if (p->rng == MC_RNG_PHILOX) {
+        MC_ALIGN(64) double spare[MC_BATCH];   // segunda mitad del ultimo par si dims es impar
+        for (int d = 0; d < st->dims; d += 2) {
+            g_philox_fill(p->seed, (unsigned int)(d / 2), first, n, u[d],
+                          d + 1 < st->dims ? u[d + 1] : spare);
+        }
+        return;
+    }
+
+    if (st->next != first) mc_stream_seek(st, first);
+
+    if (p->rng == MC_RNG_XOSHIRO) {
+        for (int k = 0; k < n; k++) {
+            if (st->next % MC_BLOCK_POINTS == 0 && st->next / MC_BLOCK_POINTS != st->block) {
+                xoshiro_enter_block(st, st->next / MC_BLOCK_POINTS);
+            }
+            for (int d = 0; d < st->dims; d++) u[d][k] = xoshiro_to_unit(xoshiro_next(st->xs));
+            st->next++;
+        }
+    } else {
+        for (int k = 0; k < n; k++) {
+            for (int d = 0; d < st->dims; d++) u[d][k] = rand_double_win(&st->lcg);
+        }
+        st->next += n;
+    }
+}
+
+// Palabras crudas de 32 bits, w = floor(u * 2^32), para --precision float e
+// int con --sampling mc: philox sin conversion a double, xoshiro con sus 32
+// bits altos y el LCG con sus 31 bits (sin la division de rand_double_win)
+static void mc_rng_fill_raw(mc_stream_t* st, long long first, int n, unsigned int* const* w) {
+    const mc_params_t* p = st->params;
+
+    if (p->rng == MC_RNG_PHILOX) {
+        MC_ALIGN(64) unsigned int spare[MC_BATCH];
+        for (int d = 0; d < st->dims; d += 2) {
+            g_philox_raw(p->seed, (unsigned int)(d / 2), first, n, w[d],
+                         d + 1 < st->dims ? w[d + 1] : spare);
+        }
+        return;
+    }
+
+    if (st->next != first) mc_stream_seek(st, first);
+
+    if (p->rng == MC_RNG_XOSHIRO) {
+        for (int k = 0; k < n; k++) {
+            if (st->next % MC_BLOCK_POINTS == 0 && st->next / MC_BLOCK_POINTS != st->block) {
+                xoshiro_enter_block(st, st->next / MC_BLOCK_POINTS);
+            }
+            for (int d = 0; d < st->dims; d++) w[d][k] = (unsigned int)(xoshiro_next(st->xs) >> 32);
+            st->next++;
+        }
+    } else {
+        for (int k = 0; k < n; k++) {
+            for (int d = 0; d < st->dims; d++) w[d][k] = rand_win(&st->lcg) << 1;
+        }
+        st->next += n;
+    }
+}
+
+// ==================== ESTRATEGIAS DE MUESTREO ====================
+// La estrategia decide que punto corresponde al indice global i. Como el
+// punto sigue dependiendo solo de (parametros, i), cada worker toma un
+// segmento disjunto de la secuencia y la cuenta no depende de la particion.
+//
+//  - mc:         pseudoaleatorio puro con el generador de --rng.
+//  - sobol:      Sobol en orden Gray (hasta MC_MAX_DIMS dimensiones),
+//                aleatorizado con scrambling lineal de Matousek (matriz
+//                triangular inferior al azar aplicada a los numeros de
+//                direccion) y un desplazamiento digital.
+//  - halton:     Halton en las bases 2, 3, 5, ... con desplazamiento digital
+//                aleatorio en cada base.
+//  - stratified: cada bloque de MC_STRATA_SIDE^2 indices consecutivos pone un
+//                punto (con jitter del generador) en cada celda de la grilla
+//                de las dos primeras coordenadas (en 1D, en cada intervalo);
+//                el resto de las coordenadas queda sin estratificar.
+//  - lhs:        hipercubo latino por bloques de MC_LHS_BLOCK indices: en cada
+//                coordenada los puntos del bloque caen en estratos distintos,
+//                segun una permutacion pseudoaleatoria del bloque.
+//  - antithetic: las muestras 2j y 2j+1 usan los uniformes del indice j; la
+//                segunda es la pareja que define el integrando: el reflejo
+//                1 - u (Dartboard) o u + 1/2 modulo 1 (Needles).
+//
+// Sobol y Halton no usan el generador (--rng no los afecta); la aleatorizacion
+// sale de la semilla, asi que las estimaciones siguen siendo insesgadas.
+
+// Polinomios primitivos y numeros de direccion iniciales de Joe y Kuo para
+// las dimensiones 3 .. MC_MAX_DIMS (s = grado, a = coeficientes interiores)
+static const struct {
+    int s, a;
+    unsigned int m[5];
+} mc_sobol_init[MC_MAX_DIMS - 2] = {
+    { 2, 1, { 1, 3 } },
+    { 3, 1, { 1, 3, 1 } },
+    { 3, 2, { 1, 1, 1 } },
+    { 4, 1, { 1, 1, 3, 3 } },
+    { 4, 4, { 1, 3, 5, 13 } },
+    { 5, 2, { 1, 1, 5, 5, 17 } },
+};
+
+static const int mc_halton_bases[MC_MAX_DIMS] = { 2, 3, 5, 7, 11, 13, 17, 19 };
+
+static unsigned long long mc_sampling_key(unsigned long long seed, unsigned long long salt) {
+    unsigned long long sm = seed ^ (salt * 0xD1B54A32D192ED03ull);
+    return splitmix64(&sm);
+}
+
+static inline int mc_parity64(unsigned long long v) {
+    v ^= v >> 32;
+    v ^= v >> 16;
+    v ^= v >> 8;
+    v ^= v >> 4;
+    v ^= v >> 2;
+    v ^= v >> 1;
+    return (int)(v & 1);
+}
+
+// Digitos en base 'base' de un indice de 63 bits (40 en base 3)
+static int mc_halton_digits(int base) {
+    double pow = 1.0;
+    int digits = 0;
+    while (pow < 9223372036854775808.0) {
+        pow *= base;
+        digits++;
+    }
+    return digits;
+}
+
+static void mc_sampling_init(mc_stream_t* st) {
+    unsigned long long seed = st->params->seed;
+
+    // Numeros de direccion (el bit 63 es el primer digito binario): la
+    // dimension 1 es van der Corput, la 2 usa el polinomio x + 1 y las demas
+    // la recurrencia de Bratley y Fox con los polinomios de mc_sobol_init
+    for (int d = 0; d < st->dims; d++) {
+        unsigned long long* v = st->sobol[d];
+        for (int k = 0; k < 64; k++) {
+            if (d == 0) {
+                v[k] = 1ull << (63 - k);
+            } else if (d == 1) {
+                v[k] = k == 0 ? 1ull << 63 : v[k - 1] ^ (v[k - 1] >> 1);
+            } else {
+                int s = mc_sobol_init[d - 2].s, a = mc_sobol_init[d - 2].a;
+                if (k < s) {
+                    v[k] = (unsigned long long)mc_sobol_init[d - 2].m[k] << (63 - k);
+                } else {
+                    v[k] = v[k - s] ^ (v[k - s] >> s);
+                    for (int j = 1; j < s; j++) {
+                        if ((a >> (s - 1 - j)) & 1) v[k] ^= v[k - j];
+                    }
+                }
+            }
+        }
+    }
+    for (int d = 0; d < st->dims; d++) {
+        unsigned long long rows[64];
+        for (int r = 0; r < 64; r++) {
+            unsigned long long diag = 1ull << (63 - r);
+            rows[r] = (mc_sampling_key(seed, 64 * d + r + 1) & ~(diag - 1)) | diag;
+        }
+        for (int k = 0; k < 64; k++) {
+            unsigned long long v = 0;
+            for (int r = 0; r < 64; r++) {
+                v |= (unsigned long long)mc_parity64(st->sobol[d][k] & rows[r]) << (63 - r);
+            }
+            st->sobol[d][k] = v;
+        }
+        st->shift[d] = mc_sampling_key(seed, 1000 + d);
+    }
+    for (int d = 1; d < st->dims; d++) {
+        for (int j = 0; j < MC_HALTON_DIGITS; j++) {
+            unsigned long long key = mc_sampling_key(seed, 2000 + 64 * (d - 1) + j);
+            st->halton[d][j] = (unsigned char)(key % (unsigned long long)mc_halton_bases[d]);
+        }
+    }
+    st->sampling_ready = 1;
+}
+
+static void sobol_fill(mc_stream_t* st, long long first, int n, double* const* u) {
+    unsigned long long i = (unsigned long long)first;
+    unsigned long long gray = i ^ (i >> 1);
+    unsigned long long a[MC_MAX_DIMS];
+
+    for (int d = 0; d < st->dims; d++) {
+        a[d] = st->shift[d];
+        for (int k = 0; k < 64; k++) {
+            if (gray & (1ull << k)) a[d] ^= st->sobol[d][k];
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        if (k > 0) {
+            // Orden Gray: de i - 1 a i cambia solo el bit ctz(i)
+            unsigned long long v = i;
+            int c = 0;
+            while (!(v & 1)) {
+                v >>= 1;
+                c++;
+            }
+            for (int d = 0; d < st->dims; d++) a[d] ^= st->sobol[d][c];
+        }
+        for (int d = 0; d < st->dims; d++) u[d][k] = (double)(a[d] >> 12) * MC_TWO_POW_M52;
+        i++;
+    }
+}
+
+static void halton_fill(mc_stream_t* st, long long first, int n, double* const* u) {
+    int ndigits[MC_MAX_DIMS];
+
+    for (int d = 1; d < st->dims; d++) ndigits[d] = mc_halton_digits(mc_halton_bases[d]);
+    for (int k = 0; k < n; k++) {
+        unsigned long long i = (unsigned long long)first + (unsigned long long)k;
+
+        // Base 2: inversion de bits y desplazamiento digital
+        unsigned long long r = 0, v = i;
+        for (int b = 0; b < 64; b++) {
+            r = (r << 1) | (v & 1);
+            v >>= 1;
+        }
+        u[0][k] = (double)((r ^ st->shift[0]) >> 12) * MC_TWO_POW_M52;
+
+        // Otras bases: cada digito se desplaza (mod base) y se acumula de
+        // atras hacia adelante
+        for (int d = 1; d < st->dims; d++) {
+            unsigned int base = (unsigned int)mc_halton_bases[d];
+            unsigned char digits[MC_HALTON_DIGITS];
+            v = i;
+            for (int j = 0; j < ndigits[d]; j++) {
+                digits[j] = (unsigned char)(v % base);
+                v /= base;
+            }
+            double acc = 0.0;
+            for (int j = ndigits[d] - 1; j >= 0; j--) {
+                acc = (acc + (double)((digits[j] + st->halton[d][j]) % base)) / (double)base;
+            }
+            u[d][k] = acc;
+        }
+    }
+}
+
+// Permutacion pseudoaleatoria de [0, 2^bits): cada paso es biyectivo
+static unsigned int mc_permute(unsigned int v, unsigned long long key, int bits) {
+    unsigned int mask = (1u << bits) - 1u;
+    for (int r = 0; r < 2; r++) {
+        unsigned int k0 = (unsigned int)(key >> (32 * r));
+        v = (v ^ k0) & mask;
+        v = (v * ((k0 >> 9) | 1u)) & mask;
+        v ^= v >> (bits / 2);
+        v = (v + (k0 >> 18)) & mask;
+        v = (v * ((k0 >> 5) | 1u)) & mask;
+        v ^= v >> (bits / 2 + 1);
+    }
+    return v;
+}
+
+// Coordenadas u[d][k] de las muestras first .. first + n - 1 (n <= MC_BATCH)
+void mc_stream_fill(mc_stream_t* st, long long first, int n, double* const* u) {
+    const mc_params_t* p = st->params;
+    int dims = st->dims;
+
+    switch (p->sampling) {
+        case MC_SAMPLING_SOBOL:
+        case MC_SAMPLING_HALTON:
+            if (!st->sampling_ready) mc_sampling_init(st);
+            if (p->sampling == MC_SAMPLING_SOBOL) sobol_fill(st, first, n, u);
+            else halton_fill(st, first, n, u);
+            return;
+
+        case MC_SAMPLING_STRATIFIED:
+            mc_rng_fill(st, first, n, u);
+            for (int k = 0; k < n; k++) {
+                long long cell = (first + k) % (MC_STRATA_SIDE * MC_STRATA_SIDE);
+                if (dims == 1) {
+                    u[0][k] = ((double)cell + u[0][k]) / (MC_STRATA_SIDE * MC_STRATA_SIDE);
+                    continue;
+                }
+                u[0][k] = ((double)(cell % MC_STRATA_SIDE) + u[0][k]) / MC_STRATA_SIDE;
+                u[1][k] = ((double)(cell / MC_STRATA_SIDE) + u[1][k]) / MC_STRATA_SIDE;
+            }
+            return;
+
+        case MC_SAMPLING_LHS:
+            mc_rng_fill(st, first, n, u);
+            for (int k = 0; k < n; k++) {
+                long long block = (first + k) / MC_LHS_BLOCK;
+                unsigned int cell = (unsigned int)((first + k) % MC_LHS_BLOCK);
+                for (int d = 0; d < dims; d++) {
+                    unsigned long long key = mc_sampling_key(p->seed, (unsigned long long)dims * block + 3000 + d);
+                    u[d][k] = ((double)mc_permute(cell, key, MC_LHS_BITS) + u[d][k]) / MC_LHS_BLOCK;
+                }
+            }
+            return;
+
+        case MC_SAMPLING_ANTITHETIC: {
+            // Uniformes de los pares first/2 .. (first+n-1)/2, expandidos de
+            // atras hacia adelante (la fuente de cada posicion aun no se piso)
+            long long pair0 = first / 2;
+            long long pairs = (first + n - 1) / 2 - pair0 + 1;
+            mc_rng_fill(st, pair0, (int)pairs, u);
+            for (int k = n - 1; k >= 0; k--) {
+                long long i = first + k;
+                int src = (int)(i / 2 - pair0);
+                for (int d = 0; d < dims; d++) {
+                    double v = u[d][src];
+                    if (i & 1) {
+                        if (st->antithetic == MC_ANTI_REFLECT) v = 1.0 - v;
+                        else v = v < 0.5 ? v + 0.5 : v - 0.5;
+                    }
+                    u[d][k] = v;
+                }
+            }
+            return;
+        }
+
+        default:
+            mc_rng_fill(st, first, n, u);
+    }
+}
+
+// ==================== FLUJOS GRABADOS (REPRODUCCIÓN) ====================
+// Con --replay ARCHIVO los motores no generan las muestras: las leen de un
+// archivo grabado con "programa record" (o armado a partir de un volcado
+// externo), asi el tiempo medido es solo el del kernel y el acceso a memoria,
+// y una corrida se puede reproducir igual en otra maquina.
+//
+// Formato: una cabecera de MC_REPLAY_HEADER bytes y despues bloques de
+// MC_BLOCK_POINTS muestras. Cada bloque guarda una columna por dimension
+// (double con 52 bits, o palabras crudas de 32 bits para --precision float e
+// int), que es justo lo que reciben los kernels: cada llamada de conteo
+// proyecta solo los bloques de su rango y pasa punteros al mapping, sin
+// copiar. Los parametros del generador y del muestreo de la sesion no se
+// usan; la cabecera guarda de donde salio el flujo.
+#define MC_REPLAY_MAGIC "MCSTREAM"
+#define MC_REPLAY_VERSION 1
+#define MC_REPLAY_HEADER 65536           // multiplo de la granularidad de mapeo
+#define MC_REPLAY_WINDOW 64              // bloques por ventana como maximo
+
+enum { MC_REPLAY_DOUBLE = 0, MC_REPLAY_RAW, MC_REPLAY_FORMAT_COUNT };
+static const char* const mc_replay_format_names[] = { "double", "raw" };
+
+typedef struct {
+    char magic[8];
+    int version;
+    int format;
+    int dims;
+    int block;                 // muestras por bloque
+    long long points;          // muestras validas (el ultimo bloque se completa con ceros)
+    char source[256];          // origen del flujo, solo informativo
+} mc_replay_header_t;
+
+typedef struct {
+    mc_file_map_t file;
+    mc_replay_header_t header;
+    size_t block_bytes;
+    char path[MC_PATH_MAX];
+} mc_replay_t;
+
+static mc_replay_t g_replay_data;
+static mc_replay_t* g_replay = NULL;   // flujo activo (NULL = generadores)
+
+static size_t mc_replay_elem(int format) {
+    return format == MC_REPLAY_RAW ? sizeof(unsigned int) : sizeof(double);
+}
+
+static void mc_replay_close(void) {
+    if (g_replay == NULL) return;
+    mc_file_unmap(&g_replay->file);
+    g_replay = NULL;
+}
+
+// Activa el flujo grabado de 'path' ("" lo desactiva): 0 = listo
+static int mc_replay_use(const char* path) {
+    mc_replay_t* rp = &g_replay_data;
+    const mc_replay_header_t* h;
+
+    if (g_replay != NULL && strcmp(g_replay->path, path) == 0) return 0;
+    mc_replay_close();
+    if (path[0] == '\0') return 0;
+    if (strlen(path) >= MC_PATH_MAX || mc_file_open_read(&rp->file, path) != 0) {
+        fprintf(stderr, "No se pudo abrir el flujo %s: %lu\n", path, mc_last_error());
+        return -1;
+    }
+    const void* head = rp->file.size >= MC_REPLAY_HEADER
+                           ? mc_file_window(&rp->file, 0, sizeof(mc_replay_header_t)) : NULL;
+    if (head != NULL) {
+        memcpy(&rp->header, head, sizeof(rp->header));
+        mc_file_window_close(head, sizeof(mc_replay_header_t));
+    }
+    h = &rp->header;
+    rp->block_bytes = (size_t)h->dims * (size_t)h->block * mc_replay_elem(h->format);
+    if (head == NULL || memcmp(h->magic, MC_REPLAY_MAGIC, 8) != 0 || h->version != MC_REPLAY_VERSION ||
+        h->format < 0 || h->format >= MC_REPLAY_FORMAT_COUNT || h->dims < 1 || h->dims > MC_MAX_DIMS ||
+        h->block != MC_BLOCK_POINTS || h->points < 1 ||
+        rp->file.size < MC_REPLAY_HEADER + (size_t)((h->points + h->block - 1) / h->block) * rp->block_bytes) {
+        fprintf(stderr, "%s no es un flujo grabado valido\n", path);
+        mc_file_unmap(&rp->file);
+        return -1;
+    }
+    rp->header.source[sizeof(rp->header.source) - 1] = '\0';
+    snprintf(rp->path, sizeof(rp->path), "%s", path);
+    g_replay = rp;
+    return 0;
+}
+
+// Verifica que el flujo activo alcance para [0, end) con los kernels de 'p'
+static int mc_replay_check(const mc_params_t* p, long long end) {
+    const mc_replay_header_t* h = &g_replay->header;
+    int raw = mc_integrand_raw_kernel(mc_integrand(p), p->precision) != NULL;
+
+    if (end > h->points) {
+        fprintf(stderr, "El flujo %s tiene %lld muestras y la corrida pide %lld\n",
+                g_replay->path, h->points, end);
+        return -1;
+    }
+    if (h->dims < mc_integrand(p)->dims) {
+        fprintf(stderr, "El flujo %s tiene %d dimensiones y %s usa %d\n", g_replay->path, h->dims,
+                mc_method_names[p->method], mc_integrand(p)->dims);
+        return -1;
+    }
+    if (raw != (h->format == MC_REPLAY_RAW)) {
+        if (!raw && mc_integrand_raw_kernel(mc_integrand(p), MC_PREC_FLOAT) == NULL &&
+            mc_integrand_raw_kernel(mc_integrand(p), MC_PREC_INT) == NULL) {
+            fprintf(stderr, "%s no tiene kernels float ni int: grabe el flujo con --format double\n",
+                    mc_method_names[p->method]);
+        } else {
+            fprintf(stderr, "El flujo %s es de formato %s: use --precision %s\n", g_replay->path,
+                    mc_replay_format_names[h->format], raw ? "double" : "float o int");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Aciertos de [first, first + count) leyendo las columnas del archivo en el lugar
+static long long mc_count_replay(const mc_params_t* p, long long first, long long count) {
+    const mc_replay_t* rp = g_replay;
+    const long long block = rp->header.block;
+    const size_t elem = mc_replay_elem(rp->header.format);
+    mc_batch_fn kernel = mc_integrand_kernel(mc_integrand(p));
+    mc_raw_batch_fn raw = mc_integrand_raw_kernel(mc_integrand(p), p->precision);
+    void* col[MC_MAX_DIMS];
+    long long hits = 0;
+
+    if (count <= 0) return 0;
+    // Los llamadores ya comprobaron el flujo (mc_replay_fits); esto no deberia fallar
+    if (mc_replay_check(p, first + count) != 0) exit(1);
+    while (count > 0) {
+        long long b0 = first / block;
+        long long b1 = (first + count - 1) / block + 1;
+        if (b1 - b0 > MC_REPLAY_WINDOW) b1 = b0 + MC_REPLAY_WINDOW;
+        size_t size = (size_t)(b1 - b0) * rp->block_bytes;
+        const unsigned char* win = (const unsigned char*)mc_file_window(
+            (mc_file_map_t*)&rp->file, MC_REPLAY_HEADER + b0 * (long long)rp->block_bytes, size);
+        if (win == NULL) {
+            fprintf(stderr, "Error proyectando el flujo %s: %lu\n", rp->path, mc_last_error());
+            exit(1);
+        }
+        long long end = b1 * block < first + count ? b1 * block : first + count;
+        while (first < end) {
+            long long off = first % block;
+            int n = (int)(end - first < MC_BATCH ? end - first : MC_BATCH);
+            if (n > block - off) n = (int)(block - off);
+            const unsigned char* blk = win + (size_t)(first / block - b0) * rp->block_bytes;
+            for (int d = 0; d < rp->header.dims; d++) {
+                col[d] = (void*)(blk + ((size_t)d * block + off) * elem);
+            }
+            hits += raw != NULL ? raw((unsigned int* const*)col, n, p) : kernel((double* const*)col, n, p);
+            count -= n;
+            first += n;
+        }
+        mc_file_window_close(win, size);
+    }
+    return hits;
+}
+
+// ==================== CONTEO POR RANGOS ====================
+// --precision float / int: el kernel lee palabras crudas. Con --sampling mc
+// salen directo del generador; con las demas estrategias se toman de las
+// coordenadas double del muestreo (en 'u'), w = floor(u * 2^32).
+static void mc_stream_fill_raw(mc_stream_t* st, long long first, int n, double* const* u,
+                               unsigned int* const* w) {
+    if (st->params->sampling == MC_SAMPLING_MC) {
+        mc_rng_fill_raw(st, first, n, w);
+        return;
+    }
+    mc_stream_fill(st, first, n, u);
+    for (int d = 0; d < st->dims; d++) {
+        for (int k = 0; k < n; k++) {
+            double x = u[d][k] * 4294967296.0;
+            w[d][k] = x < 4294967295.0 ? (unsigned int)x : 0xFFFFFFFFu;
+        }
+    }
+}
+
+static long long mc_count_stream_raw(mc_stream_t* st, mc_raw_batch_fn kernel, long long first,
+                                     long long count, double* const* u) {
+    MC_ALIGN(64) unsigned int buf[MC_MAX_DIMS][MC_BATCH];
+    unsigned int* w[MC_MAX_DIMS];
+    const mc_params_t* p = st->params;
+    long long hits = 0;
+
+    for (int d = 0; d < MC_MAX_DIMS; d++) w[d] = buf[d];
+    while (count > 0) {
+        int n = count < MC_BATCH ? (int)count : MC_BATCH;
+        mc_stream_fill_raw(st, first, n, u, w);
+        hits += kernel(w, n, p);
+        first += n;
+        count -= n;
+    }
+    return hits;
+}
+
+
+// Aciertos de [first, first + count) usando un cursor que el llamador
+// conserva entre rangos: si el siguiente rango continua donde acabo el
+// anterior, los generadores con estado no necesitan reposicionarse.
+long long mc_count_stream(mc_stream_t* st, long long first, long long count) {
+    MC_ALIGN(64) double buf[MC_MAX_DIMS][MC_BATCH];
+    double* u[MC_MAX_DIMS];
+    const mc_params_t* p = st->params;
+    mc_batch_fn kernel = mc_integrand_kernel(mc_integrand(p));
+    mc_raw_batch_fn raw = mc_integrand_raw_kernel(mc_integrand(p), p->precision);
+    long long hits = 0;
+
+    if (g_replay != NULL) return mc_count_replay(p, first, count);
+    for (int d = 0; d < MC_MAX_DIMS; d++) u[d] = buf[d];
+    if (raw != NULL) return mc_count_stream_raw(st, raw, first, count, u);
+    while (count > 0) {
+        int n = count < MC_BATCH ? (int)count : MC_BATCH;
+        mc_stream_fill(st, first, n, u);
+        hits += kernel(u, n, p);
+        first += n;
+        count -= n;
+    }
+    return hits;
+}
+
+// Aciertos del integrando (puntos dentro, cruces, suma en punto fijo) de las
+// muestras [first, first + count)
+long long mc_count_range(const mc_params_t* p, long long first, long long count) {
+    mc_stream_t st;
+    mc_stream_init(&st, p);
+    return mc_count_stream(&st, first, count);
+}
+
+// Semilla del ensayo k de un lote: cada ensayo es un flujo completo [0, N)
+// con su propia semilla, que se puede repetir aparte con --seed
+unsigned long long mc_trial_seed(unsigned long long seed, long long k) {
+    unsigned long long x = seed + (unsigned long long)k * 0xD1B54A32D192ED03ull;
+    return splitmix64(&x);
+}
+
+// Cuenta los ensayos [first, first + count) de 'points' muestras cada uno;
+// deja los aciertos de cada ensayo en hits[k] y devuelve la suma
+long long mc_count_trials(const mc_params_t* p, long long* hits, long long first, long long count,
+                          long long points) {
+    mc_params_t trial = *p;
+    long long total = 0;
+
+    for (long long k = first; k < first + count; k++) {
+        trial.seed = mc_trial_seed(p->seed, k);
+        hits[k] = mc_count_range(&trial, 0, points);
+        total += hits[k];
+    }
+    return total;
+}
+
+// Rango [first, first + count) del worker k de 'parts' (reparte el resto)
+void mc_partition(long long total, int parts, int k, long long* first, long long* count) {
+    long long begin = total / parts * k + (k < total % parts ? k : total % parts);
+    *first = begin;
+    *count = total / parts + (k < total % parts ? 1 : 0);
+}
+
+// ==================== UBICACIÓN DE WORKERS ====================
+// Politica con la que se fijan los workers (hilos del pool y procesos hijos)
+// a procesadores logicos:
+//  - none:    sin afinidad, decide el sistema operativo.
+//  - compact: llena primero los hilos SMT de un nucleo, luego los nucleos del
+//             mismo nodo y recien despues pasa al nodo siguiente.
+//  - scatter: reparte entre nodos (un nucleo de cada nodo por turno) y deja
+//             los hermanos SMT para el final.
+//  - core:    un worker por nucleo fisico, llenando un nodo antes de pasar al
+//             siguiente; los hermanos SMT solo se usan si hay mas workers que
+//             nucleos.
+// El worker w va al procesador order[w % count]. Una vez fijado, cada worker
+// toca primero su propia memoria (slot de resultados, cursor y buffers), asi
+// que con la politica de primer acceso del sistema esas paginas quedan en su
+// nodo NUMA.
+enum { MC_PLACE_NONE = 0, MC_PLACE_COMPACT, MC_PLACE_SCATTER, MC_PLACE_CORE, MC_PLACE_COUNT };
+static const char* const mc_placement_names[] = { "none", "compact", "scatter", "core" };
+
+static mc_topology_t g_topology;
+static int g_topology_ready = 0;
+static int g_placement = MC_PLACE_NONE;
+static int g_placement_order[MC_MAX_CPUS];
+static int g_placement_base = 0;   // primer puesto de este proceso (hijo hibrido)
+
+typedef struct {
+    int key[4];
+    int cpu;
+} mc_place_key_t;
+
+static int mc_compare_place_key(const void* a, const void* b) {
+    const mc_place_key_t* x = (const mc_place_key_t*)a;
+    const mc_place_key_t* y = (const mc_place_key_t*)b;
+    for (int k = 0; k < 4; k++) {
+        if (x->key[k] != y->key[k]) return x->key[k] < y->key[k] ? -1 : 1;
+    }
+    return x->cpu - y->cpu;
+}
+
+int mc_placement_from_name(const char* name) {
+    for (int p = 0; p < MC_PLACE_COUNT; p++) {
+        if (strcmp(name, mc_placement_names[p]) == 0) return p;
+    }
+    return -1;
+}
+
+const mc_topology_t* mc_topology(void) {
+    if (!g_topology_ready) {
+        mc_topology_detect(&g_topology);
+        g_topology_ready = 1;
+    }
+    return &g_topology;
+}
+
+// Activa una politica y calcula el orden de procesadores que le corresponde
+void mc_placement_set(int policy) {
+    static mc_place_key_t keys[MC_MAX_CPUS];
+    const mc_topology_t* t = mc_topology();
+
+    for (int i = 0; i < t->count; i++) {
+        const mc_cpu_info_t* c = &t->cpus[i];
+        // Posicion del nucleo dentro de su nodo, para intercalar nodos
+        int rank = 0;
+        for (int j = 0; j < t->count; j++) {
+            const mc_cpu_info_t* o = &t->cpus[j];
+            if (o->smt == 0 && o->node == c->node && o->core < c->core) rank++;
+        }
+        int* key = keys[i].key;
+        if (policy == MC_PLACE_SCATTER) {
+            key[0] = c->smt; key[1] = rank; key[2] = c->node; key[3] = c->package;
+        } else if (policy == MC_PLACE_CORE) {
+            key[0] = c->smt; key[1] = c->node; key[2] = c->package; key[3] = c->core;
+        } else {
+            key[0] = c->node; key[1] = c->package; key[2] = c->core; key[3] = c->smt;
+        }
+        keys[i].cpu = c->cpu;
+    }
+    qsort(keys, t->count, sizeof(keys[0]), mc_compare_place_key);
+    for (int i = 0; i < t->count; i++) g_placement_order[i] = keys[i].cpu;
+    g_placement = policy;
+}
+
+// Procesador del worker w con la politica activa (-1 = sin afinidad)
+int mc_placement_cpu(int w) {
+    if (g_placement == MC_PLACE_NONE || g_topology.count == 0) return -1;
+    return g_placement_order[(g_placement_base + w) % g_topology.count];
+}
+
+// En modo hibrido el hijo w ubica su equipo de T hilos en los puestos
+// [w * T, (w + 1) * T) del orden de la politica que usa el padre
+void mc_placement_team(int policy, int base) {
+    if (policy != g_placement) mc_placement_set(policy);
+    g_placement_base = base;
+}
+
+// ==================== CONFIGURACIÓN DE LA EJECUCIÓN ====================
+// Generador, estrategia de muestreo, precision de los kernels y semilla de
+// la sesion (--rng, --sampling, --precision, --seed), ubicacion de los
+// workers (--placement), informes de avance (--progress), flujo grabado
+// en lugar de los generadores (--replay) y perfil del modo auto (--profile).
+// La semilla se imprime para poder repetir cualquier ejecucion. La geometria de Needles
+// (longitud de la aguja L y separacion entre lineas D) se elige con
+// --needle-length y --line-spacing; L puede ser mayor que D.
+static int g_rng = MC_RNG_PHILOX;
+static int g_sampling = MC_SAMPLING_MC;
+static int g_precision = MC_PREC_DOUBLE;
+static unsigned long long g_seed = 0;
+static double g_needle_length = 1.0;
+static double g_line_spacing = 1.0;
+static int g_quiet = 0;   // los motores no escriben en consola (benchmark)
+static double g_progress_every = 0.0;  // segundos entre informes de avance (0 = sin monitor)
+static char g_profile_path[MC_PATH_MAX];  // perfil del modo auto ("" = el de la maquina)
+
+// Aplica una opcion de la sesion: 0 = aplicada, 1 = desconocida, -1 = valor invalido
+int mc_session_option(const char* name, const char* value) {
+    if (strcmp(name, "--seed") == 0) {
+        g_seed = strtoull(value, NULL, 0);
+    } else if (strcmp(name, "--needle-length") == 0 ||
+               strcmp(name, "--line-spacing") == 0) {
+        double v = strtod(value, NULL);
+        if (!(v > 0.0) || v > 1e6) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            return -1;
+        }
+        if (name[2] == 'n') g_needle_length = v;
+        else g_line_spacing = v;
+    } else if (strcmp(name, "--rng") == 0) {
+        int rng = mc_rng_from_name(value);
+        if (rng < 0) {
+            fprintf(stderr, "Generador desconocido: %s (philox, xoshiro, lcg)\n", value);
+            return -1;
+        }
+        g_rng = rng;
+    } else if (strcmp(name, "--sampling") == 0) {
+        int sampling = mc_sampling_from_name(value);
+        if (sampling < 0) {
+            fprintf(stderr, "Muestreo desconocido: %s (mc, sobol, halton, stratified, lhs, "
+                            "antithetic)\n", value);
+            return -1;
+        }
+        g_sampling = sampling;
+    } else if (strcmp(name, "--precision") == 0) {
+        int precision = mc_precision_from_name(value);
+        if (precision < 0) {
+            fprintf(stderr, "Precision desconocida: %s (double, float, int)\n", value);
+            return -1;
+        }
+        g_precision = precision;
+    } else if (strcmp(name, "--placement") == 0) {
+        int policy = mc_placement_from_name(value);
+        if (policy < 0) {
+            fprintf(stderr, "Ubicacion desconocida: %s (none, compact, scatter, core)\n", value);
+            return -1;
+        }
+        mc_placement_set(policy);
+    } else if (strcmp(name, "--progress") == 0) {
+        double every = strtod(value, NULL);
+        if (!(every >= 0.0) || every > 86400.0) {
+            fprintf(stderr, "Valor invalido para --progress: %s\n", value);
+            return -1;
+        }
+        g_progress_every = every;
+    } else if (strcmp(name, "--replay") == 0) {
+        if (mc_replay_use(value) != 0) return -1;
+    } else if (strcmp(name, "--profile") == 0) {
+        if (value[0] == '\0' || strlen(value) >= MC_PATH_MAX) {
+            fprintf(stderr, "Valor invalido para --profile: %s\n", value);
+            return -1;
+        }
+        snprintf(g_profile_path, sizeof(g_profile_path), "%s", value);
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+mc_params_t mc_make_params(int method) {
+    mc_params_t p;
+    p.method = method;
+    p.rng = g_rng;
+    p.sampling = g_sampling;
+    p.precision = g_precision;
+    p.seed = g_seed;
+    p.needle_length = g_needle_length;
+    p.line_spacing = g_line_spacing;
+    return p;
+}
+
+mc_params_t mc_params_from_shared(const shared_data_t* shared) {
+    mc_params_t p;
+    p.method = shared->method;
+    p.rng = shared->rng;
+    p.sampling = shared->sampling;
+    p.precision = shared->precision;
+    p.seed = shared->seed;
+    p.needle_length = shared->needle_length;
+    p.line_spacing = shared->line_spacing;
+    return p;
+}
+
+// Con un flujo grabado activo, comprueba que alcance para las muestras
+// [0, points) de 'method' con la sesion actual: 0 = sirve (o no hay flujo).
+// Lo llaman quienes leen el pedido del usuario, antes de arrancar un motor.
+int mc_replay_fits(int method, long long points) {
+    if (g_replay == NULL) return 0;
+    mc_params_t p = mc_make_params(method);
+    return mc_replay_check(&p, points);
+}
+
+// Estimacion de pi a partir de los aciertos de 'points' muestras
+double mc_estimate_pi(const mc_params_t* p, long long hits, long long points) {
+    const mc_integrand_t* it = mc_integrand(p);
+    if (points <= 0) return 0.0;
+    return it->estimate(p, (double)hits / it->scale / (double)points);
+}
+
+// Cuantil z con P(|Z| <= z) = confidence para Z normal estandar
+double mc_normal_quantile(double confidence) {
+    double lo = 0.0, hi = 10.0;
+    for (int it = 0; it < 80; it++) {
+        double mid = 0.5 * (lo + hi);
+        if (erf(mid / sqrt(2.0)) < confidence) lo = mid;
+        else hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+// Desviacion por muestra de la estimacion de pi: semiancho = z * sigma / sqrt(n)
+double mc_pi_sigma(const mc_params_t* p, long long hits, long long points) {
+    const mc_integrand_t* it = mc_integrand(p);
+    double m = (double)hits / it->scale / points;
+    double lo = 0.0, hi = 1.0;
+    if (it->range != NULL) it->range(p, &lo, &hi);
+    double var = (hi - m) * (m - lo);
+    if (var < 0.0) var = 0.0;
+    // Metodo delta: sigma = |d estimate / dm| * sqrt(var)
+    double slope;
+    if (it->slope != NULL) {
+        slope = it->slope(p, m);
+    } else {
+        double h = 1e-6 * (fabs(m) > 1e-12 ? fabs(m) : 1e-12);
+        slope = (it->estimate(p, m + h) - it->estimate(p, m - h)) / (2.0 * h);
+    }
+    return fabs(slope) * sqrt(var);
+}
+
+// ==================== REGISTRO PERSISTENTE (CHECKPOINT) ====================
+// Un registro es un archivo mapeado en memoria que guarda la configuracion de
+// una corrida larga (generador, muestreo, precision, semilla, geometria) y, por metodo,
+// una lista de segmentos del flujo global. Cada segmento [first, first +
+// count) es un sub-flujo con su posicion (muestras ya contadas desde 'first')
+// y sus aciertos acumulados. Los motores de threads y procesos avanzan los
+// segmentos de a pasos y anotan cada paso en el archivo; un hilo lo lleva a
+// disco cada 'flush_every' segundos.
+//
+// Como el resultado es la suma de conteos por indice de muestra:
+//  - una corrida interrumpida se reanuda desde la posicion de cada segmento,
+//    con cualquier motor y cantidad de workers;
+//  - extender de N a M muestras agrega segmentos nuevos que cubren [N, M), y
+//    la cuenta final es identica a la de una corrida de M muestras desde cero.
+//
+// Cada segmento guarda dos copias de (done, hits) y un selector: el dueno
+// escribe la copia libre y despues cambia el selector con una sola escritura
+// atomica, asi un proceso que muere a mitad de un paso nunca deja una
+// posicion y un conteo que no se corresponden. El archivo usa el formato
+// nativo de la maquina.
+#define MC_LEDGER_VERSION 1
+#define MC_LEDGER_SEGMENTS 4096                 // segmentos por extension
+#define MC_LEDGER_MIN_SEGMENT (4 * MC_BLOCK_POINTS)
+#define MC_LEDGER_STEP (4 * MC_BLOCK_POINTS)    // muestras entre anotaciones
+#define MC_LEDGER_FLUSH 5.0                     // segundos entre escrituras a disco
+
+static const char mc_ledger_magic[8] = { 'M', 'C', 'L', 'E', 'D', 'G', 'E', 'R' };
+
+// Cabecera en la primera pagina del archivo; los segmentos van detras
+typedef struct {
+    char magic[8];
+    int version;
+    int rng;
+    int sampling;
+    int precision;
+    unsigned long long seed;
+    double needle_length;
+    double line_spacing;
+    volatile long long num_segments;
+} mc_ledger_header_t;
+
+typedef struct {
+    MC_ALIGN(MC_CACHE_LINE) long long first;   // primera muestra global del segmento
+    long long count;
+    int method;
+    volatile long long sel;                    // copia vigente de done/hits
+    long long done[2];                         // muestras contadas desde 'first'
+    long long hits[2];
+} mc_ledger_seg_t;
+
+typedef struct {
+    mc_file_map_t map;
+    char path[MC_PATH_MAX];
+    mc_ledger_header_t* header;
+    mc_ledger_seg_t* segs;
+    double flush_every;                        // 0 = nunca desde los workers
+    volatile long long next_flush;             // mc_tick_count() de la proxima escritura
+} mc_ledger_t;
+
+// Registro de la corrida en curso (programa run); NULL = corrida sin registro
+static mc_ledger_t* g_ledger = NULL;
+
+static size_t mc_ledger_size(long long num_segments) {
+    return MC_PAGE_SIZE + sizeof(mc_ledger_seg_t) * (size_t)num_segments;
+}
+
+static void mc_ledger_map(mc_ledger_t* lg) {
+    lg->header = (mc_ledger_header_t*)lg->map.addr;
+    lg->segs = (mc_ledger_seg_t*)((char*)lg->map.addr + MC_PAGE_SIZE);
+}
+
+// Abre el registro 'path'. Con 'create' y un archivo nuevo lo inicializa con
+// 'params' y deja *created en 1. Devuelve -1 si no se puede abrir o no es un
+// registro valido.
+int mc_ledger_open(mc_ledger_t* lg, const char* path, const mc_params_t* params,
+                   int create, int* created) {
+    memset(lg, 0, sizeof(*lg));
+    if (created) *created = 0;
+    if (mc_file_map(&lg->map, path, create ? MC_PAGE_SIZE : 0, create) != 0) {
+        fprintf(stderr, "Error abriendo el registro %s: %lu\n", path, mc_last_error());
+        return -1;
+    }
+    mc_ledger_map(lg);
+    snprintf(lg->path, sizeof(lg->path), "%s", path);
+
+    mc_ledger_header_t* h = lg->header;
+    static const char zero[8] = { 0 };
+    if (create && memcmp(h->magic, zero, sizeof(zero)) == 0 && h->num_segments == 0) {
+        h->version = MC_LEDGER_VERSION;
+        h->rng = params->rng;
+        h->sampling = params->sampling;
+        h->precision = params->precision;
+        h->seed = params->seed;
+        h->needle_length = params->needle_length;
+        h->line_spacing = params->line_spacing;
+        memcpy(h->magic, mc_ledger_magic, sizeof(h->magic));
+        mc_file_sync(&lg->map);
+        if (created) *created = 1;
+    }
+    if (memcmp(h->magic, mc_ledger_magic, sizeof(h->magic)) != 0 ||
+        h->version != MC_LEDGER_VERSION || h->num_segments < 0 ||
+        h->rng < 0 || h->rng >= MC_RNG_COUNT || h->sampling < 0 || h->sampling >= MC_SAMPLING_COUNT ||
+        h->precision < 0 || h->precision >= MC_PREC_COUNT ||
+        mc_ledger_size(h->num_segments) > lg->map.size) {
+        fprintf(stderr, "%s no es un registro valido\n", path);
+        mc_file_unmap(&lg->map);
+        return -1;
+    }
+    return 0;
+}
+
+void mc_ledger_close(mc_ledger_t* lg) {
+    mc_file_sync(&lg->map);
+    mc_file_unmap(&lg->map);
+}
+
+// Parametros de la corrida registrada para 'method'
+mc_params_t mc_ledger_params(const mc_ledger_t* lg, int method) {
+    mc_params_t p;
+    p.method = method;
+    p.rng = lg->header->rng;
+    p.sampling = lg->header->sampling;
+    p.precision = lg->header->precision;
+    p.seed = lg->header->seed;
+    p.needle_length = lg->header->needle_length;
+    p.line_spacing = lg->header->line_spacing;
+    return p;
+}
+
+static void mc_ledger_seg_state(mc_ledger_seg_t* seg, long long* done, long long* hits) {
+    int k = (int)(mc_atomic_load(&seg->sel) & 1);
+    *done = seg->done[k];
+    *hits = seg->hits[k];
+}
+
+static void mc_ledger_seg_commit(mc_ledger_seg_t* seg, long long done, long long hits) {
+    int k = (int)(seg->sel & 1) ^ 1;
+    seg->done[k] = done;
+    seg->hits[k] = hits;
+    mc_atomic_store(&seg->sel, k);
+}
+
+// Muestras pedidas, contadas y aciertos acumulados de 'method'
+void mc_ledger_progress(mc_ledger_t* lg, int method, long long* target,
+                        long long* done, long long* hits) {
+    *target = *done = *hits = 0;
+    for (long long i = 0; i < lg->header->num_segments; i++) {
+        mc_ledger_seg_t* seg = &lg->segs[i];
+        long long d, h;
+        if (seg->method != method) continue;
+        mc_ledger_seg_state(seg, &d, &h);
+        *target += seg->count;
+        *done += d;
+        *hits += h;
+    }
+}
+
+// Lleva el objetivo de 'method' a 'target' muestras agregando segmentos que
+// cubren [objetivo actual, target). No debe haber workers usando el registro.
+int mc_ledger_extend(mc_ledger_t* lg, int method, long long target) {
+    long long have, done, hits;
+
+    mc_ledger_progress(lg, method, &have, &done, &hits);
+    if (target <= have) return 0;
+
+    long long count = target - have;
+    long long size = (count + MC_LEDGER_SEGMENTS - 1) / MC_LEDGER_SEGMENTS;
+    size = (size + MC_BLOCK_POINTS - 1) / MC_BLOCK_POINTS * MC_BLOCK_POINTS;
+    if (size < MC_LEDGER_MIN_SEGMENT) size = MC_LEDGER_MIN_SEGMENT;
+    long long added = (count + size - 1) / size;
+    long long old = lg->header->num_segments;
+
+    if (mc_file_grow(&lg->map, mc_ledger_size(old + added)) != 0) {
+        fprintf(stderr, "Error agrandando el registro: %lu\n", mc_last_error());
+        return -1;
+    }
+    mc_ledger_map(lg);
+    for (long long i = 0; i < added; i++) {
+        mc_ledger_seg_t* seg = &lg->segs[old + i];
+        memset(seg, 0, sizeof(*seg));
+        seg->first = have + i * size;
+        seg->count = target - seg->first < size ? target - seg->first : size;
+        seg->method = method;
+    }
+    // Los segmentos llegan a disco antes que el contador que los publica
+    mc_file_sync(&lg->map);
+    mc_atomic_store(&lg->header->num_segments, old + added);
+    mc_file_sync(&lg->map);
+    return 0;
+}
+
+// Segmentos de 'method' que aun tienen muestras por contar (lista con malloc)
+mc_ledger_seg_t** mc_ledger_pending(mc_ledger_t* lg, int method, long long* count) {
+    long long n = lg->header->num_segments;
+    mc_ledger_seg_t** list = (mc_ledger_seg_t**)malloc(sizeof(mc_ledger_seg_t*) * (size_t)(n > 0 ? n : 1));
+
+    *count = 0;
+    if (list == NULL) {
+        fprintf(stderr, "Sin memoria para %lld segmentos\n", n);
+        exit(1);
+    }
+    for (long long i = 0; i < n; i++) {
+        long long d, h;
+        if (lg->segs[i].method != method) continue;
+        mc_ledger_seg_state(&lg->segs[i], &d, &h);
+        if (d < lg->segs[i].count) list[(*count)++] = &lg->segs[i];
+    }
+    return list;
+}
+
+void mc_ledger_flush(mc_ledger_t* lg) {
+    if (mc_file_sync(&lg->map) != 0) {
+        fprintf(stderr, "Error escribiendo el registro: %lu\n", mc_last_error());
+    }
+}
+
+// Escritura periodica: la hace el primer worker que encuentra el plazo vencido
+static void mc_ledger_tick(mc_ledger_t* lg) {
+    if (lg->flush_every <= 0.0) return;
+    long long now = (long long)mc_tick_count();
+    long long due = mc_atomic_load(&lg->next_flush);
+    if (now < due) return;
+    if (!mc_atomic_cas(&lg->next_flush, due, now + (long long)(lg->flush_every * 1000.0))) return;
+    mc_ledger_flush(lg);
+}
+
+// Cuenta lo que falta del segmento, anotando la posicion cada MC_LEDGER_STEP
+// muestras. Devuelve los aciertos nuevos y deja en *points las muestras nuevas.
+long long mc_ledger_advance(mc_ledger_t* lg, mc_ledger_seg_t* seg, mc_stream_t* st,
+                            long long* points) {
+    long long done, hits, start, added = 0;
+
+    mc_ledger_seg_state(seg, &done, &hits);
+    start = done;
+    while (done < seg->count) {
+        long long step = seg->count - done < MC_LEDGER_STEP ? seg->count - done : MC_LEDGER_STEP;
+        long long h = mc_count_stream(st, seg->first + done, step);
+        done += step;
+        hits += h;
+        added += h;
+        mc_ledger_seg_commit(seg, done, hits);
+        mc_ledger_tick(lg);
+    }
+    *points = done - start;
+    return added;
+}
+
+// ==================== MONITOR DE PROGRESO ====================
+// Con --progress S un hilo del padre muestrea cada S segundos los contadores
+// de avance de los workers y escribe en stderr las muestras contadas, el
+// ritmo del ultimo intervalo, el tiempo restante estimado y la estimacion
+// parcial de pi con su intervalo de confianza del 95%. Los workers actualizan
+// sus contadores una vez por chunk (o por paso del registro), fuera del
+// kernel, y el monitor solo los lee: sin --progress no hay hilo ni costo.
+//  - threads:  aciertos y puntos de cada slot del pool (atomicos relajados).
+//  - procesos: los rangos cerrados mas el avance del rango en curso de cada
+//              slot de la memoria compartida.
+//  - registro: el estado de los segmentos, que ya anotan los workers.
+#define MC_PROGRESS_POINTS (4 * MC_BLOCK_POINTS)
+#define MC_MONITOR_TICK_MS 50
+
+typedef struct mc_monitor mc_monitor_t;
+
+// Muestras y aciertos acumulados hasta ahora segun la fuente m->ctx
+typedef void (*mc_progress_fn)(const mc_monitor_t* m, long long* points, long long* hits);
+
+struct mc_monitor {
+    const mc_params_t* params;
+    mc_progress_fn sample;
+    void* ctx;
+    long long total;          // muestras del trabajo, incluidas las ya contadas
+    long long base;           // muestras ya contadas al arrancar (registro)
+    double start;
+    volatile long long stop;
+    mc_thread_t thread;
+    int running;
+};
+
+// Duracion legible: 1h02m03s, 4m05s o 6.7s
+static void mc_format_duration(double seconds, char* buf, size_t size) {
+    if (!(seconds < 1e9)) {
+        snprintf(buf, size, "?");
+    } else if (seconds >= 3600.0) {
+        long long s = (long long)seconds;
+        snprintf(buf, size, "%lldh%02lldm%02llds", s / 3600, s / 60 % 60, s % 60);
+    } else if (seconds >= 60.0) {
+        long long s = (long long)seconds;
+        snprintf(buf, size, "%lldm%02llds", s / 60, s % 60);
+    } else {
+        snprintf(buf, size, "%.1fs", seconds);
+    }
+}
+
+static mc_thread_ret_t MC_THREAD_API mc_monitor_thread(void* arg) {
+    mc_monitor_t* m = (mc_monitor_t*)arg;
+    double z = mc_normal_quantile(0.95);
+    double last_time = m->start, next = m->start + g_progress_every;
+    long long last_points = m->base;
+
+    while (!mc_atomic_load(&m->stop)) {
+        mc_sleep_ms(MC_MONITOR_TICK_MS);
+        double now = mc_now();
+        if (now < next) continue;
+        next = now + g_progress_every;
+
+        long long points, hits;
+        char eta[32];
+        m->sample(m, &points, &hits);
+        if (points > m->total) points = m->total;
+        double rate = (points - last_points) / (now - last_time);
+        if (!(rate > 0.0)) rate = (points - m->base) / (now - m->start);
+        mc_format_duration(rate > 0.0 ? (m->total - points) / rate : HUGE_VAL, eta, sizeof(eta));
+        last_points = points;
+        last_time = now;
+
+        if (points > 0) {
+            double pi = mc_estimate_pi(m->params, hits, points);
+            double half = z * mc_pi_sigma(m->params, hits, points) / sqrt((double)points);
+            fprintf(stderr, "[progreso] %5.1f%% %lld de %lld muestras, %.3g muestras/s, "
+                            "restan %s, pi = %.10f +- %.2e\n",
+                    100.0 * points / m->total, points, m->total, rate, eta, pi, half);
+        } else {
+            fprintf(stderr, "[progreso] 0 de %lld muestras\n", m->total);
+        }
+    }
+    return 0;
+}
+
+// Arranca el monitor si se pidio --progress; 'base' son las muestras que ya
+// estaban contadas (con registro) y no entran en el ritmo
+static void mc_monitor_start(mc_monitor_t* m, const mc_params_t* params, long long total,
+                             long long base, mc_progress_fn sample, void* ctx) {
+    memset(m, 0, sizeof(*m));
+    if (g_progress_every <= 0.0 || total <= 0) return;
+    m->params = params;
+    m->sample = sample;
+    m->ctx = ctx;
+    m->total = total;
+    m->base = base;
+    m->start = mc_now();
+    if (mc_thread_create(&m->thread, mc_monitor_thread, m) != 0) {
+        fprintf(stderr, "No se pudo crear el monitor de progreso: %lu\n", mc_last_error());
+        return;
+    }
+    m->running = 1;
+}
+
+static void mc_monitor_stop(mc_monitor_t* m) {
+    if (!m->running) return;
+    mc_atomic_store(&m->stop, 1);
+    mc_thread_join(m->thread);
+    m->running = 0;
+}
+
+// Fuente para corridas con registro: lo anotado en los segmentos del metodo
+static void mc_progress_ledger(const mc_monitor_t* m, long long* points, long long* hits) {
+    long long target;
+    mc_ledger_progress((mc_ledger_t*)m->ctx, m->params->method, &target, points, hits);
+}
+
+// ==================== WORKER DE PROCESO ====================
+// Cada proceso hijo toma rangos libres del trabajo publicado y los cuenta con
+// el kernel del integrando (Dartboard, Needles u otro) hasta que no quede
+// ninguno; despues publica su resultado, que el padre informa fuera de la
+// medicion. Con un registro, los rangos son grupos de segmentos pendientes y
+// el padre es quien lleva el archivo a disco.
+
+// Publica el resultado del worker en su slot y avisa al padre
+static void mc_publish_result(shared_data_t* shared, int worker_id, int generation,
+                              long long hits, long long points) {
+    mc_result_slot_t* slot = &shared->slots[worker_id];
+    slot->points_inside = hits;
+    slot->points_done = points;
+    slot->pid = mc_process_id();
+    mc_atomic_store(&slot->done, generation);
+    if (mc_atomic_add32(&shared->remaining, -1) == 0) {
+        mc_futex_wake_all(&shared->remaining);
+    }
+}
+
+// Toma un rango libre: primero en orden y despues, por si el padre devolvio
+// los de un worker muerto, recorriendo la tabla. Devuelve -1 si no queda.
+static long long mc_claim_range(shared_data_t* shared, int worker_id) {
+    for (;;) {
+        long long r = mc_atomic_add(&shared->next_range, 1) - 1;
+        if (r >= shared->num_ranges) break;
+        if (mc_atomic_cas(&shared->ranges[r].state, MC_PROC_RANGE_FREE, worker_id + 1)) return r;
+    }
+    for (long long r = 0; r < shared->num_ranges; r++) {
+        if (mc_atomic_load(&shared->ranges[r].state) == MC_PROC_RANGE_FREE &&
+            mc_atomic_cas(&shared->ranges[r].state, MC_PROC_RANGE_FREE, worker_id + 1)) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+// Equipo de hilos de un hijo en modo hibrido: el pool de threads (mas abajo)
+long long mc_pool_count(const mc_params_t* params, long long first, long long count, int workers);
+long long mc_pool_count_ledger(const mc_params_t* params, mc_ledger_t* lg, mc_ledger_seg_t** segs,
+                               long long num_segs, int workers, long long* points);
+
+#ifdef MC_PROFILE
+// Contadores del hilo principal del hijo; el perfil va al slot del worker
+static mc_perf_t g_proc_perf;
+#endif
+
+// Cuenta un rango; con registro avanza cada segmento pendiente del grupo. Sin
+// registro va por tramos de MC_PROGRESS_POINTS y deja el avance en 'slot'
+// (si lo hay) para el monitor. Con threads > 1 el rango lo cuenta el equipo
+// de hilos del proceso, que reduce sus aciertos antes de volver.
+static long long mc_count_proc_range(const mc_proc_range_t* range, mc_ledger_t* lg,
+                                     mc_stream_t* st, int method, int threads,
+                                     mc_result_slot_t* slot, long long* points) {
+    long long hits = 0;
+
+    *points = 0;
+    if (lg == NULL) {
+        // Al equipo, tramos de cuatro veces lo de un hilo por cada uno: repartir
+        // cuesta unos microsegundos y el tramo, milisegundos
+        long long quantum = threads > 1 ? 4 * MC_PROGRESS_POINTS * threads : MC_PROGRESS_POINTS;
+        while (*points < range->count) {
+            long long step = range->count - *points < quantum ? range->count - *points : quantum;
+            MC_PROF(if (slot != NULL) mc_prof_kernel_begin(&g_proc_perf, &slot->prof));
+            if (threads > 1) hits += mc_pool_count(st->params, range->first + *points, step, threads);
+            else hits += mc_count_stream(st, range->first + *points, step);
+            MC_PROF(if (slot != NULL) mc_prof_kernel_end(&g_proc_perf, &slot->prof, step));
+            *points += step;
+            if (slot == NULL) continue;
+            mc_atomic_store_relaxed(&slot->range_hits, hits);
+            mc_atomic_store_relaxed(&slot->range_points, *points);
+        }
+        return hits;
+    }
+    if (threads > 1) {
+        mc_ledger_seg_t** segs = (mc_ledger_seg_t**)malloc(sizeof(mc_ledger_seg_t*) *
+                                                           (size_t)(range->seg_end - range->seg + 1));
+        long long num_segs = 0;
+        if (segs != NULL) {
+            for (long long i = range->seg; i < range->seg_end; i++) {
+                long long d, h;
+                if (lg->segs[i].method != method) continue;
+                mc_ledger_seg_state(&lg->segs[i], &d, &h);
+                if (d < lg->segs[i].count) segs[num_segs++] = &lg->segs[i];
+            }
+            MC_PROF(if (slot != NULL && num_segs > 0) mc_prof_kernel_begin(&g_proc_perf, &slot->prof));
+            if (num_segs > 0) hits = mc_pool_count_ledger(st->params, lg, segs, num_segs, threads, points);
+            MC_PROF(if (slot != NULL && num_segs > 0) mc_prof_kernel_end(&g_proc_perf, &slot->prof, *points));
+            free(segs);
+            return hits;
+        }
+    }
+    for (long long i = range->seg; i < range->seg_end; i++) {
+        long long d, h, n;
+        if (lg->segs[i].method != method) continue;
+        mc_ledger_seg_state(&lg->segs[i], &d, &h);
+        if (d >= lg->segs[i].count) continue;
+        MC_PROF(if (slot != NULL) mc_prof_kernel_begin(&g_proc_perf, &slot->prof));
+        hits += mc_ledger_advance(lg, &lg->segs[i], st, &n);
+        MC_PROF(if (slot != NULL) mc_prof_kernel_end(&g_proc_perf, &slot->prof, n));
+        *points += n;
+    }
+    return hits;
+}
+
+// Atiende el trabajo 'generation' ya publicado en la memoria compartida
+void mc_process_worker(int worker_id, shared_data_t* shared, int generation) {
+    mc_params_t params = mc_params_from_shared(shared);
+    mc_result_slot_t* slot = &shared->slots[worker_id];
+    mc_ledger_t lg;
+    mc_ledger_t* ledger = NULL;
+    mc_stream_t st;
+    long long local_hits = 0, local_points = 0, r;
+    
+    // Sin el registro no se toca ningun rango: el padre cuenta los que queden
+    if (shared->ledger[0] != '\0') {
+        if (mc_ledger_open(&lg, shared->ledger, &params, 0, NULL) != 0) {
+            mc_publish_result(shared, worker_id, generation, 0, 0);
+            return;
+        }
+        ledger = &lg;
+    }
+    // El flujo grabado queda abierto entre trabajos mientras no cambie
+    if (mc_replay_use(shared->replay) != 0) {
+        if (ledger != NULL) mc_file_unmap(&lg.map);
+        mc_publish_result(shared, worker_id, generation, 0, 0);
+        return;
+    }
+    mc_stream_init(&st, &params);
+    // Modo hibrido: el equipo ocupa los puestos de este hijo en la politica del padre
+    int threads = shared->threads > 1 ? shared->threads : 1;
+    if (threads > 1) mc_placement_team(shared->placement, worker_id * threads);
+    // Perfil por llamada de conteo, como en el pool de threads
+    MC_PROF(memset(&shared->slots[worker_id].prof, 0, sizeof(mc_prof_worker_t)));
+    MC_PROF(mc_perf_open(&g_proc_perf));
+    // Un hijo huerfano deja de tomar rangos: nadie va a juntar el resultado
+    while (!mc_parent_gone(shared->parent) && (r = mc_claim_range(shared, worker_id)) >= 0) {
+        mc_proc_range_t* range = &shared->ranges[r];
+        long long n;
+        range->hits = mc_count_proc_range(range, ledger, &st, params.method, threads, slot, &n);
+        range->points = n;
+        // El avance pasa del slot al rango cerrado
+        mc_atomic_store_relaxed(&slot->range_points, 0);
+        mc_atomic_store_relaxed(&slot->range_hits, 0);
+        mc_atomic_store(&range->state, MC_PROC_RANGE_DONE);
+        local_hits += range->hits;
+        local_points += n;
+    }
+    MC_PROF(mc_perf_close(&g_proc_perf));
+    if (ledger != NULL) mc_file_unmap(&lg.map);
+    
+    mc_publish_result(shared, worker_id, generation, local_hits, local_points);
+}
+
+// ==================== POOL DE THREADS CON ROBO DE TRABAJO ====================
+// Los hilos se crean una sola vez (uno por procesador logico, o mas si se
+// piden) y quedan esperando trabajos. Cada trabajo se corta en chunks de
+// tamano fijo repartidos en una cola por worker: el dueno consume desde el
+// frente y, cuando la suya se vacia, roba del final de la cola de otro. Asi
+// un hilo lento (SMT, nucleos de distinta velocidad) no fija el tiempo total.
+#define MC_CHUNK_POINTS (4 * MC_BLOCK_POINTS)
+#define MC_MIN_CHUNK_POINTS 8192
+#define MC_MAX_POOL 1024
+
+// Tamano de chunk en uso; 'programa tune' lo ajusta a la maquina (perfil)
+static long long g_chunk_points = MC_CHUNK_POINTS;
+
+// Cola de chunks [head, tail) empaquetada en una palabra: el dueno toma del
+// frente y los ladrones del final, ambos con un solo CAS
+typedef struct {
+    MC_ALIGN(MC_CACHE_LINE) volatile long long range;
+} mc_deque_t;
+
+// Acumuladores por worker, cada uno en su propia pagina para que el primer
+// acceso del worker la ubique en su nodo NUMA
+typedef struct {
+    MC_ALIGN(MC_PAGE_SIZE) volatile long long hits;
+    volatile long long points;
+    long long chunks;
+    long long stolen;
+#ifdef MC_PROFILE
+    mc_prof_worker_t prof;
+#endif
+} mc_worker_slot_t;
+
+typedef struct {
+    const mc_params_t* params;
+    long long first;          // primera muestra global del trabajo
+    long long total;
+    long long chunk_points;
+    long long num_chunks;
+    int num_workers;
+    mc_deque_t* deques;
+    mc_worker_slot_t* slots;
+    mc_ledger_t* ledger;      // con registro, el chunk c es el segmento segs[c]
+    mc_ledger_seg_t** segs;
+    long long* trial_hits;    // ensayos en lote: el chunk c son los ensayos [c * chunk_points, ...)
+    long long trial_points;   // muestras por ensayo
+    double deadline;          // mc_now() limite para tomar chunks (0 = sin limite)
+    volatile long long pending;
+} mc_pool_job_t;
+
+typedef struct {
+    mc_lock_t lock;
+    mc_cond_t wake;
+    mc_cond_t done;
+    mc_thread_t threads[MC_MAX_POOL];
+    long long seen[MC_MAX_POOL];  // ultima generacion atendida por cada hilo
+    int size;
+    long long generation;
+    mc_pool_job_t* job;
+    int job_workers;
+    mc_worker_slot_t* slots;      // MC_MAX_POOL slots; cada hilo inicializa el suyo
+    int team;                     // equipo de un hijo hibrido: solo los hilos pedidos
+    int initialized;
+} mc_pool_t;
+
+static mc_pool_t g_pool;
+
+static int mc_deque_pop_front(mc_deque_t* dq, long long* chunk) {
+    for (;;) {
+        long long r = mc_atomic_load(&dq->range);
+        long long head = r >> 32, tail = r & 0xFFFFFFFFll;
+        if (head >= tail) return 0;
+        if (mc_atomic_cas(&dq->range, r, ((head + 1) << 32) | tail)) {
+            *chunk = head;
+            return 1;
+        }
+    }
+}
+
+static int mc_deque_steal_back(mc_deque_t* dq, long long* chunk) {
+    for (;;) {
+        long long r = mc_atomic_load(&dq->range);
+        long long head = r >> 32, tail = r & 0xFFFFFFFFll;
+        if (head >= tail) return 0;
+        if (mc_atomic_cas(&dq->range, r, (head << 32) | (tail - 1))) {
+            *chunk = tail - 1;
+            return 1;
+        }
+    }
+}
+
+// Consume chunks propios y luego robados hasta que no quede ninguno
+static void mc_pool_run(mc_pool_job_t* job, int w) {
+    mc_worker_slot_t* slot = &job->slots[w];
+    long long end = job->first + job->total;
+    long long chunk;
+    mc_stream_t st;
+
+    memset(slot, 0, sizeof(*slot));
+    mc_stream_init(&st, job->params);
+    MC_PROF(mc_perf_t perf);
+    MC_PROF(mc_perf_open(&perf));
+    for (;;) {
+        if (job->deadline > 0 && mc_now() >= job->deadline) break;
+        if (!mc_deque_pop_front(&job->deques[w], &chunk)) {
+            int found = 0;
+            for (int v = 1; v < job->num_workers && !found; v++) {
+                found = mc_deque_steal_back(&job->deques[(w + v) % job->num_workers], &chunk);
+            }
+            if (!found) break;
+            slot->stolen++;
+        }
+        long long first = job->first + chunk * job->chunk_points;
+        long long count = end - first < job->chunk_points ? end - first : job->chunk_points;
+        long long hits;
+        MC_PROF(mc_prof_kernel_begin(&perf, &slot->prof));
+        if (job->segs != NULL) {
+            hits = mc_ledger_advance(job->ledger, job->segs[chunk], &st, &count);
+        } else if (job->trial_hits != NULL) {
+            hits = mc_count_trials(job->params, job->trial_hits, first, count, job->trial_points);
+            count *= job->trial_points;
+        } else {
+            hits = mc_count_stream(&st, first, count);
+        }
+        MC_PROF(mc_prof_kernel_end(&perf, &slot->prof, count));
+        // Una escritura por chunk; el monitor de progreso las lee al vuelo
+        mc_atomic_store_relaxed(&slot->hits, slot->hits + hits);
+        mc_atomic_store_relaxed(&slot->points, slot->points + count);
+        slot->chunks++;
+    }
+    MC_PROF(mc_perf_close(&perf));
+}
+
+static mc_thread_ret_t MC_THREAD_API mc_pool_thread(void* arg) {
+    int w = (int)(size_t)arg;
+    int pinned = -1;
+    int cpu = mc_placement_cpu(w);
+
+    // Fijarse antes de usar la pila, asi sus paginas quedan en el nodo local
+    if (cpu >= 0 && mc_pin_current_thread(cpu) == 0) pinned = cpu;
+    for (;;) {
+        mc_lock(&g_pool.lock);
+        while (g_pool.generation == g_pool.seen[w]) {
+            mc_cond_wait(&g_pool.wake, &g_pool.lock);
+        }
+        g_pool.seen[w] = g_pool.generation;
+        mc_pool_job_t* job = g_pool.job;
+        int participate = w < g_pool.job_workers;
+        mc_unlock(&g_pool.lock);
+
+        if (!participate) continue;
+        // La politica puede cambiar entre trabajos (benchmark)
+        cpu = mc_placement_cpu(w);
+        if (cpu != pinned && mc_pin_current_thread(cpu) == 0) pinned = cpu;
+        mc_pool_run(job, w);
+        if (mc_atomic_add(&job->pending, -1) == 0) {
+            mc_lock(&g_pool.lock);
+            mc_cond_broadcast(&g_pool.done);
+            mc_unlock(&g_pool.lock);
+        }
+    }
+    return 0;
+}
+
+// Garantiza al menos 'workers' hilos vivos; la primera vez crea uno por
+// procesador logico (en un hijo hibrido, solo los de su equipo). Los hilos
+// se reutilizan en todas las llamadas.
+int mc_pool_ensure(int workers) {
+    if (!g_pool.initialized) {
+        mc_lock_init(&g_pool.lock);
+        mc_cond_init(&g_pool.wake);
+        mc_cond_init(&g_pool.done);
+        // Reserva sin tocar: cada pagina la asigna el primer hilo que la usa
+        g_pool.slots = (mc_worker_slot_t*)mc_aligned_alloc(sizeof(mc_worker_slot_t) * MC_MAX_POOL,
+                                                           MC_PAGE_SIZE);
+        if (g_pool.slots == NULL) {
+            fprintf(stderr, "Sin memoria para los slots del pool\n");
+            exit(1);
+        }
+        g_pool.initialized = 1;
+    }
+    int target = g_pool.team ? workers : mc_cpu_count();
+    if (workers > target) target = workers;
+    if (target > MC_MAX_POOL) target = MC_MAX_POOL;
+
+    while (g_pool.size < target) {
+        int w = g_pool.size;
+        g_pool.seen[w] = g_pool.generation;
+        if (mc_thread_create(&g_pool.threads[w], mc_pool_thread, (void*)(size_t)w) != 0) {
+            fprintf(stderr, "Error creando thread %d: %lu\n", w, mc_last_error());
+            exit(1);
+        }
+        g_pool.size++;
+    }
+    return g_pool.size;
+}
+
+// Reparte los chunks del trabajo en partes iguales entre las colas
+static void mc_pool_job_deques(mc_pool_job_t* job) {
+    int workers = job->num_workers;
+
+    mc_pool_ensure(workers);
+    job->deques = (mc_deque_t*)mc_aligned_alloc(sizeof(mc_deque_t) * workers, MC_CACHE_LINE);
+    job->slots = g_pool.slots;    // los pone en cero cada worker en mc_pool_run
+    if (job->deques == NULL) {
+        fprintf(stderr, "Sin memoria para %d workers\n", workers);
+        exit(1);
+    }
+    for (int w = 0; w < workers; w++) {
+        long long head = job->num_chunks * w / workers;
+        long long tail = job->num_chunks * (w + 1) / workers;
+        job->deques[w].range = (head << 32) | tail;
+    }
+}
+
+// Prepara el trabajo [first, first + total) para 'workers' hilos del pool
+void mc_pool_job_init(mc_pool_job_t* job, const mc_params_t* params,
+                      long long first, long long total, int workers) {
+    memset(job, 0, sizeof(*job));
+    job->params = params;
+    job->first = first;
+    job->total = total;
+    job->num_workers = workers;
+
+    // Chunks fijos; en trabajos chicos se achican para que haya que repartir
+    long long chunk = g_chunk_points;
+    if (total / ((long long)workers * 4) < chunk) {
+        chunk = total / ((long long)workers * 4);
+        chunk = (chunk + MC_BATCH - 1) / MC_BATCH * MC_BATCH;
+        if (chunk < MC_MIN_CHUNK_POINTS) chunk = MC_MIN_CHUNK_POINTS;
+    }
+    while ((total + chunk - 1) / chunk > 0x7FFFFFFFll) chunk *= 2;
+    job->chunk_points = chunk;
+    job->num_chunks = (total + chunk - 1) / chunk;
+    mc_pool_job_deques(job);
+}
+
+// Trabajo sobre los segmentos pendientes de un registro: cada segmento es un
+// chunk que un solo worker avanza hasta el final
+void mc_pool_job_init_ledger(mc_pool_job_t* job, const mc_params_t* params, mc_ledger_t* ledger,
+                             mc_ledger_seg_t** segs, long long num_segs, int workers) {
+    memset(job, 0, sizeof(*job));
+    job->params = params;
+    job->num_workers = workers;
+    job->ledger = ledger;
+    job->segs = segs;
+    job->num_chunks = num_segs;
+    mc_pool_job_deques(job);
+}
+
+// Trabajo de 'trials' ensayos de 'points' muestras: cada chunk es un grupo
+// de ensayos y cada ensayo deja sus aciertos en hits[k], sin sincronizar
+void mc_pool_job_init_trials(mc_pool_job_t* job, const mc_params_t* params, long long* hits,
+                             long long trials, long long points, int workers) {
+    memset(job, 0, sizeof(*job));
+    job->params = params;
+    job->total = trials;
+    job->num_workers = workers;
+    job->trial_hits = hits;
+    job->trial_points = points;
+
+    // Unas g_chunk_points muestras por chunk, con al menos un ensayo
+    long long chunk = g_chunk_points / points;
+    if (trials / ((long long)workers * 4) < chunk) chunk = trials / ((long long)workers * 4);
+    if (chunk < 1) chunk = 1;
+    while ((trials + chunk - 1) / chunk > 0x7FFFFFFFll) chunk *= 2;
+    job->chunk_points = chunk;
+    job->num_chunks = (trials + chunk - 1) / chunk;
+    mc_pool_job_deques(job);
+}
+
+void mc_pool_job_free(mc_pool_job_t* job) {
+    mc_aligned_free(job->deques);
+}
+
+// Publica el trabajo y espera a que lo terminen todos sus workers
+void mc_pool_execute(mc_pool_job_t* job) {
+    mc_pool_ensure(job->num_workers);
+    job->pending = job->num_workers;
+
+    mc_lock(&g_pool.lock);
+    g_pool.job = job;
+    g_pool.job_workers = job->num_workers;
+    g_pool.generation++;
+    mc_cond_broadcast(&g_pool.wake);
+    while (mc_atomic_load(&job->pending) > 0) {
+        mc_cond_wait(&g_pool.done, &g_pool.lock);
+    }
+    mc_unlock(&g_pool.lock);
+}
+
+// Cuenta [first, first + count) con 'workers' hilos del pool
+long long mc_pool_count(const mc_params_t* params, long long first, long long count, int workers) {
+    mc_pool_job_t job;
+    long long hits = 0;
+
+    mc_pool_job_init(&job, params, first, count, workers);
+    mc_pool_execute(&job);
+    for (int i = 0; i < workers; i++) hits += job.slots[i].hits;
+    mc_pool_job_free(&job);
+    return hits;
+}
+
+// Avanza con 'workers' hilos del pool los segmentos 'segs' de un registro
+long long mc_pool_count_ledger(const mc_params_t* params, mc_ledger_t* lg, mc_ledger_seg_t** segs,
+                               long long num_segs, int workers, long long* points) {
+    mc_pool_job_t job;
+    long long hits = 0;
+
+    *points = 0;
+    mc_pool_job_init_ledger(&job, params, lg, segs, num_segs, workers);
+    mc_pool_execute(&job);
+    for (int i = 0; i < workers; i++) {
+        hits += job.slots[i].hits;
+        *points += job.slots[i].points;
+    }
+    mc_pool_job_free(&job);
+    return hits;
+}
+
+// Fuente del monitor: lo acumulado en los slots de los hilos del trabajo
+static void mc_progress_pool(const mc_monitor_t* m, long long* points, long long* hits) {
+    const mc_pool_job_t* job = (const mc_pool_job_t*)m->ctx;
+
+    *points = *hits = 0;
+    for (int i = 0; i < job->num_workers; i++) {
+        *points += mc_atomic_load_relaxed(&job->slots[i].points);
+        *hits += mc_atomic_load_relaxed(&job->slots[i].hits);
+    }
+}
+
+// ==================== IMPLEMENTACIÓN CON THREADS ====================
+// Con un registro activo (g_ledger) los motores cuentan solo lo que falta de
+// sus segmentos y el resultado es el acumulado del registro.
+mc_run_t parallel_threads_monte_carlo(long long total_points, int num_threads, int method) {
+    mc_params_t params = mc_make_params(method);
+    mc_pool_job_t job;
+    mc_monitor_t monitor;
+    mc_run_t run;
+    long long total_inside = 0;
+    mc_ledger_seg_t** segs = NULL;
+
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MC_MAX_POOL) num_threads = MC_MAX_POOL;
+
+    if (!g_quiet) {
+        printf("\n=== INICIANDO THREADS (%d hilos, %lld puntos totales) ===\n",
+               num_threads, total_points);
+    }
+
+    // Los hilos del pool ya existen (o se crean aqui, fuera de la medicion)
+    MC_PROF(double setup = mc_now());
+    mc_pool_ensure(num_threads);
+    MC_PROF(setup = mc_now() - setup);
+    if (g_ledger != NULL) {
+        long long num_segs, target, done, hits;
+        segs = mc_ledger_pending(g_ledger, method, &num_segs);
+        mc_pool_job_init_ledger(&job, &params, g_ledger, segs, num_segs, num_threads);
+        mc_ledger_progress(g_ledger, method, &target, &done, &hits);
+        mc_monitor_start(&monitor, &params, target, done, mc_progress_ledger, g_ledger);
+    } else {
+        mc_pool_job_init(&job, &params, 0, total_points, num_threads);
+        mc_monitor_start(&monitor, &params, total_points, 0, mc_progress_pool, &job);
+    }
+
+    double start = mc_now();
+    mc_pool_execute(&job);
+
+    // Recolectar resultados
+    for (int i = 0; i < num_threads; i++) {
+        total_inside += job.slots[i].hits;
+    }
+    if (g_ledger != NULL) {
+        long long target;
+        mc_ledger_flush(g_ledger);
+        mc_ledger_progress(g_ledger, method, &target, &total_points, &total_inside);
+    }
+    double elapsed = mc_now() - start;
+    mc_monitor_stop(&monitor);
+
+    for (int i = 0; i < num_threads && !g_quiet; i++) {
+        mc_worker_slot_t* slot = &job.slots[i];
+        printf("Hilo %d completado: %lld %s de %lld (%lld chunks, %lld robados)\n",
+               i, slot->hits, mc_integrand(&params)->label,
+               slot->points, slot->chunks, slot->stolen);
+    }
+#ifdef MC_PROFILE
+    if (!g_quiet) {
+        mc_prof_worker_t* prof = (mc_prof_worker_t*)malloc(sizeof(mc_prof_worker_t) * num_threads);
+        for (int i = 0; prof != NULL && i < num_threads; i++) prof[i] = job.slots[i].prof;
+        if (prof != NULL) mc_prof_report("THREADS", prof, num_threads, start, start + elapsed, setup);
+        free(prof);
+    }
+#endif
+    mc_pool_job_free(&job);
+    free(segs);
+
+    // Calcular π
+    run.pi = mc_estimate_pi(&params, total_inside, total_points);
+    run.hits = total_inside;
+    run.points = total_points;
+    run.elapsed = elapsed;
+
+    if (!g_quiet) {
+        printf("Tiempo con THREADS: %.6f segundos\n", elapsed);
+        printf("Puntos dentro/cruces: %lld de %lld\n", total_inside, total_points);
+    }
+
+    return run;
+}
+
+// ==================== POOL DE PROCESOS ====================
+// Los procesos hijos se lanzan una sola vez y quedan vivos entre trabajos,
+// durmiendo sobre el contador de generacion de una memoria compartida que
+// dura toda la sesion. Publicar un trabajo cuesta escribir sus parametros y
+// sus rangos: no se relanza el ejecutable ni se reabre el mapping por nombre.
+// Si un hijo muere en medio de un trabajo, el padre devuelve sus rangos a la
+// cola y lo relanza para que se sume al mismo trabajo.
+#define MC_PROC_RESPAWNS 3
+#define MC_PROC_READY_TIMEOUT 10.0
+
+typedef struct {
+    mc_shm_t shm;
+    shared_data_t* shared;
+    char map_name[MAP_NAME_MAX];
+    mc_process_t procs[MAX_PROCESSES];
+    int size;
+    int initialized;
+} mc_proc_pool_t;
+
+static mc_proc_pool_t g_proc_pool;
+
+// Lanza el hijo w. 'generation' es el ultimo trabajo que ya no le toca: el
+// actual si se lanza entre trabajos, el anterior si reemplaza a uno que murio
+// sin terminar el actual.
+static int mc_proc_pool_spawn(int w, int generation) {
+    char worker_arg[16], cpu_arg[16], gen_arg[16];
+
+    // Linea de comandos: exe child <worker_id> <map_name> <cpu> <generacion>
+    snprintf(worker_arg, sizeof(worker_arg), "%d", w);
+    snprintf(cpu_arg, sizeof(cpu_arg), "%d", mc_placement_cpu(w));
+    snprintf(gen_arg, sizeof(gen_arg), "%d", generation);
+    char* child_argv[] = { "montecarlo", "child", worker_arg, g_proc_pool.map_name,
+                           cpu_arg, gen_arg, NULL };
+
+    if (mc_process_spawn(&g_proc_pool.procs[w], child_argv) != 0) {
+        fprintf(stderr, "Error creando proceso %d: %lu\n", w, mc_last_error());
+        return -1;
+    }
+    if (!g_quiet) printf("Proceso hijo %d lanzado (PID: %lu)\n", w, mc_process_pid(&g_proc_pool.procs[w]));
+    return 0;
+}
+
+// Cierra el pool al salir del programa: los hijos ven 'shutdown' y terminan
+static void mc_proc_pool_shutdown(void) {
+    shared_data_t* shared = g_proc_pool.shared;
+
+    if (!g_proc_pool.initialized) return;
+    mc_atomic_add32(&shared->shutdown, 1);
+    mc_atomic_add32(&shared->generation, 1);
+    mc_futex_wake_all(&shared->generation);
+    for (int w = 0; w < g_proc_pool.size; w++) {
+        mc_process_wait(&g_proc_pool.procs[w]);
+    }
+    mc_shm_close(&g_proc_pool.shm);
+    g_proc_pool.initialized = 0;
+}
+
+// Garantiza 'workers' hijos vivos y esperando; relanza los que murieron
+// entre trabajos. Devuelve cuantos hay (menos si no se pudo lanzar alguno).
+int mc_proc_pool_ensure(int workers) {
+    if (!g_proc_pool.initialized) {
+        mc_shm_sweep("MonteCarloPool_");
+        snprintf(g_proc_pool.map_name, MAP_NAME_MAX, MC_SHM_PREFIX "MonteCarloPool_%lu_%lu",
+                 mc_process_id(), mc_tick_count());
+        // Cabecera + un slot por proceso posible; las paginas se asignan al usarlas
+        if (mc_shm_create(&g_proc_pool.shm, g_proc_pool.map_name, mc_shared_size(MAX_PROCESSES)) != 0) {
+            fprintf(stderr, "Error creando file mapping: %lu\n", mc_last_error());
+            exit(1);
+        }
+        g_proc_pool.shared = (shared_data_t*)g_proc_pool.shm.addr;
+        g_proc_pool.shared->parent = mc_process_id();
+        g_proc_pool.initialized = 1;
+        atexit(mc_proc_pool_shutdown);
+    }
+    shared_data_t* shared = g_proc_pool.shared;
+    int generation = mc_atomic_load32(&shared->generation);
+    int expected = mc_atomic_load32(&shared->ready);
+    int available = workers;
+
+    for (int w = 0; w < workers; w++) {
+        if (w < g_proc_pool.size && !mc_process_exited(&g_proc_pool.procs[w])) continue;
+        mc_process_wait(&g_proc_pool.procs[w]);
+        if (mc_proc_pool_spawn(w, generation) != 0) {
+            available = w;
+            break;
+        }
+        if (w >= g_proc_pool.size) g_proc_pool.size = w + 1;
+        expected++;
+    }
+
+    // Esperar a que los nuevos abran el mapping, asi su arranque no se mide
+    double deadline = mc_now() + MC_PROC_READY_TIMEOUT;
+    for (;;) {
+        int ready = mc_atomic_load32(&shared->ready);
+        if (ready >= expected || mc_now() > deadline) break;
+        mc_futex_wait(&shared->ready, ready, 50);
+    }
+    return available;
+}
+
+// Revisa los hijos del trabajo 'generation': al que murio sin publicar se le
+// devuelven los rangos a la cola y se lo relanza para que se sume al mismo
+// trabajo. Tras MC_PROC_RESPAWNS intentos se lo da por perdido.
+static void mc_proc_pool_recover(int workers, int generation, int* respawns) {
+    shared_data_t* shared = g_proc_pool.shared;
+
+    for (int w = 0; w < workers; w++) {
+        if (respawns[w] > MC_PROC_RESPAWNS || !mc_process_exited(&g_proc_pool.procs[w])) continue;
+        mc_process_wait(&g_proc_pool.procs[w]);
+        int published = mc_atomic_load(&shared->slots[w].done) == generation;
+        if (!published) {
+            for (int r = 0; r < shared->num_ranges; r++) {
+                mc_atomic_cas(&shared->ranges[r].state, w + 1, MC_PROC_RANGE_FREE);
+            }
+        }
+        if (++respawns[w] <= MC_PROC_RESPAWNS &&
+            mc_proc_pool_spawn(w, published ? generation : generation - 1) == 0) {
+            if (!published) fprintf(stderr, "Proceso %d termino sin publicar; relanzado\n", w);
+            continue;
+        }
+        respawns[w] = MC_PROC_RESPAWNS + 1;
+        fprintf(stderr, "Proceso %d perdido; sus rangos los cuenta otro\n", w);
+        if (!published) mc_atomic_add32(&shared->remaining, -1);
+    }
+}
+
+// Reparte el trabajo en rangos: MC_RANGES_PER_WORKER por worker para que los
+// que terminan antes tomen parte de la cola, o grupos de segmentos pendientes
+// del registro. Sin registro los rangos cubren [first, first + total).
+static void mc_proc_job_ranges(shared_data_t* shared, long long first, long long total, int workers,
+                               mc_ledger_seg_t** segs, long long num_segs) {
+    long long n;
+
+    if (segs != NULL) {
+        n = num_segs < MC_PROC_RANGES ? num_segs : MC_PROC_RANGES;
+    } else {
+        n = (long long)(workers > 0 ? workers : 1) * MC_RANGES_PER_WORKER;
+        if (n > total / MC_BATCH) n = total / MC_BATCH;
+        if (n > MC_PROC_RANGES) n = MC_PROC_RANGES;
+        if (n < 1) n = 1;
+    }
+    for (long long r = 0; r < n; r++) {
+        mc_proc_range_t* range = &shared->ranges[r];
+        if (segs != NULL) {
+            range->seg = segs[num_segs * r / n] - g_ledger->segs;
+            range->seg_end = segs[num_segs * (r + 1) / n - 1] - g_ledger->segs + 1;
+            range->first = range->count = 0;
+        } else {
+            mc_partition(total, (int)n, (int)r, &range->first, &range->count);
+            range->first += first;
+            range->seg = range->seg_end = 0;
+        }
+        range->hits = range->points = 0;
+        range->state = MC_PROC_RANGE_FREE;
+    }
+    shared->num_ranges = (int)n;
+    shared->next_range = 0;
+}
+
+// Fuente del monitor: rangos cerrados mas el rango en curso de cada hijo
+static void mc_progress_processes(const mc_monitor_t* m, long long* points, long long* hits) {
+    shared_data_t* shared = (shared_data_t*)m->ctx;
+
+    *points = *hits = 0;
+    for (int w = 0; w < shared->num_workers; w++) {
+        *points += mc_atomic_load_relaxed(&shared->slots[w].range_points);
+        *hits += mc_atomic_load_relaxed(&shared->slots[w].range_hits);
+    }
+    for (int r = 0; r < shared->num_ranges; r++) {
+        if (mc_atomic_load(&shared->ranges[r].state) != MC_PROC_RANGE_DONE) continue;
+        *points += shared->ranges[r].points;
+        *hits += shared->ranges[r].hits;
+    }
+}
+
+// ==================== IMPLEMENTACIÓN CON PROCESOS ====================
+// Cuenta [first, first + total_points) del flujo de 'params' con el pool de
+// procesos (o, con registro, lo que le falte al registro)
+mc_run_t mc_processes_run(const mc_params_t* p, long long first, long long total_points,
+                          int num_processes, int threads) {
+    mc_params_t params = *p;
+    int method = params.method;
+    mc_run_t run;
+    shared_data_t* shared = NULL;
+    mc_ledger_seg_t** segs = NULL;
+    long long num_segs = 0;
+    mc_monitor_t monitor;
+    int respawns[MAX_PROCESSES];
+    long long total_inside = 0;
+    long long points_done = 0;
+    int orphans = 0;
+    
+    if (num_processes < 1) num_processes = 1;
+    if (num_processes > MAX_PROCESSES) num_processes = MAX_PROCESSES;
+    if (threads < 1) threads = 1;
+    if (threads > MC_MAX_POOL) threads = MC_MAX_POOL;
+    
+    if (!g_quiet && threads > 1) {
+        printf("\n=== INICIANDO HIBRIDO (%d procesos x %d hilos, %lld puntos totales) ===\n",
+               num_processes, threads, total_points);
+    } else if (!g_quiet) {
+        printf("\n=== INICIANDO PROCESOS (%d procesos, %lld puntos totales) ===\n",
+               num_processes, total_points);
+    }
+    
+    // Los hijos del pool ya existen (o se lanzan aqui, fuera de la medicion)
+    int workers = mc_proc_pool_ensure(num_processes);
+    shared = g_proc_pool.shared;
+    
+    // Escribir el trabajo: todos los hijos del anterior ya publicaron
+    shared->total_points = total_points;
+    shared->num_workers = workers;
+    shared->method = method;
+    shared->needle_length = params.needle_length;
+    shared->line_spacing = params.line_spacing;
+    shared->rng = params.rng;
+    shared->sampling = params.sampling;
+    shared->precision = params.precision;
+    shared->seed = params.seed;
+    shared->threads = threads;
+    shared->placement = g_placement;
+    shared->remaining = workers;
+    shared->ledger[0] = '\0';
+    shared->replay[0] = '\0';
+    if (g_replay != NULL) {
+        snprintf(shared->replay, sizeof(shared->replay), "%s", g_replay->path);
+    }
+    if (g_ledger != NULL) {
+        snprintf(shared->ledger, sizeof(shared->ledger), "%s", g_ledger->path);
+        segs = mc_ledger_pending(g_ledger, method, &num_segs);
+    }
+    mc_proc_job_ranges(shared, first, total_points, workers, segs, num_segs);
+    int generation = mc_atomic_load32(&shared->generation) + 1;
+    for (int i = 0; i < workers; i++) {
+        // En modo hibrido se fijan los hilos del equipo, no el hilo principal
+        shared->assign[i].cpu = threads > 1 ? -1 : mc_placement_cpu(i);
+        shared->assign[i].generation = generation;
+        respawns[i] = 0;
+    }
+    if (g_ledger != NULL) {
+        long long target, done, hits;
+        mc_ledger_progress(g_ledger, method, &target, &done, &hits);
+        mc_monitor_start(&monitor, &params, target, done, mc_progress_ledger, g_ledger);
+    } else {
+        mc_monitor_start(&monitor, &params, total_points, 0, mc_progress_processes, shared);
+    }
+    
+    double start = mc_now();
+    mc_atomic_add32(&shared->generation, 1);
+    mc_futex_wake_all(&shared->generation);
+    
+    // Barrera: dormir sobre el contador hasta que todos publiquen, revisando
+    // en cada vuelta si algun hijo murio
+    for (;;) {
+        int left = mc_atomic_load32(&shared->remaining);
+        if (left <= 0) break;
+        mc_futex_wait(&shared->remaining, left, 50);
+        if (g_ledger != NULL) mc_ledger_tick(g_ledger);
+        mc_proc_pool_recover(workers, generation, respawns);
+    }
+    
+    // Rangos que no cerro ningun hijo (perdidos o sin lanzar): los cuenta el padre
+    for (int r = 0; r < shared->num_ranges; r++) {
+        mc_proc_range_t* range = &shared->ranges[r];
+        mc_stream_t st;
+        long long n;
+        if (mc_atomic_load(&range->state) == MC_PROC_RANGE_DONE) continue;
+        mc_stream_init(&st, &params);
+        range->hits = mc_count_proc_range(range, g_ledger, &st, method, 1, NULL, &n);
+        range->points = n;
+        range->state = MC_PROC_RANGE_DONE;
+        orphans++;
+    }
+    
+    double elapsed = mc_now() - start;
+    mc_monitor_stop(&monitor);
+    if (orphans > 0) fprintf(stderr, "El padre conto %d rangos sin worker\n", orphans);
+    
+    // Lo que informa cada hijo, ya fuera de la medicion
+    for (int i = 0; i < workers && !g_quiet; i++) {
+        mc_result_slot_t* slot = &shared->slots[i];
+        if (mc_atomic_load(&slot->done) != generation) continue;
+        printf("Proceso %d (PID %lu): %lld %s\n",
+               i, slot->pid, slot->points_inside, mc_integrand(&params)->label);
+    }
+    
+    // Reducir los rangos cerrados, sin ningun lock
+    for (int r = 0; r < shared->num_ranges; r++) {
+        total_inside += shared->ranges[r].hits;
+        points_done += shared->ranges[r].points;
+    }
+    // Con registro cuenta el acumulado, incluido lo de corridas anteriores
+    if (g_ledger != NULL) {
+        long long target;
+        mc_ledger_flush(g_ledger);
+        mc_ledger_progress(g_ledger, method, &target, &points_done, &total_inside);
+    }
+    free(segs);
+#ifdef MC_PROFILE
+    if (!g_quiet && workers > 0) {
+        double reduced = mc_now();
+        mc_prof_worker_t* prof = (mc_prof_worker_t*)calloc(workers, sizeof(mc_prof_worker_t));
+        for (int i = 0; prof != NULL && i < workers; i++) {
+            if (mc_atomic_load(&shared->slots[i].done) == generation) prof[i] = shared->slots[i].prof;
+        }
+        if (prof != NULL) mc_prof_report("PROCESOS", prof, workers, start, reduced, 0.0);
+        free(prof);
+    }
+#endif
+    
+    // Calcular π con los puntos efectivamente procesados
+    run.pi = mc_estimate_pi(&params, total_inside, points_done);
+    run.hits = total_inside;
+    run.points = points_done;
+    run.elapsed = elapsed;
+    
+    if (!g_quiet) {
+        printf("Tiempo con %s: %.6f segundos\n", threads > 1 ? "HIBRIDO" : "PROCESOS", elapsed);
+        printf("Puntos dentro/cruces: %lld de %lld\n", total_inside, points_done);
+    }
+    
+    return run;
+}
+
+mc_run_t parallel_processes_monte_carlo(long long total_points, int num_processes, int method) {
+    mc_params_t params = mc_make_params(method);
+    return mc_processes_run(&params, 0, total_points, num_processes, 1);
+}
+
+// ==================== IMPLEMENTACIÓN HÍBRIDA (PROCESOS x THREADS) ====================
+// Un proceso por socket o contenedor y un equipo de hilos dentro de cada uno:
+// cada hijo del pool de procesos cuenta los rangos que toma con su propio
+// pool de 'threads_per_process' hilos, reduce en el proceso y publica un
+// solo resultado en su slot. Los rangos y la recuperacion de hijos muertos
+// son los del modo procesos; con --placement el equipo del hijo w ocupa los
+// puestos [w * T, (w + 1) * T) de la politica.
+mc_run_t parallel_hybrid_monte_carlo(long long total_points, int num_processes,
+                                     int threads_per_process, int method) {
+    mc_params_t params = mc_make_params(method);
+    return mc_processes_run(&params, 0, total_points, num_processes, threads_per_process);
+}
+
+// ==================== CÓDIGO PARA PROCESOS HIJOS ====================
+// Un hijo del pool se fija a su procesador, abre el mapping una sola vez y
+// atiende trabajos hasta que el padre cierra el pool o desaparece.
+int run_as_child_process(int argc, char* argv[]) {
+    if (argc < 6) {
+        fprintf(stderr, "Uso: programa child worker_id map_name cpu generacion\n");
+        return 1;
+    }
+    
+    int worker_id = atoi(argv[2]);
+    char* map_name = argv[3];
+    int cpu = atoi(argv[4]);
+    int seen = atoi(argv[5]);
+    int pinned = -1;
+    
+    // Morir con el padre: un huerfano seguiria contando el trabajo entero
+    mc_die_with_parent();
+    // Fijarse al procesador antes de tocar el slot propio
+    if (cpu >= 0 && mc_pin_current_thread(cpu) == 0) pinned = cpu;
+    // En modo hibrido el pool de este hijo es su equipo: solo los hilos pedidos
+    g_pool.team = 1;
+    
+    // Abrir y mapear el file mapping existente
+    mc_shm_t shm;
+    if (mc_shm_open(&shm, map_name, mc_shared_size(MAX_PROCESSES)) != 0) {
+        fprintf(stderr, "Error abriendo file mapping: %lu\n", mc_last_error());
+        return 1;
+    }
+    shared_data_t* shared = (shared_data_t*)shm.addr;
+    if (worker_id < 0 || worker_id >= MAX_PROCESSES) {
+        fprintf(stderr, "Worker %d fuera de rango\n", worker_id);
+        mc_shm_close(&shm);
+        return 1;
+    }
+    mc_atomic_add32(&shared->ready, 1);
+    mc_futex_wake_all(&shared->ready);
+    
+    for (;;) {
+        int generation = mc_atomic_load32(&shared->generation);
+        if (mc_atomic_load32(&shared->shutdown)) break;
+        if (generation == seen) {
+            if (mc_parent_gone(shared->parent)) break;
+            mc_futex_wait(&shared->generation, generation, 500);
+            continue;
+        }
+        seen = generation;
+        // Trabajos con menos workers, o uno que este hijo ya publico antes de morir
+        if (shared->assign[worker_id].generation != generation ||
+            mc_atomic_load(&shared->slots[worker_id].done) == generation) {
+            continue;
+        }
+        // La politica de ubicacion puede cambiar entre trabajos (benchmark)
+        cpu = shared->assign[worker_id].cpu;
+        if (cpu != pinned && mc_pin_current_thread(cpu) == 0) pinned = cpu;
+        mc_process_worker(worker_id, shared, generation);
+    }
+    
+    mc_shm_close(&shm);
+    
+    return 0;
+}
+
+// ==================== VERSIÓN SERIAL ====================
+// Avance de la corrida serial, para el monitor
+typedef struct {
+    volatile long long points;
+    volatile long long hits;
+} mc_serial_progress_t;
+
+static void mc_progress_serial(const mc_monitor_t* m, long long* points, long long* hits) {
+    mc_serial_progress_t* sp = (mc_serial_progress_t*)m->ctx;
+    *points = mc_atomic_load_relaxed(&sp->points);
+    *hits = mc_atomic_load_relaxed(&sp->hits);
+}
+
+mc_run_t serial_monte_carlo(long long total_points, int method) {
+    long long count = 0;
+    mc_params_t params = mc_make_params(method);
+    mc_serial_progress_t progress = { 0, 0 };
+    mc_monitor_t monitor;
+    mc_stream_t st;
+    mc_run_t run;
+    
+    if (!g_quiet) printf("\n=== INICIANDO VERSION SERIAL (%lld puntos) ===\n", total_points);
+    
+    MC_PROF(mc_prof_worker_t prof);
+    MC_PROF(mc_perf_t perf);
+    MC_PROF(memset(&prof, 0, sizeof(prof)));
+    MC_PROF(mc_perf_open(&perf));
+    mc_stream_init(&st, &params);
+    if (g_ledger != NULL) {
+        long long target, done, hits;
+        mc_ledger_progress(g_ledger, method, &target, &done, &hits);
+        mc_monitor_start(&monitor, &params, target, done, mc_progress_ledger, g_ledger);
+    } else {
+        mc_monitor_start(&monitor, &params, total_points, 0, mc_progress_serial, &progress);
+    }
+    double start = mc_now();
+    
+    // El mismo flujo global que reparten threads y procesos
+    MC_PROF(mc_prof_kernel_begin(&perf, &prof));
+    if (g_ledger != NULL) {
+        long long num_segs, points;
+        mc_ledger_seg_t** segs = mc_ledger_pending(g_ledger, method, &num_segs);
+        for (long long i = 0; i < num_segs; i++) {
+            mc_ledger_advance(g_ledger, segs[i], &st, &points);
+        }
+        free(segs);
+        mc_ledger_flush(g_ledger);
+        mc_ledger_progress(g_ledger, method, &points, &total_points, &count);
+    } else {
+        // Por tramos, para que el monitor vea el avance
+        for (long long done = 0; done < total_points; ) {
+            long long step = total_points - done < MC_PROGRESS_POINTS ? total_points - done
+                                                                      : MC_PROGRESS_POINTS;
+            count += mc_count_stream(&st, done, step);
+            done += step;
+            mc_atomic_store_relaxed(&progress.hits, count);
+            mc_atomic_store_relaxed(&progress.points, done);
+        }
+    }
+    MC_PROF(mc_prof_kernel_end(&perf, &prof, total_points));
+    
+    double elapsed = mc_now() - start;
+    mc_monitor_stop(&monitor);
+    MC_PROF(mc_perf_close(&perf));
+    MC_PROF(if (!g_quiet) mc_prof_report("SERIAL", &prof, 1, start, start + elapsed, 0.0));
+    
+    run.pi = mc_estimate_pi(&params, count, total_points);
+    run.hits = count;
+    run.points = total_points;
+    run.elapsed = elapsed;
+    
+    if (!g_quiet) {
+        printf("Tiempo SERIAL: %.6f segundos\n", elapsed);
+        printf("Puntos dentro/cruces: %lld de %lld\n", count, total_points);
+    }
+    
+    return run;
+}
+
+// ==================== MODO ADAPTATIVO ====================
+// En lugar de fijar el numero de puntos se pide un error absoluto objetivo y
+// un nivel de confianza. El trabajo avanza por rondas sobre el mismo flujo
+// global [0, n) que usan las otras versiones: los hilos del pool publican sus
+// conteos parciales y, tras cada ronda, el coordinador recalcula el intervalo
+// de confianza y decide si parar o cuantas muestras pedir. Como la decision
+// depende solo de los conteos, con la misma semilla la corrida se detiene en
+// el mismo punto y da el mismo resultado (salvo que corte el limite de tiempo).
+//
+// Cada muestra aporta X en [lo, hi], las cotas del integrando: [0, 1] en
+// Dartboard y en Needles con L <= D (conteos binomiales) y [0, ceil(L / D)]
+// con agujas largas. La varianza se toma de la cota de Bhatia-Davis
+// Var(X) <= (hi - m)(m - lo), exacta en el caso binomial y conservadora en
+// los demas, y pasa a la estimacion por el metodo delta. Con --sampling distinto de mc el
+// intervalo sigue suponiendo muestras independientes, por lo que queda mas
+// ancho que el error real y la corrida se detiene tarde, nunca temprano.
+#define MC_ADAPT_FIRST_ROUND (1 << 18)
+#define MC_ADAPT_MIN_ROUND MC_BLOCK_POINTS
+#define MC_ADAPT_MIN_HITS 100
+#define MC_ADAPT_MAX_GROWTH 16
+
+enum { MC_STOP_TARGET = 0, MC_STOP_POINTS, MC_STOP_TIME };
+static const char* const mc_stop_names[] = {
+    "error objetivo alcanzado", "limite de puntos", "limite de tiempo"
+};
+
+typedef struct {
+    double pi;
+    double half_width;   // semiancho del intervalo de confianza
+    long long hits;
+    long long points;
+    int rounds;
+    int reason;
+    double elapsed;
+} mc_adaptive_result_t;
+
+// Semiancho del intervalo con cuantil z; infinito hasta juntar MC_ADAPT_MIN_HITS aciertos
+double mc_half_width(const mc_params_t* p, long long hits, long long points, double z) {
+    if (hits < MC_ADAPT_MIN_HITS || points <= 0) return HUGE_VAL;
+    return z * mc_pi_sigma(p, hits, points) / sqrt((double)points);
+}
+
+// Muestras de la ronda siguiente: las que faltan segun la varianza actual
+// (+5%); el total crece a lo sumo MC_ADAPT_MAX_GROWTH veces por ronda
+long long mc_adapt_next_round(const mc_params_t* p, long long hits, long long points,
+                              double target_error, double z) {
+    long long round = points;
+    if (hits >= MC_ADAPT_MIN_HITS) {
+        double sigma = mc_pi_sigma(p, hits, points);
+        double needed = (z * sigma / target_error) * (z * sigma / target_error) * 1.05;
+        round = points * (MC_ADAPT_MAX_GROWTH - 1);
+        if (needed - points < (double)round) round = (long long)ceil(needed) - points;
+    }
+    if (round < MC_ADAPT_MIN_ROUND) round = MC_ADAPT_MIN_ROUND;
+    return round;
+}
+
+// max_points <= 0 y max_seconds <= 0 significan sin limite
+mc_adaptive_result_t adaptive_monte_carlo(int method, int num_threads, double target_error,
+                                          double confidence, long long max_points,
+                                          double max_seconds) {
+    mc_params_t params = mc_make_params(method);
+    mc_adaptive_result_t res;
+    double z = mc_normal_quantile(confidence);
+    long long round = MC_ADAPT_FIRST_ROUND;
+
+    memset(&res, 0, sizeof(res));
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MC_MAX_POOL) num_threads = MC_MAX_POOL;
+    if (max_points <= 0) max_points = 1ll << 60;
+
+    printf("\n=== INICIANDO MODO ADAPTATIVO (%d hilos, error %.2e al %.2f%%) ===\n",
+           num_threads, target_error, confidence * 100.0);
+
+    mc_pool_ensure(num_threads);
+    double start = mc_now();
+
+    for (;;) {
+        mc_pool_job_t job;
+        long long round_hits = 0, round_points = 0;
+
+        if (round > max_points - res.points) round = max_points - res.points;
+        mc_pool_job_init(&job, &params, res.points, round, num_threads);
+        if (max_seconds > 0) job.deadline = start + max_seconds;
+        mc_pool_execute(&job);
+        for (int i = 0; i < num_threads; i++) {
+            round_hits += job.slots[i].hits;
+            round_points += job.slots[i].points;
+        }
+        mc_pool_job_free(&job);
+
+        res.hits += round_hits;
+        res.points += round_points;
+        res.rounds++;
+        res.pi = mc_estimate_pi(&params, res.hits, res.points);
+        res.half_width = mc_half_width(&params, res.hits, res.points, z);
+        printf("Ronda %d: %lld puntos, pi = %.10f +- %.2e\n",
+               res.rounds, res.points, res.pi, res.half_width);
+
+        if (res.half_width <= target_error) {
+            res.reason = MC_STOP_TARGET;
+            break;
+        }
+        if (res.points >= max_points) {
+            res.reason = MC_STOP_POINTS;
+            break;
+        }
+        if (round_points < round || (max_seconds > 0 && mc_now() - start >= max_seconds)) {
+            res.reason = MC_STOP_TIME;
+            break;
+        }
+        round = mc_adapt_next_round(&params, res.hits, res.points, target_error, z);
+    }
+
+    res.elapsed = mc_now() - start;
+    printf("Tiempo ADAPTATIVO: %.6f segundos (%d rondas, %s)\n",
+           res.elapsed, res.rounds, mc_stop_names[res.reason]);
+    printf("Puntos dentro/cruces: %lld de %lld\n", res.hits, res.points);
+
+    return res;
+}
+
+// ==================== FUNCIONES AUXILIARES ====================
+void print_results(double computed_pi, double actual_pi, long long iterations, 
+                  double time_taken, const char* method) {
+    double error = fabs(computed_pi - actual_pi);
+    double relative_error = (error / actual_pi) * 100;
+    
+    printf("\n=== RESULTADOS %s ===\n", method);
+    printf("Pi calculado:  %.10f\n", computed_pi);
+    printf("Pi real:       %.10f\n", actual_pi);
+    printf("Error absoluto: %.2e\n", error);
+    printf("Error relativo: %.6f%%\n", relative_error);
+    printf("Iteraciones:   %lld\n", iterations);
+    printf("Tiempo:        %.6f segundos\n", time_taken);
+    if (time_taken > 0) {
+        printf("Iteraciones/segundo: %.0f\n", iterations / time_taken);
+    }
+    printf("===================================\n");
+}
+
+void benchmark_method(long long points, int method, const char* method_name) {
+    const double ACTUAL_PI = 3.14159265358979323846;
+    
+    printf("\n\n**************************************************");
+    printf("\n* BENCHMARK: %s", method_name);
+    printf("\n**************************************************");
+    
+    // Serial (cada motor mide solo su computo)
+    mc_run_t serial = serial_monte_carlo(points, method);
+    double time_serial = serial.elapsed;
+    
+    print_results(serial.pi, ACTUAL_PI, points, time_serial, "SERIAL");
+    
+    // Threads (2, 4, 8): el pool se crea una vez y se reutiliza en las tres corridas
+    int thread_counts[] = {2, 4, 8};
+    mc_pool_ensure(8);
+    for (int i = 0; i < 3; i++) {
+        mc_run_t threads = parallel_threads_monte_carlo(points, thread_counts[i], method);
+        double time_threads = threads.elapsed;
+        
+        const char* labels[3] = {"2 THREADS", "4 THREADS", "8 THREADS"};
+        print_results(threads.pi, ACTUAL_PI, points, time_threads, labels[i]);
+        printf("Speedup: %.2fx\n", time_serial / time_threads);
+    }
+    
+    // Procesos (2, 4)
+    int process_counts[] = {2, 4};
+    for (int i = 0; i < 2; i++) {
+        mc_run_t processes = parallel_processes_monte_carlo(points, process_counts[i], method);
+        double time_processes = processes.elapsed;
+        
+        const char* plabels[2] = {"2 PROCESOS", "4 PROCESOS"};
+        print_results(processes.pi, ACTUAL_PI, processes.points, time_processes, plabels[i]);
+        printf("Speedup: %.2fx\n", time_serial / time_processes);
+    }
+}
+
+// ==================== BENCHMARK NO INTERACTIVO ====================
+// programa bench [opciones]: barre metodos, modos, cantidad de workers y
+// tamanos de muestra sin pasar por el menu. En modo hybrid cada cantidad de
+// workers W se prueba con todos los repartos P procesos x T hilos (P * T = W)
+// y al final se imprime la grilla en stderr. Cada configuracion se corre
+// 'warmup' veces sin medir y luego 'reps' veces; el tiempo de cada repeticion
+// es el que mide el propio motor, con la salida por consola desactivada. El
+// informe (JSON o CSV) va a stdout o a --output y el progreso a stderr, entre
+// una configuracion y la siguiente.
+//
+// Escalado fuerte: los mismos puntos totales con mas workers; eficiencia =
+// speedup * workers_base / workers. Escalado debil: --points es la carga por
+// worker; eficiencia = T_base / T. La base es la corrida serial con los
+// mismos puntos (o por worker) o, si no se midio, la de menos workers del
+// mismo modo.
+#define MC_BENCH_MAX_LIST 64
+
+enum { MC_MODE_SERIAL = 0, MC_MODE_THREADS, MC_MODE_PROCESSES, MC_MODE_HYBRID, MC_MODE_COUNT };
+static const char* const mc_mode_names[] = { "serial", "threads", "processes", "hybrid" };
+
+typedef struct {
+    int methods[MC_METHOD_COUNT];
+    int num_methods;
+    int modes[MC_MODE_COUNT];
+    int num_modes;
+    int workers[MC_BENCH_MAX_LIST];
+    int num_workers;
+    long long points[MC_BENCH_MAX_LIST];
+    int num_points;
+    int reps;
+    int warmup;
+    int weak;
+    int csv;
+    const char* output;
+} mc_bench_config_t;
+
+typedef struct {
+    int method;
+    int mode;
+    int workers;                  // procesos x hilos por proceso
+    int processes;
+    int threads;                  // hilos por proceso
+    long long points;             // puntos totales de cada repeticion
+    long long points_per_worker;
+    double median, p95, mean, stddev, min;
+    double pi;
+    long long hits;
+    double speedup;               // respecto de la base (0 = sin base)
+    double efficiency;
+    int precision;                // la que uso el metodo (double si no tiene kernel)
+} mc_bench_row_t;
+
+static int mc_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int mc_compare_int(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Lista separada por comas; "max" vale 'max_value'. Devuelve la cantidad o -1
+static int mc_parse_list(const char* text, long long* out, int max_items, long long max_value) {
+    char buf[1024];
+    int n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", text);
+    for (char* tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        char* end;
+        double value;
+        if (n >= max_items) return -1;
+        if (strcmp(tok, "max") == 0) {
+            value = (double)max_value;
+        } else {
+            value = strtod(tok, &end);   // admite 1e8
+            if (*end != '\0' || value < 1.0 || value != floor(value) || value > 9e18) return -1;
+        }
+        out[n++] = (long long)value;
+    }
+    return n > 0 ? n : -1;
+}
+
+static int mc_bench_name_list(const char* text, const char* const* names, int count,
+                              int first, int* out, int max_items) {
+    char buf[256];
+    int n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", text);
+    for (char* tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int found = -1;
+        for (int k = first; k < count; k++) {
+            if (strcmp(tok, names[k]) == 0) found = k;
+        }
+        if (found < 0 || n >= max_items) return -1;
+        out[n++] = found;
+    }
+    return n > 0 ? n : -1;
+}
+
+// En modo hibrido 'workers' son los procesos y 'team' los hilos de cada uno
+static mc_run_t mc_bench_once(int mode, int method, int workers, int team, long long points) {
+    switch (mode) {
+        case MC_MODE_SERIAL:
+            return serial_monte_carlo(points, method);
+        case MC_MODE_THREADS:
+            return parallel_threads_monte_carlo(points, workers, method);
+        case MC_MODE_HYBRID:
+            return parallel_hybrid_monte_carlo(points, workers, team, method);
+        default:
+            return parallel_processes_monte_carlo(points, workers, method);
+    }
+}
+
+static void mc_bench_measure(const mc_bench_config_t* cfg, mc_bench_row_t* row, double* times) {
+    mc_run_t run;
+
+    int workers = row->mode == MC_MODE_HYBRID ? row->processes : row->workers;
+
+    for (int r = 0; r < cfg->warmup; r++) {
+        mc_bench_once(row->mode, row->method, workers, row->threads, row->points);
+    }
+    for (int r = 0; r < cfg->reps; r++) {
+        run = mc_bench_once(row->mode, row->method, workers, row->threads, row->points);
+        times[r] = run.elapsed;
+    }
+
+    double sum = 0.0, sq = 0.0;
+    for (int r = 0; r < cfg->reps; r++) sum += times[r];
+    row->mean = sum / cfg->reps;
+    for (int r = 0; r < cfg->reps; r++) sq += (times[r] - row->mean) * (times[r] - row->mean);
+    row->stddev = cfg->reps > 1 ? sqrt(sq / (cfg->reps - 1)) : 0.0;
+
+    qsort(times, cfg->reps, sizeof(double), mc_compare_double);
+    row->min = times[0];
+    row->median = cfg->reps % 2 ? times[cfg->reps / 2]
+                                : 0.5 * (times[cfg->reps / 2 - 1] + times[cfg->reps / 2]);
+    row->p95 = times[(int)ceil(0.95 * cfg->reps) - 1];   // rango mas cercano
+    row->pi = run.pi;
+    row->hits = run.hits;
+    mc_params_t params = mc_make_params(row->method);
+    row->precision = mc_effective_precision(&params);
+}
+
+static void mc_bench_scaling(const mc_bench_config_t* cfg, mc_bench_row_t* rows, int n) {
+    for (int i = 0; i < n; i++) {
+        mc_bench_row_t* base = NULL;
+        for (int j = 0; j < n; j++) {
+            mc_bench_row_t* c = &rows[j];
+            if (c->method != rows[i].method) continue;
+            if (cfg->weak ? c->points_per_worker != rows[i].points_per_worker
+                          : c->points != rows[i].points) continue;
+            if (c->mode == MC_MODE_SERIAL) {
+                base = c;
+                break;
+            }
+            if (c->mode == rows[i].mode && (base == NULL || c->workers < base->workers)) base = c;
+        }
+        if (base == NULL || rows[i].median <= 0.0) continue;
+        if (cfg->weak) {
+            rows[i].efficiency = base->median / rows[i].median;
+            rows[i].speedup = rows[i].efficiency * rows[i].workers / base->workers;
+        } else {
+            rows[i].speedup = base->median / rows[i].median;
+            rows[i].efficiency = rows[i].speedup * base->workers / rows[i].workers;
+        }
+    }
+}
+
+// Grilla procesos x hilos del modo hibrido por metodo y puntos, en stderr:
+// mediana de cada reparto y '*' en el mejor de cada cantidad de workers
+static void mc_bench_grid(const mc_bench_row_t* rows, int n) {
+    for (int i = 0; i < n; i++) {
+        const mc_bench_row_t* g = &rows[i];
+        int procs[MC_BENCH_MAX_LIST], threads[MC_BENCH_MAX_LIST];
+        int num_procs = 0, num_threads = 0, first = 1;
+
+        if (g->mode != MC_MODE_HYBRID) continue;
+        // Una grilla por (metodo, puntos), cuando aparece su primera fila
+        for (int j = 0; j < i && first; j++) {
+            first = !(rows[j].mode == MC_MODE_HYBRID && rows[j].method == g->method &&
+                      rows[j].points == g->points);
+        }
+        if (!first) continue;
+        for (int j = i; j < n; j++) {
+            const mc_bench_row_t* r = &rows[j];
+            int k;
+            if (r->mode != MC_MODE_HYBRID || r->method != g->method || r->points != g->points) continue;
+            for (k = 0; k < num_procs && procs[k] != r->processes; k++) {}
+            if (k == num_procs && num_procs < MC_BENCH_MAX_LIST) procs[num_procs++] = r->processes;
+            for (k = 0; k < num_threads && threads[k] != r->threads; k++) {}
+            if (k == num_threads && num_threads < MC_BENCH_MAX_LIST) threads[num_threads++] = r->threads;
+        }
+        qsort(procs, num_procs, sizeof(int), mc_compare_int);
+        qsort(threads, num_threads, sizeof(int), mc_compare_int);
+
+        fprintf(stderr, "\n[bench] hibrido %s, %lld puntos: mediana en s por procesos x hilos "
+                        "(* = mejor reparto de esos workers)\n", mc_method_names[g->method], g->points);
+        fprintf(stderr, "%10s", "proc\\hilos");
+        for (int b = 0; b < num_threads; b++) fprintf(stderr, " %11d", threads[b]);
+        fprintf(stderr, "\n");
+        for (int a = 0; a < num_procs; a++) {
+            fprintf(stderr, "%10d", procs[a]);
+            for (int b = 0; b < num_threads; b++) {
+                const mc_bench_row_t* cell = NULL;
+                int best = 1;
+                for (int j = i; j < n; j++) {
+                    const mc_bench_row_t* r = &rows[j];
+                    if (r->mode != MC_MODE_HYBRID || r->method != g->method || r->points != g->points) continue;
+                    if (r->processes == procs[a] && r->threads == threads[b]) cell = r;
+                }
+                if (cell == NULL) {
+                    fprintf(stderr, " %11s", "-");
+                    continue;
+                }
+                for (int j = i; j < n; j++) {
+                    const mc_bench_row_t* r = &rows[j];
+                    if (r->mode == MC_MODE_HYBRID && r->method == g->method && r->points == g->points &&
+                        r->workers == cell->workers && r->median < cell->median) best = 0;
+                }
+                fprintf(stderr, " %10.6f%c", cell->median, best ? '*' : ' ');
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+static void mc_bench_write(FILE* out, const mc_bench_config_t* cfg, const mc_bench_row_t* rows, int n) {
+    const double ACTUAL_PI = 3.14159265358979323846;
+
+    if (cfg->csv) {
+        fprintf(out, "method,mode,workers,points,points_per_worker,reps,median_s,p95_s,mean_s,"
+                     "stddev_s,min_s,throughput,speedup,efficiency,pi,abs_error,isa,rng,sampling,seed,"
+                     "placement,precision,processes,threads_per_process\n");
+        for (int i = 0; i < n; i++) {
+            const mc_bench_row_t* r = &rows[i];
+            fprintf(out, "%s,%s,%d,%lld,%lld,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.1f,%.4f,%.4f,%.12f,%.3e,%s,%s,%s,%llu,%s,%s,%d,%d\n",
+                    mc_method_names[r->method], mc_mode_names[r->mode], r->workers, r->points,
+                    r->points_per_worker, cfg->reps, r->median, r->p95, r->mean, r->stddev, r->min,
+                    r->points / r->median, r->speedup, r->efficiency, r->pi,
+                    fabs(r->pi - ACTUAL_PI), mc_isa_names[g_isa], mc_rng_names[g_rng],
+                    mc_sampling_names[g_sampling], g_seed, mc_placement_names[g_placement],
+                    mc_precision_names[r->precision], r->processes, r->threads);
+        }
+        return;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"platform\": \"%s\",\n", MC_PLATFORM_NAME);
+    fprintf(out, "  \"isa\": \"%s\",\n", mc_isa_names[g_isa]);
+    fprintf(out, "  \"cpus\": %d,\n", mc_cpu_count());
+    fprintf(out, "  \"cores\": %d,\n", mc_topology()->cores);
+    fprintf(out, "  \"numa_nodes\": %d,\n", mc_topology()->nodes);
+    fprintf(out, "  \"placement\": \"%s\",\n", mc_placement_names[g_placement]);
+    fprintf(out, "  \"rng\": \"%s\",\n", mc_rng_names[g_rng]);
+    fprintf(out, "  \"sampling\": \"%s\",\n", mc_sampling_names[g_sampling]);
+    fprintf(out, "  \"precision\": \"%s\",\n", mc_precision_names[g_precision]);
+    fprintf(out, "  \"seed\": %llu,\n", g_seed);
+    fprintf(out, "  \"needle_length\": %g,\n", g_needle_length);
+    fprintf(out, "  \"line_spacing\": %g,\n", g_line_spacing);
+    fprintf(out, "  \"scaling\": \"%s\",\n", cfg->weak ? "weak" : "strong");
+    fprintf(out, "  \"warmup\": %d,\n", cfg->warmup);
+    fprintf(out, "  \"reps\": %d,\n", cfg->reps);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < n; i++) {
+        const mc_bench_row_t* r = &rows[i];
+        fprintf(out, "    {\"method\": \"%s\", \"mode\": \"%s\", \"workers\": %d, "
+                     "\"processes\": %d, \"threads_per_process\": %d, "
+                     "\"points\": %lld, \"points_per_worker\": %lld, "
+                     "\"median_s\": %.9f, \"p95_s\": %.9f, \"mean_s\": %.9f, "
+                     "\"stddev_s\": %.9f, \"min_s\": %.9f, \"throughput\": %.1f, "
+                     "\"speedup\": %.4f, \"efficiency\": %.4f, \"pi\": %.12f, "
+                     "\"abs_error\": %.3e, \"precision\": \"%s\"}%s\n",
+                mc_method_names[r->method], mc_mode_names[r->mode], r->workers, r->processes,
+                r->threads, r->points, r->points_per_worker, r->median, r->p95, r->mean, r->stddev,
+                r->min, r->points / r->median, r->speedup, r->efficiency, r->pi,
+                fabs(r->pi - ACTUAL_PI), mc_precision_names[r->precision], i + 1 < n ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void mc_bench_usage(void) {
+    fprintf(stderr,
+            "Uso: programa bench [--methods dartboard,needles,ball3,ball4,arctan]\n"
+            "                    [--modes serial,threads,processes,hybrid]\n"
+            "                    [--workers 1,2,4,max] [--points 1e7,1e8] [--reps N] [--warmup N]\n"
+            "                    [--scaling strong|weak] [--format json|csv] [--output archivo]\n"
+            "                    [--seed N] [--rng philox|xoshiro|lcg]\n"
+            "                    [--needle-length L] [--line-spacing D]\n"
+            "                    [--sampling mc|sobol|halton|stratified|lhs|antithetic]\n"
+            "                    [--precision double|float|int]\n"
+            "                    [--placement none|compact|scatter|core] [--progress S]\n");
+}
+
+int run_benchmark_suite(int argc, char* argv[]) {
+    mc_bench_config_t cfg;
+    long long list[MC_BENCH_MAX_LIST];
+    int cpus = mc_cpu_count();
+
+    // Valores por omision: ambos metodos, serial, threads y procesos (el
+    // hibrido se pide), potencias de dos hasta el numero de procesadores,
+    // 10^7 puntos, 1 + 5 repeticiones
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.methods[0] = 1;
+    cfg.methods[1] = 2;
+    cfg.num_methods = 2;
+    for (int m = MC_MODE_SERIAL; m <= MC_MODE_PROCESSES; m++) cfg.modes[cfg.num_modes++] = m;
+    for (int w = 1; w < cpus && cfg.num_workers < MC_BENCH_MAX_LIST - 1; w *= 2) {
+        cfg.workers[cfg.num_workers++] = w;
+    }
+    cfg.workers[cfg.num_workers++] = cpus;
+    cfg.points[0] = 10000000;
+    cfg.num_points = 1;
+    cfg.reps = 5;
+    cfg.warmup = 1;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int n = 0;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--methods") == 0) {
+            n = cfg.num_methods = mc_bench_name_list(value, mc_method_names, MC_METHOD_COUNT, 1,
+                                                     cfg.methods, MC_METHOD_COUNT - 1);
+        } else if (strcmp(name, "--modes") == 0) {
+            n = cfg.num_modes = mc_bench_name_list(value, mc_mode_names, MC_MODE_COUNT, 0,
+                                                   cfg.modes, MC_MODE_COUNT);
+        } else if (strcmp(name, "--workers") == 0) {
+            n = mc_parse_list(value, list, MC_BENCH_MAX_LIST, cpus);
+            cfg.num_workers = 0;
+            for (int k = 0; k < n; k++) {
+                int seen = 0;
+                if (list[k] > MC_MAX_POOL) n = -1;
+                for (int j = 0; j < cfg.num_workers && n > 0; j++) seen |= cfg.workers[j] == list[k];
+                if (n > 0 && !seen) cfg.workers[cfg.num_workers++] = (int)list[k];
+            }
+        } else if (strcmp(name, "--points") == 0) {
+            n = cfg.num_points = mc_parse_list(value, cfg.points, MC_BENCH_MAX_LIST, 0);
+        } else if (strcmp(name, "--reps") == 0) {
+            n = cfg.reps = atoi(value);
+        } else if (strcmp(name, "--warmup") == 0) {
+            cfg.warmup = atoi(value);
+            n = cfg.warmup >= 0 ? 1 : -1;
+        } else if (strcmp(name, "--scaling") == 0) {
+            cfg.weak = strcmp(value, "weak") == 0;
+            n = cfg.weak || strcmp(value, "strong") == 0 ? 1 : -1;
+        } else if (strcmp(name, "--format") == 0) {
+            cfg.csv = strcmp(value, "csv") == 0;
+            n = cfg.csv || strcmp(value, "json") == 0 ? 1 : -1;
+        } else if (strcmp(name, "--output") == 0) {
+            cfg.output = value;
+            n = 1;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_bench_usage();
+                return 1;
+            }
+            n = 1;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_bench_usage();
+            return 1;
+        }
+    }
+
+    // El hibrido prueba cada reparto procesos x hilos de cada cantidad de workers
+    int splits = 0;
+    for (int c = 0; c < cfg.num_workers; c++) {
+        for (int t = 1; t <= cfg.workers[c]; t++) splits += cfg.workers[c] % t == 0;
+    }
+    int max_rows = cfg.num_methods * cfg.num_modes * (cfg.num_workers + splits) * cfg.num_points;
+    mc_bench_row_t* rows = (mc_bench_row_t*)calloc(max_rows, sizeof(mc_bench_row_t));
+    double* times = (double*)malloc(sizeof(double) * cfg.reps);
+    int num_rows = 0;
+    int max_workers = 1;
+    if (rows == NULL || times == NULL) {
+        fprintf(stderr, "Sin memoria para el benchmark\n");
+        return 1;
+    }
+    for (int k = 0; k < cfg.num_workers; k++) {
+        if (cfg.workers[k] > max_workers) max_workers = cfg.workers[k];
+    }
+    // Con --replay, antes de medir nada: el tamano mas grande de cada metodo
+    for (int a = 0; a < cfg.num_methods; a++) {
+        for (int d = 0; d < cfg.num_points; d++) {
+            long long need = cfg.weak ? cfg.points[d] * max_workers : cfg.points[d];
+            if (mc_replay_fits(cfg.methods[a], need) != 0) {
+                free(rows);
+                free(times);
+                return 1;
+            }
+        }
+    }
+
+    // El pool se crea antes de medir; los motores no escriben en consola
+    mc_pool_ensure(max_workers);
+    g_quiet = 1;
+
+    for (int a = 0; a < cfg.num_methods; a++) {
+        for (int b = 0; b < cfg.num_modes; b++) {
+            int mode = cfg.modes[b];
+            for (int c = 0; c < cfg.num_workers; c++) {
+                int workers = mode == MC_MODE_SERIAL ? 1 : cfg.workers[c];
+                if (mode == MC_MODE_SERIAL && c > 0) break;
+                for (int t = 1; t <= workers; t++) {
+                    // Hilos por proceso: los divisores de 'workers' en modo hibrido
+                    int threads = mode == MC_MODE_HYBRID ? t : mode == MC_MODE_THREADS ? workers : 1;
+                    int processes = mode == MC_MODE_THREADS ? 1 : workers / threads;
+                    if (mode != MC_MODE_HYBRID && t > 1) break;
+                    if (workers % threads != 0 || processes > MAX_PROCESSES) continue;
+                    for (int d = 0; d < cfg.num_points; d++) {
+                        mc_bench_row_t* row = &rows[num_rows++];
+                        row->method = cfg.methods[a];
+                        row->mode = mode;
+                        row->workers = workers;
+                        row->processes = processes;
+                        row->threads = threads;
+                        row->points_per_worker = cfg.weak ? cfg.points[d] : cfg.points[d] / workers;
+                        row->points = cfg.weak ? cfg.points[d] * workers : cfg.points[d];
+
+                        mc_bench_measure(&cfg, row, times);
+                        fprintf(stderr, "[bench] %s %s %dx%d, %lld puntos: mediana %.6f s\n",
+                                mc_method_names[row->method], mc_mode_names[mode], processes,
+                                threads, row->points, row->median);
+                    }
+                }
+            }
+        }
+    }
+    g_quiet = 0;
+
+    mc_bench_scaling(&cfg, rows, num_rows);
+    mc_bench_grid(rows, num_rows);
+
+    FILE* out = stdout;
+    if (cfg.output != NULL) {
+        out = fopen(cfg.output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "No se pudo abrir %s\n", cfg.output);
+            return 1;
+        }
+    }
+    mc_bench_write(out, &cfg, rows, num_rows);
+    if (out != stdout) fclose(out);
+
+    free(rows);
+    free(times);
+    return 0;
+}
+
+// ==================== MICROBENCHMARKS (programa micro) ====================
+// Mide los bloques por separado, sin pools, procesos ni reparto: cada
+// generador y cada variante de kernel (escalar y SIMD, double, float e int)
+// sobre lotes de tamano fijo, en un solo hilo fijado a un procesador. Para
+// cada caso informa ns/muestra, muestras por ciclo (del contador de tiempo
+// de la CPU, TSC en x86) y millones de muestras por segundo.
+//
+// Ademas verifica que todas las variantes de un kernel den la misma cuenta
+// que la escalar sobre el mismo lote y, por integrando y precision, que el
+// estimador no tenga sesgo visible: con K semillas de N muestras el desvio
+// de pi debe quedar dentro de MC_MICRO_MAX_Z desviaciones estandar.
+//
+// --save-baseline guarda los ns/muestra en un archivo de texto (una linea
+// "caso ns" por caso); --baseline compara contra ese archivo y falla (codigo
+// de salida 1) si algun caso es mas lento que la base en mas de --threshold.
+#define MC_MICRO_MAX_CASES 256
+#define MC_MICRO_MAX_BATCHES 8
+#define MC_MICRO_MAX_BATCH 65536
+#define MC_MICRO_TRIALS 5
+#define MC_MICRO_MAX_Z 5.0
+
+static const char* const mc_micro_isa[] = { "scalar", "sse2", "avx2", "avx512" };
+
+typedef struct {
+    char name[64];
+    int batch;
+    double ns;             // ns por muestra (mejor de MC_MICRO_TRIALS)
+    double per_cycle;      // muestras por ciclo (0 = sin contador)
+    double base_ns;        // de la base (0 = sin base)
+} mc_micro_case_t;
+
+typedef struct {
+    double seconds;        // tiempo de medicion por caso
+    const char* filter;    // solo los casos que contienen este texto
+    int batches[MC_MICRO_MAX_BATCHES];
+    int num_batches;
+    long long bias_points;
+    int bias_seeds;
+    mc_micro_case_t cases[MC_MICRO_MAX_CASES];
+    int num_cases;
+    int failures;
+} mc_micro_t;
+
+// Lotes de entrada: MC_MAX_DIMS columnas de uniformes y de palabras crudas
+typedef struct {
+    double* u[MC_MAX_DIMS];
+    unsigned int* w[MC_MAX_DIMS];
+    mc_params_t params;
+    mc_stream_t stream;
+    int kind;              // que mide mc_micro_call
+    int isa;
+    int method;
+    volatile long long sink;
+} mc_micro_input_t;
+
+enum {
+    MC_MICRO_RAND_WIN = 0, MC_MICRO_RAND_DOUBLE_WIN, MC_MICRO_PHILOX, MC_MICRO_PHILOX_RAW,
+    MC_MICRO_STREAM, MC_MICRO_STREAM_RAW, MC_MICRO_KERNEL, MC_MICRO_KERNEL_F32,
+    MC_MICRO_KERNEL_INT
+};
+
+// Ciclos de referencia de la CPU (0 si la plataforma no tiene contador)
+static inline unsigned long long mc_cycles(void) {
+#if defined(MC_HAVE_X86) && defined(_MSC_VER)
+    return __rdtsc();
+#elif defined(MC_HAVE_X86)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static const philox_fill_fn mc_philox_fills[MC_ISA_COUNT] = MC_ISA_KERNELS(philox_fill);
+static const philox_raw_fn mc_philox_raws[MC_ISA_COUNT] = MC_ISA_KERNELS(philox_raw);
+
+// Una llamada del caso sobre n muestras; el resultado va a 'sink' para que
+// el compilador no la elimine
+static void mc_micro_call(mc_micro_input_t* in, int n, long long first) {
+    const mc_integrand_t* it = &mc_integrands[in->method];
+    long long acc = 0;
+
+    switch (in->kind) {
+        case MC_MICRO_RAND_WIN: {
+            unsigned int seed = (unsigned int)first;
+            for (int k = 0; k < 2 * n; k++) acc += rand_win(&seed);
+            break;
+        }
+        case MC_MICRO_RAND_DOUBLE_WIN: {
+            unsigned int seed = (unsigned int)first;
+            double sum = 0.0;
+            for (int k = 0; k < 2 * n; k++) sum += rand_double_win(&seed);
+            acc = (long long)sum;
+            break;
+        }
+        case MC_MICRO_PHILOX:
+            mc_philox_fills[in->isa](in->params.seed, 0, first, n, in->u[0], in->u[1]);
+            acc = (long long)in->u[0][n - 1];
+            break;
+        case MC_MICRO_PHILOX_RAW:
+            mc_philox_raws[in->isa](in->params.seed, 0, first, n, in->w[0], in->w[1]);
+            acc = in->w[0][n - 1];
+            break;
+        case MC_MICRO_STREAM:
+        case MC_MICRO_STREAM_RAW:
+            // El cursor sigue de largo: mide la generacion, no los saltos
+            for (int k = 0; k < n; k += MC_BATCH) {
+                int m = n - k < MC_BATCH ? n - k : MC_BATCH;
+                if (in->kind == MC_MICRO_STREAM) {
+                    mc_rng_fill(&in->stream, in->stream.next, m, in->u);
+                } else {
+                    mc_rng_fill_raw(&in->stream, in->stream.next, m, in->w);
+                }
+            }
+            acc = in->w[0][0];
+            break;
+        case MC_MICRO_KERNEL:
+            acc = it->kernels[in->isa](in->u, n, &in->params);
+            break;
+        case MC_MICRO_KERNEL_F32:
+            acc = it->kernels_f32[in->isa](in->w, n, &in->params);
+            break;
+        default:
+            acc = it->kernels_int[in->isa](in->w, n, &in->params);
+            break;
+    }
+    in->sink += acc;
+}
+
+static int mc_micro_selected(const mc_micro_t* mb, const char* name) {
+    return mb->filter == NULL || strstr(name, mb->filter) != NULL;
+}
+
+// Mide el caso con cada tamano de lote: calentamiento y MC_MICRO_TRIALS
+// tandas, de las que se queda con la mas rapida
+static void mc_micro_measure(mc_micro_t* mb, mc_micro_input_t* in, const char* name) {
+    if (!mc_micro_selected(mb, name)) return;
+    for (int b = 0; b < mb->num_batches && mb->num_cases < MC_MICRO_MAX_CASES; b++) {
+        int n = mb->batches[b];
+        long long first = 0;
+        double best_ns = HUGE_VAL, best_cycle = 0.0;
+        double until = mc_now() + 0.1 * mb->seconds;
+
+        while (mc_now() < until) mc_micro_call(in, n, first += n);
+        for (int t = 0; t < MC_MICRO_TRIALS; t++) {
+            long long calls = 0;
+            double start = mc_now(), elapsed;
+            unsigned long long c0 = mc_cycles();
+            do {
+                for (int r = 0; r < 16; r++) mc_micro_call(in, n, first += n);
+                calls += 16;
+                elapsed = mc_now() - start;
+            } while (elapsed < mb->seconds / MC_MICRO_TRIALS);
+            unsigned long long cycles = mc_cycles() - c0;
+            double samples = (double)calls * n;
+            if (elapsed * 1e9 / samples < best_ns) {
+                best_ns = elapsed * 1e9 / samples;
+                best_cycle = cycles > 0 ? samples / (double)cycles : 0.0;
+            }
+        }
+
+        mc_micro_case_t* c = &mb->cases[mb->num_cases++];
+        snprintf(c->name, sizeof(c->name), "%s", name);
+        c->batch = n;
+        c->ns = best_ns;
+        c->per_cycle = best_cycle;
+        fprintf(stderr, "[micro] %-32s lote %6d: %8.3f ns/muestra\n", name, n, best_ns);
+    }
+}
+
+// Todas las variantes de un kernel cuentan lo mismo que la escalar
+static void mc_micro_check_variants(mc_micro_t* mb, mc_micro_input_t* in, const char* name) {
+    int isa = in->isa;
+    long long expected, got;
+
+    in->isa = MC_ISA_SCALAR;
+    in->sink = 0;
+    mc_micro_call(in, MC_BATCH, 0);
+    expected = in->sink;
+    in->isa = isa;
+    in->sink = 0;
+    mc_micro_call(in, MC_BATCH, 0);
+    got = in->sink;
+    if (got != expected) {
+        fprintf(stderr, "[micro] FALLA %s: cuenta %lld, la escalar %lld\n", name, got, expected);
+        mb->failures++;
+    }
+}
+
+static void mc_micro_run(mc_micro_t* mb) {
+    mc_micro_input_t in;
+    int best = mc_detect_isa();
+    char name[64];
+
+    memset(&in, 0, sizeof(in));
+    for (int d = 0; d < MC_MAX_DIMS; d++) {
+        in.u[d] = (double*)mc_aligned_alloc(sizeof(double) * MC_MICRO_MAX_BATCH, MC_CACHE_LINE);
+        in.w[d] = (unsigned int*)mc_aligned_alloc(sizeof(unsigned int) * MC_MICRO_MAX_BATCH,
+                                                  MC_CACHE_LINE);
+        if (in.u[d] == NULL || in.w[d] == NULL) {
+            fprintf(stderr, "Sin memoria para los lotes\n");
+            exit(1);
+        }
+    }
+
+    // Generadores: dos coordenadas por muestra, como Dartboard y Needles
+    in.params = mc_make_params(MC_METHOD_DARTBOARD);
+    in.kind = MC_MICRO_RAND_WIN;
+    mc_micro_measure(mb, &in, "rng/rand_win");
+    in.kind = MC_MICRO_RAND_DOUBLE_WIN;
+    mc_micro_measure(mb, &in, "rng/rand_double_win");
+    for (int isa = 0; isa <= best; isa++) {
+        in.isa = isa;
+        in.kind = MC_MICRO_PHILOX;
+        snprintf(name, sizeof(name), "rng/philox/%s", mc_micro_isa[isa]);
+        mc_micro_measure(mb, &in, name);
+        in.kind = MC_MICRO_PHILOX_RAW;
+        snprintf(name, sizeof(name), "rng/philox_raw/%s", mc_micro_isa[isa]);
+        mc_micro_measure(mb, &in, name);
+    }
+    for (int rng = MC_RNG_XOSHIRO; rng < MC_RNG_COUNT; rng++) {
+        in.params.rng = rng;
+        mc_stream_init(&in.stream, &in.params);
+        mc_stream_seek(&in.stream, 0);
+        in.kind = MC_MICRO_STREAM;
+        snprintf(name, sizeof(name), "rng/%s", mc_rng_names[rng]);
+        mc_micro_measure(mb, &in, name);
+        in.kind = MC_MICRO_STREAM_RAW;
+        snprintf(name, sizeof(name), "rng/%s_raw", mc_rng_names[rng]);
+        mc_micro_measure(mb, &in, name);
+    }
+
+    // Kernels sobre lotes ya generados (philox), sin el generador en la medicion
+    for (int d = 0; d + 1 < MC_MAX_DIMS; d += 2) {
+        philox_fill_scalar(g_seed, (unsigned int)(d / 2), 0, MC_MICRO_MAX_BATCH, in.u[d], in.u[d + 1]);
+        philox_raw_scalar(g_seed, (unsigned int)(d / 2), 0, MC_MICRO_MAX_BATCH, in.w[d], in.w[d + 1]);
+    }
+    for (int method = 1; method < MC_METHOD_COUNT; method++) {
+        const mc_integrand_t* it = &mc_integrands[method];
+        static const int kinds[] = { MC_MICRO_KERNEL, MC_MICRO_KERNEL_F32, MC_MICRO_KERNEL_INT };
+        static const char* const suffix[] = { "", "/float", "/int" };
+        in.method = method;
+        in.params = mc_make_params(method);
+        for (int k = 0; k < 3; k++) {
+            const void* const* table = k == 0 ? (const void* const*)it->kernels
+                                     : k == 1 ? (const void* const*)it->kernels_f32
+                                              : (const void* const*)it->kernels_int;
+            for (int isa = 0; isa <= best; isa++) {
+                if (table[isa] == NULL) continue;
+                in.kind = kinds[k];
+                in.isa = isa;
+                snprintf(name, sizeof(name), "kernel/%s%s/%s", mc_method_names[method], suffix[k],
+                         mc_micro_isa[isa]);
+                if (isa > 0 && mc_micro_selected(mb, name)) mc_micro_check_variants(mb, &in, name);
+                mc_micro_measure(mb, &in, name);
+            }
+        }
+    }
+
+    for (int d = 0; d < MC_MAX_DIMS; d++) {
+        mc_aligned_free(in.u[d]);
+        mc_aligned_free(in.w[d]);
+    }
+}
+
+// Sesgo de cada estimador: K semillas de N muestras con el flujo completo
+// (generador + kernel) y la ISA activa, comparado con el error estandar
+static void mc_micro_bias(mc_micro_t* mb) {
+    double z_max = 0.0;
+
+    printf("\n%-28s %14s %14s %10s %8s\n", "estimador", "muestras", "pi", "error", "z");
+    for (int method = 1; method < MC_METHOD_COUNT; method++) {
+        for (int precision = 0; precision < MC_PREC_COUNT; precision++) {
+            mc_params_t p = mc_make_params(method);
+            long long hits = 0, points = 0;
+            char name[64];
+
+            p.sampling = MC_SAMPLING_MC;
+            p.precision = precision;
+            if (precision != MC_PREC_DOUBLE && mc_effective_precision(&p) != precision) continue;
+            snprintf(name, sizeof(name), "%s/%s", mc_method_names[method], mc_precision_names[precision]);
+            if (!mc_micro_selected(mb, name)) continue;
+            for (int s = 0; s < mb->bias_seeds; s++) {
+                p.seed = g_seed + 0x9E3779B97F4A7C15ull * (unsigned long long)(s + 1);
+                hits += mc_count_range(&p, 0, mb->bias_points);
+                points += mb->bias_points;
+            }
+            double pi = mc_estimate_pi(&p, hits, points);
+            double se = mc_pi_sigma(&p, hits, points) / sqrt((double)points);
+            double z = se > 0.0 ? (pi - 3.14159265358979323846) / se : 0.0;
+            int bad = fabs(z) > MC_MICRO_MAX_Z;
+            if (fabs(z) > z_max) z_max = fabs(z);
+            printf("%-28s %14lld %14.10f %10.2e %8.2f%s\n", name, points, pi,
+                   pi - 3.14159265358979323846, z, bad ? "  FALLA" : "");
+            mb->failures += bad;
+        }
+    }
+    printf("Mayor |z|: %.2f (limite %.1f)\n", z_max, MC_MICRO_MAX_Z);
+}
+
+static int mc_micro_save(const mc_micro_t* mb, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "No se pudo escribir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "# montecarlo micro, ISA %s: caso/lote ns_por_muestra\n", mc_isa_names[mc_detect_isa()]);
+    for (int i = 0; i < mb->num_cases; i++) {
+        fprintf(f, "%s/%d %.6f\n", mb->cases[i].name, mb->cases[i].batch, mb->cases[i].ns);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Carga la base y cuenta los casos que la empeoran en mas de 'threshold'
+static int mc_micro_compare(mc_micro_t* mb, const char* path, double threshold) {
+    FILE* f = fopen(path, "r");
+    char line[256], key[128], name[128];
+    double ns;
+    int regressions = 0;
+
+    if (f == NULL) {
+        fprintf(stderr, "No se pudo leer %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%127s %lf", key, &ns) != 2 || ns <= 0.0) continue;
+        for (int i = 0; i < mb->num_cases; i++) {
+            snprintf(name, sizeof(name), "%s/%d", mb->cases[i].name, mb->cases[i].batch);
+            if (strcmp(name, key) == 0) mb->cases[i].base_ns = ns;
+        }
+    }
+    fclose(f);
+    for (int i = 0; i < mb->num_cases; i++) {
+        if (mb->cases[i].base_ns > 0.0 && mb->cases[i].ns > mb->cases[i].base_ns * (1.0 + threshold)) {
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void mc_micro_usage(void) {
+    fprintf(stderr,
+            "Uso: programa micro [--batch 64,512,4096] [--seconds S] [--cpu C] [--filter TEXTO]\n"
+            "                    [--bias-points N] [--bias-seeds K]\n"
+            "                    [--baseline archivo] [--save-baseline archivo] [--threshold 0.10]\n"
+            "                    [--seed N] [--needle-length L] [--line-spacing D]\n");
+}
+
+int run_microbenchmarks(int argc, char* argv[]) {
+    static mc_micro_t mb;
+    long long list[MC_MICRO_MAX_BATCHES];
+    const char* baseline = NULL;
+    const char* save = NULL;
+    double threshold = 0.10;
+    int cpu = 0;
+    int regressions = 0;
+
+    memset(&mb, 0, sizeof(mb));
+    mb.seconds = 0.2;
+    mb.batches[0] = 64;
+    mb.batches[1] = MC_BATCH;
+    mb.batches[2] = 4096;
+    mb.num_batches = 3;
+    mb.bias_points = 10000000;
+    mb.bias_seeds = 4;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--batch") == 0) {
+            mb.num_batches = mc_parse_list(value, list, MC_MICRO_MAX_BATCHES, MC_MICRO_MAX_BATCH);
+            ok = mb.num_batches > 0;
+            for (int k = 0; ok && k < mb.num_batches; k++) {
+                ok = list[k] <= MC_MICRO_MAX_BATCH;
+                mb.batches[k] = (int)list[k];
+            }
+        } else if (strcmp(name, "--seconds") == 0) {
+            mb.seconds = strtod(value, NULL);
+            ok = mb.seconds > 0.0 && mb.seconds <= 60.0;
+        } else if (strcmp(name, "--cpu") == 0) {
+            cpu = atoi(value);
+        } else if (strcmp(name, "--filter") == 0) {
+            mb.filter = value;
+        } else if (strcmp(name, "--bias-points") == 0) {
+            ok = mc_parse_list(value, list, 1, 0) == 1;
+            mb.bias_points = list[0];
+        } else if (strcmp(name, "--bias-seeds") == 0) {
+            mb.bias_seeds = atoi(value);
+            ok = mb.bias_seeds >= 0;
+        } else if (strcmp(name, "--baseline") == 0) {
+            baseline = value;
+        } else if (strcmp(name, "--save-baseline") == 0) {
+            save = value;
+        } else if (strcmp(name, "--threshold") == 0) {
+            threshold = strtod(value, NULL);
+            ok = threshold > 0.0;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_micro_usage();
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_micro_usage();
+            return 1;
+        }
+    }
+    // El sesgo corre varias semillas y precisiones sobre [0, puntos): un flujo grabado no las tiene
+    if (g_replay != NULL) {
+        fprintf(stderr, "--replay no se combina con micro: los casos miden los generadores\n");
+        return 1;
+    }
+
+    // Un solo hilo fijado: sin migraciones entre procesadores durante la medicion
+    if (cpu >= 0 && mc_pin_current_thread(cpu) != 0) {
+        fprintf(stderr, "No se pudo fijar el hilo al procesador %d\n", cpu);
+    }
+    printf("Microbenchmarks: ISA %s, semilla %llu, procesador %d\n",
+           mc_isa_names[mc_detect_isa()], g_seed, cpu);
+    mc_micro_run(&mb);
+
+    if (baseline != NULL) {
+        regressions = mc_micro_compare(&mb, baseline, threshold);
+        if (regressions < 0) return 1;
+    }
+    printf("\n%-32s %6s %11s %14s %11s %9s\n", "caso", "lote", "ns/muestra", "muestras/ciclo",
+           "Mmuestras/s", "vs base");
+    for (int i = 0; i < mb.num_cases; i++) {
+        const mc_micro_case_t* c = &mb.cases[i];
+        char vs[32] = "-";
+        if (c->base_ns > 0.0) {
+            snprintf(vs, sizeof(vs), "%+.1f%%%s", 100.0 * (c->ns / c->base_ns - 1.0),
+                     c->ns > c->base_ns * (1.0 + threshold) ? " !" : "");
+        }
+        printf("%-32s %6d %11.3f %14.3f %11.1f %9s\n", c->name, c->batch, c->ns, c->per_cycle,
+               1e3 / c->ns, vs);
+    }
+
+    if (mb.bias_seeds > 0 && mb.bias_points > 0) mc_micro_bias(&mb);
+    if (save != NULL && mc_micro_save(&mb, save) != 0) return 1;
+
+    if (regressions > 0) {
+        printf("%d casos mas lentos que la base en mas de %.0f%%\n", regressions, threshold * 100.0);
+    }
+    if (mb.failures > 0) printf("%d verificaciones fallidas\n", mb.failures);
+    return regressions > 0 || mb.failures > 0 ? 1 : 0;
+}
+
+// ==================== AUTOAJUSTE (programa tune) ====================
+// programa tune [--profile ARCHIVO] [--methods lista] [--max-workers W] [--seconds S]
+// Corre sondas cortas de cada motor en esta maquina y guarda en un perfil:
+//  - la ISA de los kernels con mas muestras por segundo (la mas ancha no
+//    siempre gana: AVX-512 puede bajar la frecuencia del nucleo),
+//  - el tamano de chunk del pool de threads,
+//  - lo que cuesta lanzar cada pool, por worker,
+//  - un modelo t(N) = costo fijo + N / ritmo por metodo, precision, modo y
+//    cantidad de workers, ajustado por minimos cuadrados sobre tres tamanos.
+// Con el modo "auto" (menu, run --mode auto, serve) mc_auto_pick elige la
+// configuracion con menor tiempo previsto para los puntos pedidos: en
+// corridas chicas el costo fijo de repartir, y el de lanzar el pool si
+// todavia no existe, supera lo que se gana y queda la serial. El perfil por
+// omision es montecarlo-<maquina>.perfil en el directorio actual; --profile
+// elige otro en cualquier programa.
+#define MC_MODE_AUTO MC_MODE_COUNT          // pedido de modo que resuelve mc_auto_pick
+#define MC_TUNE_MAX_MODELS 512
+#define MC_TUNE_SIZES 3
+#define MC_TUNE_REPS 3
+#define MC_AUTO_SERIAL_POINTS (1ll << 21)   // regla fija cuando no hay perfil
+#define MC_AUTO_MARGIN 0.05
+
+typedef struct {
+    int method;
+    int precision;    // precision efectiva de los kernels
+    int mode;
+    int workers;
+    double overhead;  // segundos fijos por corrida
+    double rate;      // muestras por segundo
+} mc_tune_model_t;
+
+typedef struct {
+    char path[MC_PATH_MAX];       // archivo del que se leyo ("" = ninguno)
+    int loaded;                   // 1 = perfil valido de esta maquina
+    int isa;
+    long long chunk;
+    double spawn[MC_MODE_COUNT];  // segundos por worker para lanzar el pool
+    mc_tune_model_t models[MC_TUNE_MAX_MODELS];
+    int num_models;
+} mc_tune_profile_t;
+
+typedef struct {
+    int mode;
+    int workers;
+    double predicted;  // segundos previstos (0 = sin perfil)
+} mc_auto_choice_t;
+
+static mc_tune_profile_t g_tune;
+
+static void mc_tune_path(char* path, size_t size) {
+    char host[128];
+
+    if (g_profile_path[0] != '\0') {
+        snprintf(path, size, "%s", g_profile_path);
+        return;
+    }
+    mc_host_name(host, sizeof(host));
+    snprintf(path, size, "montecarlo-%s.perfil", host);
+}
+
+static int mc_tune_save(const mc_tune_profile_t* tp, const char* path) {
+    char host[128];
+    FILE* f = fopen(path, "w");
+
+    if (f == NULL) {
+        fprintf(stderr, "No se pudo escribir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    mc_host_name(host, sizeof(host));
+    fprintf(f, "# montecarlo tune: %d CPUs, ISA detectada %s\n", mc_cpu_count(),
+            mc_micro_isa[mc_detect_isa()]);
+    fprintf(f, "# model metodo precision modo workers costo_fijo_s muestras_por_s\n");
+    fprintf(f, "host %s\n", host);
+    fprintf(f, "isa %s\n", mc_micro_isa[tp->isa]);
+    fprintf(f, "chunk %lld\n", tp->chunk);
+    for (int mode = MC_MODE_THREADS; mode <= MC_MODE_PROCESSES; mode++) {
+        fprintf(f, "spawn %s %.9g\n", mc_mode_names[mode], tp->spawn[mode]);
+    }
+    for (int i = 0; i < tp->num_models; i++) {
+        const mc_tune_model_t* m = &tp->models[i];
+        fprintf(f, "model %s %s %s %d %.9g %.9g\n", mc_method_names[m->method],
+                mc_precision_names[m->precision], mc_mode_names[m->mode], m->workers,
+                m->overhead, m->rate);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "No se pudo escribir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int mc_tune_name(const char* const* names, int count, const char* name) {
+    for (int k = 0; k < count; k++) {
+        if (strcmp(name, names[k]) == 0) return k;
+    }
+    return -1;
+}
+
+// Lee el perfil; un perfil de otra maquina se descarta
+static int mc_tune_load(mc_tune_profile_t* tp, const char* path) {
+    char line[512], host[128], a[64], b[64], c[64];
+    int ok = 1, same_host = 0;
+    FILE* f = fopen(path, "r");
+
+    memset(tp, 0, sizeof(*tp));
+    snprintf(tp->path, sizeof(tp->path), "%s", path);
+    tp->isa = mc_detect_isa();
+    tp->chunk = MC_CHUNK_POINTS;
+    if (f == NULL) {
+        fprintf(stderr, "Sin perfil de esta maquina (%s): ejecute 'programa tune'; "
+                        "se usa una regla fija\n", path);
+        return -1;
+    }
+    mc_host_name(host, sizeof(host));
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        mc_tune_model_t m;
+        double v;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "host %63s", a) == 1) {
+            same_host = strcmp(a, host) == 0;
+        } else if (sscanf(line, "isa %63s", a) == 1) {
+            tp->isa = mc_tune_name(mc_micro_isa, MC_ISA_COUNT, a);
+            ok = tp->isa >= 0;
+        } else if (sscanf(line, "chunk %lld", &tp->chunk) == 1) {
+            ok = tp->chunk >= MC_MIN_CHUNK_POINTS && tp->chunk % MC_BATCH == 0;
+        } else if (sscanf(line, "spawn %63s %lf", a, &v) == 2) {
+            int mode = mc_tune_name(mc_mode_names, MC_MODE_HYBRID, a);
+            ok = mode >= 0 && v >= 0.0;
+            if (ok) tp->spawn[mode] = v;
+        } else if (sscanf(line, "model %63s %63s %63s %d %lf %lf", a, b, c, &m.workers,
+                          &m.overhead, &m.rate) == 6) {
+            m.method = mc_method_from_name(a);
+            m.precision = mc_precision_from_name(b);
+            m.mode = mc_tune_name(mc_mode_names, MC_MODE_HYBRID, c);
+            ok = m.method > 0 && m.precision >= 0 && m.mode >= 0 && m.workers >= 1 &&
+                 m.overhead >= 0.0 && m.rate > 0.0 && tp->num_models < MC_TUNE_MAX_MODELS;
+            if (ok) tp->models[tp->num_models++] = m;
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(f);
+    if (!ok || !same_host) {
+        if (!ok) fprintf(stderr, "Perfil %s con formato invalido: %s", path, line);
+        else fprintf(stderr, "El perfil %s es de otra maquina: ejecute 'programa tune' en esta\n", path);
+        tp->isa = mc_detect_isa();
+        tp->chunk = MC_CHUNK_POINTS;
+        tp->num_models = 0;
+        return -1;
+    }
+    tp->loaded = 1;
+    return 0;
+}
+
+// Tiempo previsto de la configuracion 'm' para 'points' muestras. Con 'live'
+// se suma el lanzamiento de los workers que el pool todavia no tiene; sin
+// 'live' se supone un programa recien arrancado, sin pools.
+static double mc_tune_predict(const mc_tune_profile_t* tp, const mc_tune_model_t* m,
+                              long long points, int live) {
+    double t = m->overhead + (double)points / m->rate;
+    int missing = 0;
+
+    if (m->mode == MC_MODE_THREADS) {
+        // La primera vez el pool crea un hilo por procesador logico
+        int target = m->workers > mc_cpu_count() ? m->workers : mc_cpu_count();
+        missing = live && g_pool.size > 0 ? m->workers - g_pool.size : target;
+    } else if (m->mode == MC_MODE_PROCESSES) {
+        missing = live ? m->workers - g_proc_pool.size : m->workers;
+    }
+    if (missing > 0) t += missing * tp->spawn[m->mode];
+    return t;
+}
+
+// Mejor configuracion segun 'tp' para los parametros y puntos pedidos, con
+// los modelos de la misma precision efectiva (o los del metodo si no hay).
+// Entre las que quedan a MC_AUTO_MARGIN de la mas rapida se toma la de menos
+// workers: una ventaja menor que el ruido de la medicion no paga ocupar la
+// maquina.
+static mc_auto_choice_t mc_tune_best(const mc_tune_profile_t* tp, const mc_params_t* p,
+                                     long long points, int live) {
+    mc_auto_choice_t best = { MC_MODE_SERIAL, 1, 0.0 };
+    int precision = mc_effective_precision(p);
+    double fastest = HUGE_VAL;
+    int found = 0;
+
+    for (int pass = 0; pass < 2 && !found; pass++) {
+        for (int i = 0; i < tp->num_models; i++) {
+            const mc_tune_model_t* m = &tp->models[i];
+            if (m->method != p->method || (pass == 0 && m->precision != precision)) continue;
+            double t = mc_tune_predict(tp, m, points, live);
+            if (t < fastest) fastest = t;
+            found = 1;
+        }
+        for (int i = 0; i < tp->num_models && found; i++) {
+            const mc_tune_model_t* m = &tp->models[i];
+            if (m->method != p->method || (pass == 0 && m->precision != precision)) continue;
+            double t = mc_tune_predict(tp, m, points, live);
+            if (t > fastest * (1.0 + MC_AUTO_MARGIN)) continue;
+            if (best.predicted == 0.0 || m->workers < best.workers ||
+                (m->workers == best.workers && m->mode < best.mode)) {
+                best.mode = m->mode;
+                best.workers = m->workers;
+                best.predicted = t;
+            }
+        }
+    }
+    if (!found && points >= MC_AUTO_SERIAL_POINTS) {
+        best.mode = MC_MODE_THREADS;
+        best.workers = mc_cpu_count();
+    }
+    return best;
+}
+
+// Modo "auto": lee el perfil la primera vez (o si --profile cambio), aplica
+// su ISA y su chunk y elige el modo y los workers de menor tiempo previsto.
+// Sin perfil: serial hasta MC_AUTO_SERIAL_POINTS, threads en todos los
+// procesadores desde ahi.
+mc_auto_choice_t mc_auto_pick(const mc_params_t* p, long long points) {
+    char path[MC_PATH_MAX];
+
+    mc_tune_path(path, sizeof(path));
+    if (strcmp(path, g_tune.path) != 0) {
+        if (mc_tune_load(&g_tune, path) == 0) {
+            if (!g_isa_forced) mc_set_isa(g_tune.isa);
+            g_chunk_points = g_tune.chunk;
+        }
+    }
+    return mc_tune_best(&g_tune, p, points, 1);
+}
+
+// Segundos de pared de la mejor de 'reps' corridas, incluido repartir y juntar
+static double mc_tune_time(int mode, int method, int workers, long long points, int reps) {
+    double best = HUGE_VAL;
+
+    for (int r = 0; r < reps; r++) {
+        double start = mc_now();
+        mc_bench_once(mode, method, workers, 1, points);
+        double t = mc_now() - start;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+// Puntos que la configuracion cuenta en unos 'seconds' segundos
+static long long mc_tune_size(int mode, int method, int workers, double seconds) {
+    long long points = MC_BLOCK_POINTS;
+
+    for (;;) {
+        double t = mc_tune_time(mode, method, workers, points, 1);
+        if (t >= seconds / 8.0 || points >= (1ll << 40)) {
+            double scaled = (double)points * seconds / (t > 0.0 ? t : 1e-9);
+            return scaled > (double)points ? (long long)scaled : points;
+        }
+        points *= 4;
+    }
+}
+
+// Ajuste de t = a + b N por minimos cuadrados con peso 1/t^2 (error relativo):
+// las corridas chicas fijan el costo fijo y las grandes el ritmo
+static void mc_tune_fit(const long long* n, const double* t, int k, double* overhead, double* rate) {
+    double sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+
+    for (int i = 0; i < k; i++) {
+        double w = 1.0 / (t[i] * t[i]), x = (double)n[i];
+        sw += w;
+        sx += w * x;
+        sy += w * t[i];
+        sxx += w * x * x;
+        sxy += w * x * t[i];
+    }
+    double det = sw * sxx - sx * sx;
+    double b = det > 0.0 ? (sw * sxy - sx * sy) / det : 0.0;
+    double a = b > 0.0 ? (sy - b * sx) / sw : -1.0;
+    if (a < 0.0) {
+        // Sin costo fijo medible: recta por el origen
+        a = 0.0;
+        b = sxy / sxx;
+    }
+    *overhead = a;
+    *rate = 1.0 / b;
+}
+
+static void mc_tune_usage(void) {
+    fprintf(stderr,
+            "Uso: programa tune [--profile ARCHIVO] [--methods dartboard,needles,...]\n"
+            "                   [--max-workers W] [--seconds S] [--precision P] [--rng R]\n"
+            "                   [--sampling S] [--placement P]\n");
+}
+
+int run_autotuner(int argc, char* argv[]) {
+    static mc_tune_profile_t tp;
+    int methods[MC_METHOD_COUNT];
+    int num_methods = 0;
+    int max_workers = mc_cpu_count();
+    double seconds = 0.05;
+    char path[MC_PATH_MAX], host[128];
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--methods") == 0) {
+            num_methods = mc_bench_name_list(value, mc_method_names, MC_METHOD_COUNT, 1,
+                                             methods, MC_METHOD_COUNT);
+            ok = num_methods > 0;
+        } else if (strcmp(name, "--max-workers") == 0) {
+            max_workers = atoi(value);
+            ok = max_workers >= 1 && max_workers <= MC_MAX_POOL && max_workers <= MAX_PROCESSES;
+        } else if (strcmp(name, "--seconds") == 0) {
+            seconds = strtod(value, NULL);
+            ok = seconds > 0.0 && seconds <= 60.0;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_tune_usage();
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_tune_usage();
+            return 1;
+        }
+    }
+    if (g_replay != NULL) {
+        fprintf(stderr, "--replay no se combina con tune: el perfil mide los generadores\n");
+        return 1;
+    }
+    if (num_methods == 0) {
+        for (int m = 1; m < MC_METHOD_COUNT; m++) methods[num_methods++] = m;
+    }
+    mc_tune_path(path, sizeof(path));
+    mc_host_name(host, sizeof(host));
+    memset(&tp, 0, sizeof(tp));
+    snprintf(tp.path, sizeof(tp.path), "%s", path);
+    g_quiet = 1;
+
+    printf("Autoajuste de %s: %d CPUs, hasta %d workers, ISA detectada %s, sondas de %.3f s\n",
+           host, mc_cpu_count(), max_workers, mc_isa_names[mc_detect_isa()], seconds);
+
+    // Lanzamiento de los pools, por worker: se mide antes de cualquier corrida
+    double start = mc_now();
+    int created = mc_pool_ensure(max_workers);
+    tp.spawn[MC_MODE_THREADS] = (mc_now() - start) / created;
+    start = mc_now();
+    created = mc_proc_pool_ensure(max_workers);
+    if (created < 1) {
+        fprintf(stderr, "No se pudo lanzar el pool de procesos\n");
+        return 1;
+    }
+    tp.spawn[MC_MODE_PROCESSES] = (mc_now() - start) / created;
+    printf("Lanzar el pool: %.1f us por hilo, %.1f us por proceso\n",
+           tp.spawn[MC_MODE_THREADS] * 1e6, tp.spawn[MC_MODE_PROCESSES] * 1e6);
+
+    // ISA: media geometrica del ritmo serial de todos los metodos
+    long long serial_points[MC_METHOD_COUNT];
+    double best_score = -HUGE_VAL;
+    for (int k = 0; k < num_methods; k++) {
+        serial_points[k] = mc_tune_size(MC_MODE_SERIAL, methods[k], 1, seconds);
+    }
+    for (int isa = 0; isa <= mc_detect_isa(); isa++) {
+        double score = 0.0;
+        mc_set_isa(isa);
+        for (int k = 0; k < num_methods; k++) {
+            double t = mc_tune_time(MC_MODE_SERIAL, methods[k], 1, serial_points[k], MC_TUNE_REPS);
+            score += log((double)serial_points[k] / t) / num_methods;
+        }
+        printf("ISA %-8s %10.1f Mmuestras/s (media geometrica, serial)\n", mc_isa_names[isa],
+               exp(score) / 1e6);
+        if (score > best_score) {
+            best_score = score;
+            tp.isa = isa;
+        }
+    }
+    mc_set_isa(tp.isa);
+
+    // Chunk del pool de threads, con todos los workers y chunks sin achicar
+    static const long long chunks[] = { MC_BLOCK_POINTS / 4, MC_BLOCK_POINTS,
+                                        4 * MC_BLOCK_POINTS, 16 * MC_BLOCK_POINTS };
+    long long chunk_points = mc_tune_size(MC_MODE_THREADS, methods[0], max_workers, seconds);
+    long long min_points = chunks[3] * 4 * max_workers;
+    if (chunk_points < min_points) chunk_points = min_points;
+    double best_time = HUGE_VAL;
+    for (int c = 0; c < (int)(sizeof(chunks) / sizeof(chunks[0])); c++) {
+        g_chunk_points = chunks[c];
+        double t = mc_tune_time(MC_MODE_THREADS, methods[0], max_workers, chunk_points, MC_TUNE_REPS);
+        printf("Chunk %8lld: %10.1f Mmuestras/s (%s, %d hilos)\n", chunks[c],
+               chunk_points / t / 1e6, mc_method_names[methods[0]], max_workers);
+        if (t < best_time) {
+            best_time = t;
+            tp.chunk = chunks[c];
+        }
+    }
+    g_chunk_points = tp.chunk;
+
+    // Modelo por metodo, modo y workers: 1, 2, 4, ... y el maximo
+    printf("\n%-10s %-9s %7s %14s %13s\n", "metodo", "modo", "workers", "costo fijo us",
+           "Mmuestras/s");
+    for (int k = 0; k < num_methods; k++) {
+        mc_params_t params = mc_make_params(methods[k]);
+        // El hibrido no entra en el modelo: su reparto se busca con bench
+        for (int mode = MC_MODE_SERIAL; mode <= MC_MODE_PROCESSES; mode++) {
+            int w = 1;
+            for (;;) {
+                long long n[MC_TUNE_SIZES];
+                double t[MC_TUNE_SIZES];
+                mc_tune_model_t* m = &tp.models[tp.num_models];
+                long long big = mc_tune_size(mode, methods[k], w, seconds);
+
+                for (int s = 0; s < MC_TUNE_SIZES; s++) {
+                    n[s] = big >> (3 * (MC_TUNE_SIZES - 1 - s));
+                    if (n[s] < MC_BATCH) n[s] = MC_BATCH;
+                    t[s] = mc_tune_time(mode, methods[k], w, n[s], MC_TUNE_REPS);
+                }
+                m->method = methods[k];
+                m->precision = mc_effective_precision(&params);
+                m->mode = mode;
+                m->workers = w;
+                mc_tune_fit(n, t, MC_TUNE_SIZES, &m->overhead, &m->rate);
+                printf("%-10s %-9s %7d %14.1f %13.1f\n", mc_method_names[m->method],
+                       mc_mode_names[mode], w, m->overhead * 1e6, m->rate / 1e6);
+                tp.num_models++;
+                if (mode == MC_MODE_SERIAL || w == max_workers ||
+                    tp.num_models == MC_TUNE_MAX_MODELS) break;
+                w = w * 2 < max_workers ? w * 2 : max_workers;
+            }
+        }
+    }
+    g_quiet = 0;
+
+    // Lo que elegiria "auto" en un programa recien arrancado
+    printf("\nModo auto (sin pools lanzados):\n");
+    for (int k = 0; k < num_methods; k++) {
+        mc_params_t params = mc_make_params(methods[k]);
+        printf("%-10s", mc_method_names[methods[k]]);
+        for (long long points = 10000; points <= 10000000000ll; points *= 100) {
+            mc_auto_choice_t c = mc_tune_best(&tp, &params, points, 0);
+            printf("  %.0e: %s/%d", (double)points, mc_mode_names[c.mode], c.workers);
+        }
+        printf("\n");
+    }
+
+    if (mc_tune_save(&tp, path) != 0) return 1;
+    printf("Perfil guardado en %s\n", path);
+    return 0;
+}
+
+// ==================== ENSAYOS EN LOTE (programa trials) ====================
+// programa trials --method M --trials K --points N [--mode serial|threads]
+//                 [--workers W] [--confidence C] [--bins B] [--output ARCHIVO]
+//                 [--format csv|bin] [--raw 0|1] [opciones de sesion]
+// Corre K estimaciones independientes de N muestras como un solo trabajo del
+// pool, para estudiar la distribucion del estimador. Cada chunk es un grupo
+// de ensayos que un worker cuenta de punta a punta, sin sincronizar entre
+// ensayos, y cada ensayo deja sus aciertos en un arreglo de K enteros. El
+// ensayo k usa el flujo [0, N) de la semilla mc_trial_seed(semilla, k) y se
+// puede repetir solo con --seed. El resumen da media, varianza y sesgo de
+// las estimaciones, la desviacion observada contra la teorica, la cobertura
+// del intervalo de confianza de cada ensayo y un histograma.
+#define MC_TRIALS_MAGIC "MCTRIALS"
+#define MC_TRIALS_VERSION 1
+#define MC_TRIALS_MAX_BINS 1000
+#define MC_TRIALS_MAX (1ll << 30)
+
+enum { MC_TRIALS_CSV = 0, MC_TRIALS_BIN };
+
+// Resumen del lote; es tambien la cabecera del formato binario, seguida de
+// 'bins' conteos int64 del histograma y, con raw, los aciertos int64 de
+// cada ensayo (la semilla de cada uno sale de mc_trial_seed)
+typedef struct {
+    char magic[8];
+    int version;
+    int method;
+    int rng;
+    int sampling;
+    int precision;
+    int bins;
+    long long trials;
+    long long points;
+    unsigned long long seed;
+    long long raw;             // 1 = siguen los aciertos de cada ensayo
+    long long invalid;         // ensayos sin estimacion finita (Needles sin cruces)
+    double confidence;
+    double mean;
+    double variance;           // varianza muestral de las estimaciones
+    double sd_theory;          // sigma / sqrt(N) promedio de los ensayos
+    double coverage;           // fraccion de intervalos que contienen a pi
+    double mean_half_width;
+    double hist_lo;            // rango [lo, hi] del histograma
+    double hist_hi;
+} mc_trials_header_t;
+
+static void mc_trials_usage(void) {
+    fprintf(stderr,
+            "Uso: programa trials --trials K --points N [--method dartboard|needles|ball3|ball4|arctan]\n"
+            "                     [--mode serial|threads] [--workers W] [--confidence C] [--bins B]\n"
+            "                     [--output ARCHIVO] [--format csv|bin] [--raw 0|1] [--seed N]\n"
+            "                     [--rng R] [--sampling S] [--precision P] [--placement P] [--progress S]\n");
+}
+
+// Semiancho del intervalo del ensayo con 'hits' aciertos (sin minimo de aciertos)
+static double mc_trials_half_width(const mc_params_t* p, long long hits, long long points, double z) {
+    return z * mc_pi_sigma(p, hits, points) / sqrt((double)points);
+}
+
+// Resume los aciertos de los ensayos en 'h' y llena el histograma
+static void mc_trials_summarize(const mc_params_t* p, const long long* hits, mc_trials_header_t* h,
+                                long long* hist) {
+    const double ACTUAL_PI = 3.14159265358979323846;
+    double z = mc_normal_quantile(h->confidence);
+    double mean = 0.0, m2 = 0.0, sd_sum = 0.0;
+    long long valid = 0, covered = 0;
+
+    h->hist_lo = HUGE_VAL;
+    h->hist_hi = -HUGE_VAL;
+    for (long long k = 0; k < h->trials; k++) {
+        double pi = mc_estimate_pi(p, hits[k], h->points);
+        double half = mc_trials_half_width(p, hits[k], h->points, z);
+        if (!(fabs(pi) < HUGE_VAL) || !(half < HUGE_VAL)) {
+            h->invalid++;
+            continue;
+        }
+        // Welford: media y varianza en una pasada sin cancelacion
+        double delta = pi - mean;
+        valid++;
+        mean += delta / valid;
+        m2 += delta * (pi - mean);
+        sd_sum += half / z;
+        if (fabs(pi - ACTUAL_PI) <= half) covered++;
+        if (pi < h->hist_lo) h->hist_lo = pi;
+        if (pi > h->hist_hi) h->hist_hi = pi;
+    }
+    h->mean = mean;
+    h->variance = valid > 1 ? m2 / (valid - 1) : 0.0;
+    h->sd_theory = valid > 0 ? sd_sum / valid : 0.0;
+    h->mean_half_width = h->sd_theory * z;
+    h->coverage = h->trials > 0 ? (double)covered / h->trials : 0.0;
+    if (valid == 0) h->hist_lo = h->hist_hi = 0.0;
+
+    memset(hist, 0, sizeof(long long) * h->bins);
+    double width = (h->hist_hi - h->hist_lo) / h->bins;
+    for (long long k = 0; k < h->trials && valid > 0; k++) {
+        double pi = mc_estimate_pi(p, hits[k], h->points);
+        if (!(fabs(pi) < HUGE_VAL) || !(mc_trials_half_width(p, hits[k], h->points, z) < HUGE_VAL)) {
+            continue;
+        }
+        int b = width > 0.0 ? (int)((pi - h->hist_lo) / width) : 0;
+        if (b >= h->bins) b = h->bins - 1;   // el maximo cae en el ultimo
+        hist[b]++;
+    }
+}
+
+static void mc_trials_print(const mc_trials_header_t* h, const long long* hist, double elapsed) {
+    const double ACTUAL_PI = 3.14159265358979323846;
+    double sd = sqrt(h->variance);
+    long long valid = h->trials - h->invalid;
+    long long peak = 1;
+
+    printf("\nEnsayos: %lld de %lld muestras (%s), %.6f s, %.1f ensayos/s\n", h->trials, h->points,
+           mc_method_names[h->method], elapsed, h->trials / elapsed);
+    if (h->invalid > 0) printf("Ensayos sin estimacion finita: %lld\n", h->invalid);
+    printf("Media de las estimaciones: %.10f\n", h->mean);
+    printf("Sesgo: %+.3e (z = %+.2f)\n", h->mean - ACTUAL_PI,
+           sd > 0.0 && valid > 0 ? (h->mean - ACTUAL_PI) / (sd / sqrt((double)valid)) : 0.0);
+    printf("Varianza: %.6e, desviacion observada: %.6e, teorica: %.6e (razon %.4f)\n", h->variance,
+           sd, h->sd_theory, h->sd_theory > 0.0 ? sd / h->sd_theory : 0.0);
+    printf("Cobertura del intervalo del %.1f%%: %.4f (semiancho medio %.3e)\n",
+           100.0 * h->confidence, h->coverage, h->mean_half_width);
+
+    for (int b = 0; b < h->bins; b++) {
+        if (hist[b] > peak) peak = hist[b];
+    }
+    double width = (h->hist_hi - h->hist_lo) / h->bins;
+    printf("Histograma de las estimaciones:\n");
+    for (int b = 0; b < h->bins; b++) {
+        char bar[51];
+        int len = (int)(50 * hist[b] / peak);
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        printf("  [%.6f, %.6f) %8lld %s\n", h->hist_lo + b * width, h->hist_lo + (b + 1) * width,
+               hist[b], bar);
+    }
+}
+
+// CSV: el resumen como pares statistic,value, el histograma y, con raw, una
+// fila por ensayo; las tablas van separadas por una linea en blanco
+static int mc_trials_write_csv(FILE* out, const mc_params_t* p, const mc_trials_header_t* h,
+                               const long long* hist, const long long* hits) {
+    const double ACTUAL_PI = 3.14159265358979323846;
+    double z = mc_normal_quantile(h->confidence);
+    double width = (h->hist_hi - h->hist_lo) / h->bins;
+
+    fprintf(out, "statistic,value\n");
+    fprintf(out, "method,%s\n", mc_method_names[h->method]);
+    fprintf(out, "trials,%lld\n", h->trials);
+    fprintf(out, "points,%lld\n", h->points);
+    fprintf(out, "seed,%llu\n", h->seed);
+    fprintf(out, "rng,%s\n", mc_rng_names[h->rng]);
+    fprintf(out, "sampling,%s\n", mc_sampling_names[h->sampling]);
+    fprintf(out, "precision,%s\n", mc_precision_names[h->precision]);
+    fprintf(out, "confidence,%.6f\n", h->confidence);
+    fprintf(out, "mean,%.12f\n", h->mean);
+    fprintf(out, "bias,%.6e\n", h->mean - ACTUAL_PI);
+    fprintf(out, "variance,%.9e\n", h->variance);
+    fprintf(out, "sd,%.9e\n", sqrt(h->variance));
+    fprintf(out, "sd_theory,%.9e\n", h->sd_theory);
+    fprintf(out, "coverage,%.6f\n", h->coverage);
+    fprintf(out, "mean_half_width,%.9e\n", h->mean_half_width);
+    fprintf(out, "invalid,%lld\n", h->invalid);
+
+    fprintf(out, "\nbin,lo,hi,count\n");
+    for (int b = 0; b < h->bins; b++) {
+        fprintf(out, "%d,%.12f,%.12f,%lld\n", b, h->hist_lo + b * width,
+                h->hist_lo + (b + 1) * width, hist[b]);
+    }
+
+    if (h->raw) {
+        fprintf(out, "\ntrial,seed,hits,points,pi,half_width,covered\n");
+        for (long long k = 0; k < h->trials; k++) {
+            double pi = mc_estimate_pi(p, hits[k], h->points);
+            double half = mc_trials_half_width(p, hits[k], h->points, z);
+            fprintf(out, "%lld,%llu,%lld,%lld,%.12f,%.6e,%d\n", k, mc_trial_seed(h->seed, k),
+                    hits[k], h->points, pi, half, fabs(pi - ACTUAL_PI) <= half);
+        }
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+static int mc_trials_write_bin(FILE* out, const mc_trials_header_t* h, const long long* hist,
+                               const long long* hits) {
+    if (fwrite(h, sizeof(*h), 1, out) != 1 ||
+        fwrite(hist, sizeof(long long), (size_t)h->bins, out) != (size_t)h->bins) {
+        return -1;
+    }
+    if (h->raw && fwrite(hits, sizeof(long long), (size_t)h->trials, out) != (size_t)h->trials) {
+        return -1;
+    }
+    return 0;
+}
+
+int run_trials(int argc, char* argv[]) {
+    mc_trials_header_t h;
+    int mode = MC_MODE_THREADS;
+    int workers = mc_cpu_count();
+    int format = MC_TRIALS_CSV;
+    const char* output = NULL;
+
+    memset(&h, 0, sizeof(h));
+    h.method = 1;
+    h.confidence = 0.95;
+    h.bins = 20;
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--trials") == 0) {
+            h.trials = (long long)strtod(value, NULL);
+            ok = h.trials > 0 && h.trials <= MC_TRIALS_MAX;
+        } else if (strcmp(name, "--points") == 0) {
+            h.points = (long long)strtod(value, NULL);
+            ok = h.points > 0;
+        } else if (strcmp(name, "--method") == 0) {
+            h.method = mc_method_from_name(value);
+            ok = h.method > 0;
+        } else if (strcmp(name, "--mode") == 0) {
+            mode = strcmp(value, "serial") == 0 ? MC_MODE_SERIAL
+                 : strcmp(value, "threads") == 0 ? MC_MODE_THREADS : -1;
+            ok = mode >= 0;
+        } else if (strcmp(name, "--workers") == 0) {
+            workers = atoi(value);
+            ok = workers > 0 && workers <= MC_MAX_POOL;
+        } else if (strcmp(name, "--confidence") == 0) {
+            h.confidence = strtod(value, NULL);
+            ok = h.confidence > 0.0 && h.confidence < 1.0;
+        } else if (strcmp(name, "--bins") == 0) {
+            h.bins = atoi(value);
+            ok = h.bins >= 1 && h.bins <= MC_TRIALS_MAX_BINS;
+        } else if (strcmp(name, "--output") == 0) {
+            output = value;
+        } else if (strcmp(name, "--format") == 0) {
+            format = strcmp(value, "csv") == 0 ? MC_TRIALS_CSV
+                   : strcmp(value, "bin") == 0 ? MC_TRIALS_BIN : -1;
+            ok = format >= 0;
+        } else if (strcmp(name, "--raw") == 0) {
+            h.raw = atoi(value);
+            ok = h.raw == 0 || h.raw == 1;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_trials_usage();
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_trials_usage();
+            return 1;
+        }
+    }
+    if (h.trials == 0 || h.points == 0) {
+        fprintf(stderr, "Faltan --trials y --points\n");
+        mc_trials_usage();
+        return 1;
+    }
+    if (g_replay != NULL) {
+        fprintf(stderr, "--replay no se combina con trials: cada ensayo tiene su propia semilla\n");
+        return 1;
+    }
+
+    mc_params_t params = mc_make_params(h.method);
+    long long* hits = (long long*)malloc(sizeof(long long) * h.trials);
+    long long* hist = (long long*)malloc(sizeof(long long) * h.bins);
+    mc_monitor_t monitor;
+    double start, elapsed;
+
+    if (hits == NULL || hist == NULL) {
+        fprintf(stderr, "Sin memoria para %lld ensayos\n", h.trials);
+        return 1;
+    }
+    memcpy(h.magic, MC_TRIALS_MAGIC, 8);
+    h.version = MC_TRIALS_VERSION;
+    h.rng = params.rng;
+    h.sampling = params.sampling;
+    h.precision = params.precision;
+    h.seed = params.seed;
+    if (mode == MC_MODE_SERIAL) workers = 1;
+
+    printf("Ensayos en lote: %lld x %lld muestras (%s), modo %s con %d workers\n", h.trials, h.points,
+           mc_integrands[h.method].title, mc_mode_names[mode], workers);
+    printf("Generador: %s, muestreo: %s, precision: %s, semilla base: %llu\n",
+           mc_rng_names[h.rng], mc_sampling_names[h.sampling], mc_precision_names[h.precision], h.seed);
+
+    if (mode == MC_MODE_THREADS) {
+        mc_pool_job_t job;
+        mc_pool_ensure(workers);
+        mc_pool_job_init_trials(&job, &params, hits, h.trials, h.points, workers);
+        mc_monitor_start(&monitor, &params, h.trials * h.points, 0, mc_progress_pool, &job);
+        start = mc_now();
+        mc_pool_execute(&job);
+        elapsed = mc_now() - start;
+        mc_monitor_stop(&monitor);
+        mc_pool_job_free(&job);
+    } else {
+        // Por grupos de ensayos, para que el monitor vea el avance
+        mc_serial_progress_t progress = { 0, 0 };
+        long long group = MC_PROGRESS_POINTS / h.points > 0 ? MC_PROGRESS_POINTS / h.points : 1;
+        long long total = 0;
+        mc_monitor_start(&monitor, &params, h.trials * h.points, 0, mc_progress_serial, &progress);
+        start = mc_now();
+        for (long long k = 0; k < h.trials; k += group) {
+            long long count = h.trials - k < group ? h.trials - k : group;
+            total += mc_count_trials(&params, hits, k, count, h.points);
+            mc_atomic_store_relaxed(&progress.hits, total);
+            mc_atomic_store_relaxed(&progress.points, (k + count) * h.points);
+        }
+        elapsed = mc_now() - start;
+        mc_monitor_stop(&monitor);
+    }
+
+    mc_trials_summarize(&params, hits, &h, hist);
+    mc_trials_print(&h, hist, elapsed);
+
+    int status = 0;
+    if (output != NULL) {
+        FILE* out = fopen(output, format == MC_TRIALS_BIN ? "wb" : "w");
+        if (out == NULL) {
+            fprintf(stderr, "No se pudo crear %s: %s\n", output, strerror(errno));
+            status = 1;
+        } else {
+            int failed = format == MC_TRIALS_BIN ? mc_trials_write_bin(out, &h, hist, hits)
+                                                 : mc_trials_write_csv(out, &params, &h, hist, hits);
+            if (fclose(out) != 0 || failed) {
+                fprintf(stderr, "Error escribiendo %s\n", output);
+                status = 1;
+            } else {
+                printf("Resumen%s guardado en %s (%s)\n", h.raw ? " y ensayos" : "", output,
+                       format == MC_TRIALS_BIN ? "bin" : "csv");
+            }
+        }
+    }
+    free(hits);
+    free(hist);
+    return status;
+}
+
+// ==================== GRABACIÓN DE FLUJOS (programa record) ====================
+// programa record --output ARCHIVO --points N [--method M | --dims D]
+//                 [--format double|raw] [--input VOLCADO] [opciones de sesion]
+// Graba las coordenadas de las muestras [0, N) en el formato que lee
+// --replay: las del generador y el muestreo de la sesion o, con --input, las
+// de un volcado externo de palabras de 32 bits (un RNG por hardware, por
+// ejemplo) tomadas en orden, muestra por muestra y dimension por dimension.
+// En formato double cada coordenada usa dos palabras (52 bits, como philox).
+static void mc_record_usage(void) {
+    fprintf(stderr, "Uso: programa record --output ARCHIVO [--points N] "
+                    "[--method dartboard|needles|ball3|ball4|arctan] [--dims D]\n"
+                    "                     [--format double|raw] [--input VOLCADO] [--seed N] [--rng R] "
+                    "[--sampling S]\n");
+}
+
+// Lee hasta n muestras del volcado en las columnas; devuelve cuantas completo
+static int mc_record_read_input(FILE* in, int format, int dims, int n, double* const* u,
+                                unsigned int* const* w) {
+    unsigned int words[MC_BATCH * MC_MAX_DIMS * 2];
+    int per_value = format == MC_REPLAY_RAW ? 1 : 2;
+    int got = (int)fread(words, sizeof(unsigned int), (size_t)n * dims * per_value, in);
+    int samples = got / (dims * per_value);
+
+    for (int k = 0; k < samples; k++) {
+        for (int d = 0; d < dims; d++) {
+            const unsigned int* v = &words[(k * dims + d) * per_value];
+            if (format == MC_REPLAY_RAW) w[d][k] = v[0];
+            else u[d][k] = philox_to_unit(v[0], v[1]);
+        }
+    }
+    return samples;
+}
+
+int run_stream_recorder(int argc, char* argv[]) {
+    const char* output = NULL;
+    const char* input = NULL;
+    long long points = 0;
+    int method = 1;
+    int dims = 0;
+    int format = MC_REPLAY_DOUBLE;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--output") == 0) {
+            output = value;
+        } else if (strcmp(name, "--input") == 0) {
+            input = value;
+        } else if (strcmp(name, "--points") == 0) {
+            points = (long long)strtod(value, NULL);
+            ok = points > 0;
+        } else if (strcmp(name, "--method") == 0) {
+            method = mc_method_from_name(value);
+            ok = method > 0;
+        } else if (strcmp(name, "--dims") == 0) {
+            dims = atoi(value);
+            ok = dims >= 1 && dims <= MC_MAX_DIMS;
+        } else if (strcmp(name, "--format") == 0) {
+            format = -1;
+            for (int f = 0; f < MC_REPLAY_FORMAT_COUNT; f++) {
+                if (strcmp(value, mc_replay_format_names[f]) == 0) format = f;
+            }
+            ok = format >= 0;
+        } else if (strcmp(name, "--replay") == 0) {
+            ok = 0;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_record_usage();
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_record_usage();
+            return 1;
+        }
+    }
+    if (output == NULL || (input == NULL && points == 0)) {
+        fprintf(stderr, "Faltan --output y --points (o --input)\n");
+        mc_record_usage();
+        return 1;
+    }
+
+    mc_params_t params = mc_make_params(method);
+    mc_stream_t st;
+    mc_replay_header_t header;
+    FILE* in = NULL;
+    FILE* out;
+    double* u[MC_MAX_DIMS];
+    unsigned int* w[MC_MAX_DIMS];
+    MC_ALIGN(64) double scratch[MC_MAX_DIMS][MC_BATCH];   // muestreo antes de pasar a palabras
+
+    if (dims == 0) dims = mc_integrand(&params)->dims;
+    mc_stream_init(&st, &params);
+    st.dims = dims;
+    if (input != NULL && (in = fopen(input, "rb")) == NULL) {
+        fprintf(stderr, "No se pudo abrir %s: %s\n", input, strerror(errno));
+        return 1;
+    }
+    if ((out = fopen(output, "wb")) == NULL) {
+        fprintf(stderr, "No se pudo crear %s: %s\n", output, strerror(errno));
+        if (in != NULL) fclose(in);
+        return 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MC_REPLAY_MAGIC, 8);
+    header.version = MC_REPLAY_VERSION;
+    header.format = format;
+    header.dims = dims;
+    header.block = MC_BLOCK_POINTS;
+    if (input != NULL) {
+        snprintf(header.source, sizeof(header.source), "volcado %s", input);
+    } else {
+        snprintf(header.source, sizeof(header.source), "%s, muestreo %s, semilla %llu",
+                 mc_rng_names[params.rng], mc_sampling_names[params.sampling], params.seed);
+    }
+
+    size_t elem = mc_replay_elem(format);
+    size_t block_bytes = (size_t)dims * MC_BLOCK_POINTS * elem;
+    unsigned char* buf = (unsigned char*)mc_aligned_alloc(block_bytes > MC_REPLAY_HEADER ? block_bytes
+                                                          : MC_REPLAY_HEADER, MC_CACHE_LINE);
+    if (buf == NULL) {
+        fprintf(stderr, "Sin memoria para un bloque de %zu bytes\n", block_bytes);
+        return 1;
+    }
+    memset(buf, 0, MC_REPLAY_HEADER);
+    fwrite(buf, 1, MC_REPLAY_HEADER, out);   // la cabecera va al final, con el total
+
+    double start = mc_now();
+    long long recorded = 0;
+    int done = 0;
+    while (!done && (points == 0 || recorded < points)) {
+        long long in_block = points > 0 && points - recorded < MC_BLOCK_POINTS ? points - recorded
+                                                                                 : MC_BLOCK_POINTS;
+        long long filled = 0;
+        memset(buf, 0, block_bytes);
+        while (filled < in_block) {
+            int n = in_block - filled < MC_BATCH ? (int)(in_block - filled) : MC_BATCH;
+            for (int d = 0; d < dims; d++) {
+                u[d] = (double*)(buf + ((size_t)d * MC_BLOCK_POINTS + filled) * elem);
+                w[d] = (unsigned int*)u[d];
+            }
+            if (in != NULL) {
+                int got = mc_record_read_input(in, format, dims, n, u, w);
+                if (got < n) done = 1;
+                n = got;
+            } else if (format == MC_REPLAY_RAW) {
+                double* s[MC_MAX_DIMS];
+                for (int d = 0; d < MC_MAX_DIMS; d++) s[d] = scratch[d];
+                mc_stream_fill_raw(&st, recorded + filled, n, s, w);
+            } else {
+                mc_stream_fill(&st, recorded + filled, n, u);
+            }
+            filled += n;
+            if (done) break;
+        }
+        if (filled == 0) break;
+        if (fwrite(buf, 1, block_bytes, out) != block_bytes) {
+            fprintf(stderr, "Error escribiendo %s: %s\n", output, strerror(errno));
+            fclose(out);
+            return 1;
+        }
+        recorded += filled;
+    }
+    if (in != NULL) fclose(in);
+    mc_aligned_free(buf);
+
+    header.points = recorded;
+    if (recorded == 0 || fseek(out, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, out) != 1 || fclose(out) != 0) {
+        fprintf(stderr, "No se pudo completar %s\n", output);
+        return 1;
+    }
+    double elapsed = mc_now() - start;
+    printf("Flujo grabado en %s: %lld muestras, %d dimensiones, formato %s (%s)\n", output, recorded,
+           dims, mc_replay_format_names[format], header.source);
+    printf("%.1f MB en %.3f s (%.1f M muestras/s)\n",
+           (MC_REPLAY_HEADER + (double)((recorded + MC_BLOCK_POINTS - 1) / MC_BLOCK_POINTS) * block_bytes) / 1e6,
+           elapsed, recorded / elapsed / 1e6);
+    return 0;
+}
+
+// ==================== CORRIDAS CON REGISTRO (programa run) ====================
+// programa run --ledger ARCHIVO --method M --points N [--mode ...] [--workers W]
+// Crea el registro si no existe; si existe, retoma lo que falte. Con un
+// --points mayor que el ya pedido solo se cuentan las muestras nuevas. La
+// semilla, el generador, el muestreo, la precision y la geometria los fija
+// el registro. Con --mode auto el perfil de 'programa tune' elige modo y
+// workers para las muestras que faltan; con --mode hybrid corren --workers
+// procesos de --team hilos.
+static int mc_is_stream_option(const char* name) {
+    return strcmp(name, "--seed") == 0 || strcmp(name, "--rng") == 0 ||
+           strcmp(name, "--sampling") == 0 || strcmp(name, "--precision") == 0 ||
+           strcmp(name, "--needle-length") == 0 || strcmp(name, "--line-spacing") == 0;
+}
+
+int run_with_ledger(int argc, char* argv[]) {
+    const char* path = NULL;
+    int method = 1;
+    int mode = MC_MODE_THREADS;
+    int workers = mc_cpu_count();
+    int team = 1;
+    long long points = 0;
+    double flush_every = MC_LEDGER_FLUSH;
+    int explicit_stream = 0;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--ledger") == 0) {
+            path = value;
+            ok = strlen(value) < MC_PATH_MAX;
+        } else if (strcmp(name, "--points") == 0) {
+            points = (long long)strtod(value, NULL);
+            ok = points > 0;
+        } else if (strcmp(name, "--method") == 0) {
+            method = mc_method_from_name(value);
+            ok = method > 0;
+        } else if (strcmp(name, "--mode") == 0) {
+            mode = strcmp(value, "auto") == 0 ? MC_MODE_AUTO : -1;
+            for (int m = 0; m < MC_MODE_COUNT; m++) {
+                if (strcmp(value, mc_mode_names[m]) == 0) mode = m;
+            }
+            ok = mode >= 0;
+        } else if (strcmp(name, "--workers") == 0) {
+            workers = atoi(value);
+            ok = workers > 0;
+        } else if (strcmp(name, "--team") == 0) {
+            team = atoi(value);
+            ok = team > 0 && team <= MC_MAX_POOL;
+        } else if (strcmp(name, "--flush") == 0) {
+            flush_every = strtod(value, NULL);
+            ok = flush_every > 0.0;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                fprintf(stderr, "Uso: programa run --ledger ARCHIVO [--points N] "
+                                "[--method dartboard|needles|ball3|ball4|arctan]\n"
+                                "               [--mode serial|threads|processes|hybrid|auto] "
+                                "[--workers W] [--team T] [--flush S]\n"
+                                "               [--seed N] [--rng R] [--sampling S] [--precision P] "
+                                "[--needle-length L]\n"
+                                "               [--line-spacing D] [--placement P] [--progress S] "
+                                "[--profile ARCHIVO]\n");
+                return 1;
+            }
+            explicit_stream |= mc_is_stream_option(name);
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            return 1;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "Falta --ledger ARCHIVO\n");
+        return 1;
+    }
+    if (g_replay != NULL) {
+        fprintf(stderr, "--replay no se combina con --ledger: el registro sigue el flujo de los generadores\n");
+        return 1;
+    }
+
+    mc_ledger_t lg;
+    mc_params_t session = mc_make_params(method);
+    int created;
+    if (mc_ledger_open(&lg, path, &session, 1, &created) != 0) return 1;
+    if (mc_file_lock(&lg.map) != 0) {
+        fprintf(stderr, "El registro %s esta en uso por otra corrida\n", path);
+        mc_file_unmap(&lg.map);
+        return 1;
+    }
+
+    // El registro manda: una opcion distinta cambiaria las muestras ya contadas
+    mc_params_t params = mc_ledger_params(&lg, method);
+    if (!created && explicit_stream &&
+        (params.seed != session.seed || params.rng != session.rng ||
+         params.sampling != session.sampling || params.precision != session.precision ||
+         params.needle_length != session.needle_length ||
+         params.line_spacing != session.line_spacing)) {
+        fprintf(stderr, "El registro %s usa semilla %llu, %s, %s, %s, L = %g, D = %g; "
+                        "no se puede cambiar\n", path, params.seed, mc_rng_names[params.rng],
+                mc_sampling_names[params.sampling], mc_precision_names[params.precision],
+                params.needle_length, params.line_spacing);
+        mc_ledger_close(&lg);
+        return 1;
+    }
+    g_seed = params.seed;
+    g_rng = params.rng;
+    g_sampling = params.sampling;
+    g_precision = params.precision;
+    g_needle_length = params.needle_length;
+    g_line_spacing = params.line_spacing;
+
+    long long target, done, hits;
+    mc_ledger_progress(&lg, method, &target, &done, &hits);
+    if (target == 0 && points == 0) {
+        fprintf(stderr, "El registro no tiene muestras de %s: indique --points\n",
+                mc_method_names[method]);
+        mc_ledger_close(&lg);
+        return 1;
+    }
+    printf("Registro %s (%s): generador %s, muestreo %s, precision %s, semilla %llu\n",
+           path, created ? "nuevo" : "existente", mc_rng_names[params.rng],
+           mc_sampling_names[params.sampling], mc_precision_names[mc_effective_precision(&params)],
+           params.seed);
+    printf("%s: %lld de %lld muestras contadas\n", mc_method_names[method], done, target);
+    if (points > target) {
+        if (target > 0) printf("Extendiendo de %lld a %lld muestras\n", target, points);
+        if (mc_ledger_extend(&lg, method, points) != 0) {
+            mc_ledger_close(&lg);
+            return 1;
+        }
+        target = points;
+    } else if (points > 0 && points < target) {
+        printf("El registro ya pide %lld muestras; se completan esas\n", target);
+    }
+
+    long long before = done;
+    double elapsed = 0.0;
+    if (done < target) {
+        lg.flush_every = flush_every;
+        lg.next_flush = (long long)mc_tick_count() + (long long)(flush_every * 1000.0);
+        if (mode == MC_MODE_AUTO) {
+            mc_auto_choice_t c = mc_auto_pick(&params, target - done);
+            mode = c.mode;
+            workers = c.workers;
+            printf("Automatico: %s con %d workers\n", mc_mode_names[mode], workers);
+        }
+        g_ledger = &lg;
+        mc_run_t run = mc_bench_once(mode, method, workers, team, target);
+        g_ledger = NULL;
+        elapsed = run.elapsed;
+        mc_ledger_progress(&lg, method, &target, &done, &hits);
+    }
+
+    double pi = mc_estimate_pi(&params, hits, done);
+    // El tiempo es solo el de esta corrida: el ritmo va sobre las muestras nuevas
+    print_results(pi, 3.14159265358979323846, done - before, elapsed, "REGISTRO");
+    printf("Muestras en el registro: %lld (%lld nuevas en esta corrida)\n", done, done - before);
+    if (done < target) printf("Quedan %lld muestras pendientes\n", target - done);
+    mc_ledger_close(&lg);
+    return done < target;
+}
+
+// ==================== MODO DISTRIBUIDO (TCP) ====================
+// Un coordinador reparte rangos de muestras [first, first + count) a workers
+// que se conectan por TCP, posiblemente desde otras maquinas:
+//
+//   programa coordinator --points N --method dartboard|needles|... [--port P]
+//                        [--chunk M] [--timeout S] [opciones de sesion]
+//   programa worker --host H [--port P] [--threads T] [--once]
+//
+// Como cada muestra depende solo de (parametros, indice), un rango da la
+// misma cuenta en cualquier worker: si un worker se desconecta o no responde
+// en --timeout segundos, su rango vuelve a la cola y lo toma otro, y el
+// resultado final es identico al de la version serial. Los workers pueden
+// sumarse en cualquier momento y procesan cada rango con el pool de threads
+// local y los mismos kernels.
+//
+// Protocolo de texto, una linea por mensaje:
+//   worker -> coordinador:  HELLO <threads>
+//                           RESULT <rango> <aciertos> <puntos>
+//   coordinador -> worker:  JOB <rango> <first> <count> <method> <rng> <sampling>
+//                               <precision> <seed> <needle_length> <line_spacing>
+//                           BYE
+#define MC_NET_PORT 5555
+#define MC_NET_LINE 512
+#define MC_NET_MAX_NODES 60        // select() de Winsock admite 64 sockets
+#define MC_NET_TIMEOUT 60.0
+#define MC_NET_RANGES 64           // rangos por defecto (unos 64 por estimacion)
+
+enum { MC_RANGE_PENDING = 0, MC_RANGE_ASSIGNED, MC_RANGE_DONE };
+
+typedef struct {
+    mc_socket_t sock;
+    char buf[MC_NET_LINE];
+    int len;
+} mc_conn_t;
+
+typedef struct {
+    mc_conn_t conn;
+    char peer[64];
+    int threads;              // 0 hasta recibir HELLO
+    long long range;          // rango asignado (-1 = ninguno)
+    double assigned_at;
+    long long ranges_done;
+} mc_node_t;
+
+typedef struct {
+    long long first;
+    long long count;
+    long long hits;
+    int state;
+} mc_range_t;
+
+// Lee lo que haya en el socket: bytes leidos, 0 si se cerro, -1 en error
+static int mc_conn_fill(mc_conn_t* c) {
+    if (c->len >= MC_NET_LINE - 1) return -1;   // linea demasiado larga
+    int r = mc_socket_recv(c->sock, c->buf + c->len, MC_NET_LINE - 1 - c->len);
+    if (r > 0) c->len += r;
+    return r;
+}
+
+// Saca una linea completa del buffer (sin '\n'); 1 si habia una
+static int mc_conn_take_line(mc_conn_t* c, char* line, int size) {
+    for (int i = 0; i < c->len; i++) {
+        if (c->buf[i] != '\n') continue;
+        int n = i < size - 1 ? i : size - 1;
+        memcpy(line, c->buf, n);
+        line[n] = '\0';
+        if (n > 0 && line[n - 1] == '\r') line[n - 1] = '\0';
+        memmove(c->buf, c->buf + i + 1, c->len - i - 1);
+        c->len -= i + 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Bloqueante: espera hasta tener una linea; -1 si la conexion se corto
+static int mc_conn_read_line(mc_conn_t* c, char* line, int size) {
+    while (!mc_conn_take_line(c, line, size)) {
+        if (mc_conn_fill(c) <= 0) return -1;
+    }
+    return 0;
+}
+
+static int mc_conn_send(mc_conn_t* c, const char* line) {
+    return mc_socket_send_all(c->sock, line, (int)strlen(line));
+}
+
+// ---------- Worker ----------
+int run_as_net_worker(int argc, char* argv[]) {
+    const char* host = "127.0.0.1";
+    int port = MC_NET_PORT;
+    int threads = mc_cpu_count();
+    int once = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--once") == 0) {
+            once = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", argv[i]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--host") == 0) host = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0) port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--placement") == 0) {
+            if (mc_session_option(argv[i], argv[i + 1]) != 0) return 1;
+            i++;
+        } else {
+            fprintf(stderr, "Opcion desconocida: %s\n", argv[i]);
+            fprintf(stderr, "Uso: programa worker [--host H] [--port P] [--threads T] "
+                            "[--placement P] [--once]\n");
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MC_MAX_POOL) threads = MC_MAX_POOL;
+    if (mc_net_init() != 0) {
+        fprintf(stderr, "Error iniciando sockets: %lu\n", mc_net_error());
+        return 1;
+    }
+    mc_pool_ensure(threads);
+
+    // Como demonio: al terminar una estimacion vuelve a esperar al coordinador
+    for (;;) {
+        mc_conn_t conn;
+        char line[MC_NET_LINE];
+        int waiting = 0;
+
+        memset(&conn, 0, sizeof(conn));
+        while ((conn.sock = mc_tcp_connect(host, port)) == MC_INVALID_SOCKET) {
+            if (!waiting) printf("Esperando al coordinador en %s:%d...\n", host, port);
+            waiting = 1;
+            mc_sleep_ms(1000);
+        }
+        printf("Conectado a %s:%d con %d hilos\n", host, port, threads);
+        snprintf(line, sizeof(line), "HELLO %d\n", threads);
+        mc_conn_send(&conn, line);
+
+        while (mc_conn_read_line(&conn, line, sizeof(line)) == 0) {
+            mc_params_t params;
+            long long id, first, count;
+
+            if (strcmp(line, "BYE") == 0) break;
+            memset(&params, 0, sizeof(params));
+            if (sscanf(line, "JOB %lld %lld %lld %d %d %d %d %llu %lf %lf", &id, &first, &count,
+                       &params.method, &params.rng, &params.sampling, &params.precision,
+                       &params.seed, &params.needle_length, &params.line_spacing) != 10 ||
+                first < 0 || count <= 0 || !mc_method_valid(params.method) ||
+                params.rng < 0 || params.rng >= MC_RNG_COUNT ||
+                params.sampling < 0 || params.sampling >= MC_SAMPLING_COUNT ||
+                params.precision < 0 || params.precision >= MC_PREC_COUNT ||
+                !(params.needle_length > 0.0) || !(params.line_spacing > 0.0)) {
+                fprintf(stderr, "Mensaje invalido del coordinador: %s\n", line);
+                break;
+            }
+
+            double start = mc_now();
+            long long hits = mc_pool_count(&params, first, count, threads);
+            printf("Rango %lld: %lld puntos desde %lld, %lld aciertos (%.3f s)\n",
+                   id, count, first, hits, mc_now() - start);
+
+            snprintf(line, sizeof(line), "RESULT %lld %lld %lld\n", id, hits, count);
+            if (mc_conn_send(&conn, line) != 0) break;
+        }
+        mc_socket_close(conn.sock);
+        printf("Desconectado del coordinador\n");
+        if (once) return 0;
+    }
+}
+
+// ---------- Coordinador ----------
+static void mc_node_drop(mc_node_t* node, mc_range_t* ranges, long long* next_pending,
+                         long long* reassigned, const char* reason) {
+    printf("Worker %s desconectado (%s)", node->peer, reason);
+    if (node->range >= 0) {
+        ranges[node->range].state = MC_RANGE_PENDING;
+        if (node->range < *next_pending) *next_pending = node->range;
+        printf(", rango %lld vuelve a la cola", node->range);
+        (*reassigned)++;
+    }
+    printf("\n");
+    mc_socket_close(node->conn.sock);
+    node->conn.sock = MC_INVALID_SOCKET;
+    node->range = -1;
+}
+
+int run_as_coordinator(int argc, char* argv[]) {
+    int port = MC_NET_PORT;
+    int method = 1;
+    long long total_points = 100000000;
+    long long chunk = 0;
+    double timeout = MC_NET_TIMEOUT;
+    mc_node_t nodes[MC_NET_MAX_NODES];
+    int num_nodes = 0;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--port") == 0) {
+            port = atoi(value);
+            ok = port > 0 && port < 65536;
+        } else if (strcmp(name, "--points") == 0) {
+            total_points = (long long)strtod(value, NULL);
+            ok = total_points > 0;
+        } else if (strcmp(name, "--chunk") == 0) {
+            chunk = (long long)strtod(value, NULL);
+            ok = chunk > 0;
+        } else if (strcmp(name, "--method") == 0) {
+            method = mc_method_from_name(value);
+            ok = method > 0;
+        } else if (strcmp(name, "--timeout") == 0) {
+            timeout = strtod(value, NULL);
+            ok = timeout > 0.0;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                fprintf(stderr, "Uso: programa coordinator [--points N] [--method dartboard|needles|ball3|ball4|arctan] "
+                                "[--port P] [--chunk M] [--timeout S] [--seed N] [--rng R] "
+                                "[--sampling S] [--precision P] [--needle-length L] [--line-spacing D]\n");
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            return 1;
+        }
+    }
+
+    if (chunk == 0) {
+        chunk = (total_points + MC_NET_RANGES - 1) / MC_NET_RANGES;
+        chunk = (chunk + MC_BATCH - 1) / MC_BATCH * MC_BATCH;
+    }
+    long long num_ranges = (total_points + chunk - 1) / chunk;
+    mc_range_t* ranges = (mc_range_t*)calloc(num_ranges, sizeof(mc_range_t));
+    if (ranges == NULL) {
+        fprintf(stderr, "Sin memoria para %lld rangos\n", num_ranges);
+        return 1;
+    }
+    for (long long r = 0; r < num_ranges; r++) {
+        ranges[r].first = r * chunk;
+        ranges[r].count = total_points - ranges[r].first < chunk ? total_points - ranges[r].first : chunk;
+    }
+
+    if (mc_net_init() != 0) {
+        fprintf(stderr, "Error iniciando sockets: %lu\n", mc_net_error());
+        return 1;
+    }
+    mc_socket_t listener = mc_tcp_listen(port);
+    if (listener == MC_INVALID_SOCKET) {
+        fprintf(stderr, "Error escuchando en el puerto %d: %lu\n", port, mc_net_error());
+        return 1;
+    }
+
+    mc_params_t params = mc_make_params(method);
+    printf("Coordinador en el puerto %d: %s, %lld puntos en %lld rangos de %lld\n",
+           port, mc_method_names[method], total_points, num_ranges, chunk);
+    printf("Generador: %s, muestreo: %s, precision: %s, semilla: %llu\n",
+           mc_rng_names[params.rng], mc_sampling_names[params.sampling],
+           mc_precision_names[mc_effective_precision(&params)], params.seed);
+
+    long long done = 0, next_pending = 0, reassigned = 0;
+    double start = 0.0;
+
+    while (done < num_ranges) {
+        mc_socket_t socks[MC_NET_MAX_NODES + 1];
+        int ready[MC_NET_MAX_NODES + 1];
+        char line[MC_NET_LINE];
+
+        socks[0] = listener;
+        for (int i = 0; i < num_nodes; i++) socks[i + 1] = nodes[i].conn.sock;
+        mc_socket_poll(socks, num_nodes + 1, ready, 100);
+
+        // Nuevos workers (se reutilizan los lugares de los desconectados)
+        if (ready[0]) {
+            char peer[64];
+            mc_socket_t s = mc_tcp_accept(listener, peer, sizeof(peer));
+            int slot = -1;
+            for (int i = 0; i < num_nodes && slot < 0; i++) {
+                if (nodes[i].conn.sock == MC_INVALID_SOCKET) slot = i;
+            }
+            if (slot < 0 && num_nodes < MC_NET_MAX_NODES) slot = num_nodes++;
+            if (s != MC_INVALID_SOCKET && slot < 0) {
+                mc_socket_close(s);
+            } else if (s != MC_INVALID_SOCKET) {
+                memset(&nodes[slot], 0, sizeof(nodes[slot]));
+                nodes[slot].conn.sock = s;
+                nodes[slot].range = -1;
+                snprintf(nodes[slot].peer, sizeof(nodes[slot].peer), "%s", peer);
+                printf("Worker %s conectado\n", peer);
+            }
+        }
+
+        // Mensajes de los workers
+        for (int i = 0; i < num_nodes; i++) {
+            mc_node_t* node = &nodes[i];
+            if (!ready[i + 1] || node->conn.sock == MC_INVALID_SOCKET) continue;
+            if (mc_conn_fill(&node->conn) <= 0) {
+                mc_node_drop(node, ranges, &next_pending, &reassigned, "conexion cerrada");
+                continue;
+            }
+            while (node->conn.sock != MC_INVALID_SOCKET &&
+                   mc_conn_take_line(&node->conn, line, sizeof(line))) {
+                long long id, hits, points;
+                int threads;
+                if (sscanf(line, "HELLO %d", &threads) == 1 && threads > 0) {
+                    node->threads = threads;
+                } else if (sscanf(line, "RESULT %lld %lld %lld", &id, &hits, &points) == 3 &&
+                           id == node->range && ranges[id].state == MC_RANGE_ASSIGNED &&
+                           points == ranges[id].count) {
+                    ranges[id].hits = hits;
+                    ranges[id].state = MC_RANGE_DONE;
+                    node->range = -1;
+                    node->ranges_done++;
+                    done++;
+                } else {
+                    mc_node_drop(node, ranges, &next_pending, &reassigned, "mensaje invalido");
+                }
+            }
+        }
+
+        // Rangos vencidos y asignacion de trabajo a los workers libres
+        double now = mc_now();
+        for (int i = 0; i < num_nodes; i++) {
+            mc_node_t* node = &nodes[i];
+            if (node->conn.sock == MC_INVALID_SOCKET || node->threads == 0) continue;
+            if (node->range >= 0) {
+                if (now - node->assigned_at > timeout) {
+                    mc_node_drop(node, ranges, &next_pending, &reassigned, "sin respuesta");
+                }
+                continue;
+            }
+            while (next_pending < num_ranges && ranges[next_pending].state != MC_RANGE_PENDING) {
+                next_pending++;
+            }
+            if (next_pending >= num_ranges) continue;
+
+            mc_range_t* range = &ranges[next_pending];
+            snprintf(line, sizeof(line), "JOB %lld %lld %lld %d %d %d %d %llu %.17g %.17g\n",
+                     next_pending, range->first, range->count, params.method, params.rng,
+                     params.sampling, params.precision, params.seed, params.needle_length,
+                     params.line_spacing);
+            if (start == 0.0) start = now;
+            node->range = next_pending;
+            node->assigned_at = now;
+            range->state = MC_RANGE_ASSIGNED;
+            if (mc_conn_send(&node->conn, line) != 0) {
+                mc_node_drop(node, ranges, &next_pending, &reassigned, "error de envio");
+            }
+        }
+    }
+    double elapsed = mc_now() - start;
+
+    // Reduccion y despedida
+    long long total_hits = 0;
+    for (long long r = 0; r < num_ranges; r++) total_hits += ranges[r].hits;
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i].conn.sock == MC_INVALID_SOCKET) continue;
+        printf("Worker %s: %lld rangos (%d hilos)\n", nodes[i].peer, nodes[i].ranges_done, nodes[i].threads);
+        mc_conn_send(&nodes[i].conn, "BYE\n");
+        mc_socket_close(nodes[i].conn.sock);
+    }
+    mc_socket_close(listener);
+    free(ranges);
+
+    double pi_estimate = mc_estimate_pi(&params, total_hits, total_points);
+    printf("Rangos reasignados: %lld\n", reassigned);
+    printf("Puntos dentro/cruces: %lld de %lld\n", total_hits, total_points);
+    print_results(pi_estimate, 3.14159265358979323846, total_points, elapsed, "DISTRIBUIDO");
+    return 0;
+}
+
+// ==================== SERVICIO LOCAL (programa serve) ====================
+// Demonio que recibe pedidos de estimacion por un socket local, para que
+// otros programas usen el motor sin pasar por el menu:
+//
+//   programa serve [--socket RUTA] [--threads T] [--processes P] [--slice S]
+//                  [--cache N] [opciones de sesion]
+//
+// Protocolo de texto, una linea por mensaje. El cliente elige el <id> de
+// cada pedido y puede tener muchos en curso a la vez:
+//   cliente -> servicio:  ESTIMATE <id> <metodo> <puntos> <error> <semilla> <modo>
+//                                  [--workers W] [--progress S] [--confidence C]
+//                                  [--rng R] [--sampling S] [--precision P]
+//                                  [--needle-length L] [--line-spacing D]
+//                         CANCEL <id>
+//                         STATS
+//   servicio -> cliente:  PROGRESS <id> <puntos> <aciertos> <pi> <semiancho>
+//                         RESULT <id> <pi> <semiancho> <aciertos> <puntos> <de_cache> <segundos>
+//                                <alcanzado>
+//                         ERROR <id> <motivo>
+//                         STATS <clientes> <pedidos_activos> <entradas_cache> <pedidos>
+//                               <servidos_de_cache> <muestras_contadas> <muestras_reutilizadas>
+//
+// Con <error> = 0 se cuentan exactamente <puntos> muestras; con <error> > 0
+// se avanza por las mismas rondas que el modo adaptativo hasta que el
+// semiancho al nivel --confidence (0.95) queda por debajo del error, con
+// <puntos> como tope (0 = sin tope; con --replay, el largo del flujo). Un
+// pedido que no cabe en el flujo grabado se responde con ERROR
+// flujo_insuficiente. <alcanzado> es 1 si el semiancho quedo
+// por debajo del error y 0 si el pedido se corto en el tope (con <error> = 0
+// siempre es 1: se contaron los puntos pedidos). <modo> es serial, threads, processes o
+// auto (modo y workers del perfil de 'programa tune' para <puntos>).
+//
+// Los pedidos en curso comparten un solo pool de threads y uno de procesos:
+// el servicio les da turnos de --slice segundos de computo, rotando entre
+// clientes y, dentro de cada cliente, entre sus pedidos, asi un cliente con
+// cientos de pedidos no deja esperando a los demas. Como cada muestra
+// depende solo de (parametros, indice), los turnos no cambian el resultado.
+//
+// Cache: por cada (metodo, parametros del flujo, semilla) se guardan los
+// aciertos de los prefijos [0, n) ya contados. Un pedido igual a uno anterior
+// se responde sin contar nada y uno mas grande arranca desde el prefijo mas
+// largo que tenga guardado. Las cuentas de prefijos mas cortos no se pueden
+// deducir de uno largo, asi que un pedido menor se cuenta de nuevo.
+#ifdef _WIN32
+#define MC_SERVE_SOCKET "montecarlo.sock"
+#else
+#define MC_SERVE_SOCKET "/tmp/montecarlo.sock"
+#endif
+#define MC_SERVE_MAX_CLIENTS 60    // select() de Winsock admite 64 sockets
+#define MC_SERVE_MAX_JOBS 1024
+#define MC_SERVE_CACHE 4096
+#define MC_SERVE_SLICE 0.02
+#define MC_SERVE_FIRST_SLICE MC_BLOCK_POINTS
+#define MC_SERVE_ID 64
+#define MC_SERVE_MAX_ARGS 32
+
+typedef struct {
+    char id[MC_SERVE_ID];         // elegido por el cliente
+    int client;
+    int mode;
+    int workers;
+    mc_params_t params;
+    long long max_points;         // puntos pedidos, o tope del modo error (0 = sin tope)
+    double target_error;          // 0 = puntos fijos
+    double z;
+    double progress_every;
+    long long points;             // prefijo [0, points) ya contado
+    long long hits;
+    long long cached;             // muestras que vinieron de la cache
+    long long round_end;          // proximo punto de control
+    double start;
+    double next_report;
+    unsigned long long turn;      // ultimo turno atendido
+    int active;
+} mc_serve_job_t;
+
+typedef struct {
+    mc_params_t params;
+    long long points;
+    long long hits;
+    unsigned long long used;      // 0 = libre; si no, orden del ultimo uso
+} mc_serve_entry_t;
+
+typedef struct {
+    mc_conn_t conns[MC_SERVE_MAX_CLIENTS];
+    int num_clients;
+    mc_serve_job_t jobs[MC_SERVE_MAX_JOBS];
+    int num_jobs;                 // pedidos activos
+    mc_serve_entry_t* cache;
+    int cache_size;
+    unsigned long long clock;     // contador de usos de la cache
+    unsigned long long turn;
+    int next_client;
+    int threads;
+    int processes;
+    double slice;
+    double rate[MC_MODE_COUNT][MC_METHOD_COUNT];   // muestras/s medidas por turno
+    long long requests, cache_hits, counted, reused;
+} mc_serve_t;
+
+static volatile sig_atomic_t g_serve_stop = 0;
+
+static void mc_serve_on_signal(int sig) {
+    (void)sig;
+    g_serve_stop = 1;
+}
+
+static int mc_params_equal(const mc_params_t* a, const mc_params_t* b) {
+    return a->method == b->method && a->rng == b->rng && a->sampling == b->sampling &&
+           a->precision == b->precision && a->seed == b->seed &&
+           a->needle_length == b->needle_length && a->line_spacing == b->line_spacing;
+}
+
+// Prefijo guardado mas largo de estos parametros con a lo sumo 'limit' puntos
+static mc_serve_entry_t* mc_serve_cache_find(mc_serve_t* sv, const mc_params_t* p, long long limit) {
+    mc_serve_entry_t* best = NULL;
+    for (int i = 0; i < sv->cache_size; i++) {
+        mc_serve_entry_t* e = &sv->cache[i];
+        if (e->used == 0 || e->points > limit || !mc_params_equal(&e->params, p)) continue;
+        if (best == NULL || e->points > best->points) best = e;
+    }
+    if (best != NULL) best->used = ++sv->clock;
+    return best;
+}
 
-// ==================== CONFIGURACIÓN ====================
-#define MAX_THREADS 16
-#define MAX_PROCESSES 16
-#define MAP_NAME_MAX 256
+// Guarda el prefijo [0, points); si la cache esta llena reemplaza el menos usado
+static void mc_serve_cache_store(mc_serve_t* sv, const mc_params_t* p, long long points, long long hits) {
+    mc_serve_entry_t* slot = NULL;
+    if (points <= 0) return;
+    for (int i = 0; i < sv->cache_size; i++) {
+        mc_serve_entry_t* e = &sv->cache[i];
+        if (e->used != 0 && e->points == points && mc_params_equal(&e->params, p)) {
+            e->used = ++sv->clock;
+            return;
+        }
+        if (slot == NULL || e->used < slot->used) slot = e;
+    }
+    slot->params = *p;
+    slot->points = points;
+    slot->hits = hits;
+    slot->used = ++sv->clock;
+}
 
-// ==================== ESTRUCTURAS DE DATOS ====================
-typedef struct {
-    long long points_per_thread;
-    long long points_inside;
-    unsigned int seed;
-    int thread_id;
-    int method;
-} thread_data_t;
+static void mc_serve_send(mc_serve_t* sv, int client, const char* line);
 
-typedef struct {
-    long long total_points;
-    volatile long long points_inside;
-    int num_workers;
-    int method;
-    double needle_length;
-    double line_spacing;
-    char mutex_name[64]; // Compartimos el nombre del mutex, NO el HANDLE
-} shared_data_t;
+static void mc_serve_error(mc_serve_t* sv, int client, const char* id, const char* reason) {
+    char line[MC_NET_LINE];
+    snprintf(line, sizeof(line), "ERROR %s %s\n", id, reason);
+    mc_serve_send(sv, client, line);
+}
 
-// ==================== GENERACIÓN DE NÚMEROS ALEATORIOS THREAD-SAFE ====================
-unsigned int rand_win(unsigned int* seed) {
-    *seed = (*seed * 1103515245u + 12345u) & 0x7FFFFFFFu;
-    return *seed;
+// Cierra el pedido: guarda lo contado en la cache y, si 'reason' es NULL,
+// envia el resultado
+static void mc_serve_finish(mc_serve_t* sv, mc_serve_job_t* job, const char* reason) {
+    char line[MC_NET_LINE];
+    double pi = mc_estimate_pi(&job->params, job->hits, job->points);
+    double half = mc_half_width(&job->params, job->hits, job->points, job->z);
+    double elapsed = mc_now() - job->start;
+    int reached = job->target_error <= 0.0 || half <= job->target_error;
+
+    mc_serve_cache_store(sv, &job->params, job->points, job->hits);
+    job->active = 0;
+    sv->num_jobs--;
+    if (reason != NULL) {
+        mc_serve_error(sv, job->client, job->id, reason);
+        return;
+    }
+    printf("Pedido %s: %s/%s, %lld puntos (%lld de cache), pi = %.10f, %.3f s%s\n", job->id,
+           mc_method_names[job->params.method], mc_mode_names[job->mode], job->points,
+           job->cached, pi, elapsed, reached ? "" : ", error no alcanzado (tope de puntos)");
+    snprintf(line, sizeof(line), "RESULT %s %.17g %.6g %lld %lld %lld %.6f %d\n", job->id, pi, half,
+             job->hits, job->points, job->cached, elapsed, reached);
+    mc_serve_send(sv, job->client, line);
 }
 
-double rand_double_win(unsigned int* seed) {
-    return (double)rand_win(seed) / (double)0x7FFFFFFF;
+// Cierra la conexion y cancela sus pedidos; lo ya contado queda en la cache
+static void mc_serve_drop(mc_serve_t* sv, int client) {
+    for (int j = 0; j < MC_SERVE_MAX_JOBS; j++) {
+        mc_serve_job_t* job = &sv->jobs[j];
+        if (!job->active || job->client != client) continue;
+        mc_serve_cache_store(sv, &job->params, job->points, job->hits);
+        job->active = 0;
+        sv->num_jobs--;
+    }
+    mc_socket_close(sv->conns[client].sock);
+    sv->conns[client].sock = MC_INVALID_SOCKET;
+    sv->conns[client].len = 0;
 }
 
-// ==================== ALGORITMO DARTBOARD ====================
-DWORD WINAPI dartboard_thread_worker(LPVOID lpParam) {
-    thread_data_t* data = (thread_data_t*)lpParam;
-    data->points_inside = 0;
-    
-    for (long long i = 0; i < data->points_per_thread; i++) {
-        double x = rand_double_win(&data->seed);
-        double y = rand_double_win(&data->seed);
-        
-        if (x * x + y * y <= 1.0) {
-            data->points_inside++;
-        }
+static void mc_serve_send(mc_serve_t* sv, int client, const char* line) {
+    if (sv->conns[client].sock == MC_INVALID_SOCKET) return;
+    if (mc_conn_send(&sv->conns[client], line) != 0) mc_serve_drop(sv, client);
+}
+
+// Llego a un punto de control: decide si termina o hasta donde sigue.
+// Con error objetivo los puntos de control son los fines de ronda del modo
+// adaptativo, asi el resultado no depende de los turnos.
+static void mc_serve_checkpoint(mc_serve_t* sv, mc_serve_job_t* job) {
+    if (job->target_error <= 0.0) {
+        if (job->points >= job->max_points) mc_serve_finish(sv, job, NULL);
+        return;
     }
-    
-    printf("Hilo %d completado: %lld puntos dentro de %lld\n", 
-           data->thread_id, data->points_inside, data->points_per_thread);
-    
-    return 0;
+    if (mc_half_width(&job->params, job->hits, job->points, job->z) <= job->target_error ||
+        (job->max_points > 0 && job->points >= job->max_points)) {
+        mc_serve_finish(sv, job, NULL);
+        return;
+    }
+    job->round_end = job->points + mc_adapt_next_round(&job->params, job->hits, job->points,
+                                                       job->target_error, job->z);
+    if (job->max_points > 0 && job->round_end > job->max_points) job->round_end = job->max_points;
 }
 
-// Nota: ahora recibimos HANDLE hMutexLocal para sincronizar localmente
-void dartboard_process_worker(int worker_id, shared_data_t* shared, HANDLE hMutexLocal) {
-    unsigned int seed = GetCurrentProcessId() ^ GetTickCount() ^ worker_id;
-    long long local_inside = 0;
-    long long points_per_process = shared->total_points / shared->num_workers;
-    
-    for (long long i = 0; i < points_per_process; i++) {
-        double x = rand_double_win(&seed);
-        double y = rand_double_win(&seed);
-        
-        if (x * x + y * y <= 1.0) {
-            local_inside++;
-        }
+// Un turno: cuenta el tramo siguiente del pedido con su motor
+static void mc_serve_slice(mc_serve_t* sv, mc_serve_job_t* job) {
+    double* rate = &sv->rate[job->mode][job->params.method];
+    long long n = *rate > 0.0 ? (long long)(*rate * sv->slice) : MC_SERVE_FIRST_SLICE;
+    long long hits;
+    char line[MC_NET_LINE];
+
+    n = (n + MC_BATCH - 1) / MC_BATCH * MC_BATCH;
+    if (n < MC_BATCH) n = MC_BATCH;
+    if (n > job->round_end - job->points) n = job->round_end - job->points;
+
+    double start = mc_now();
+    if (job->mode == MC_MODE_SERIAL) {
+        hits = mc_count_range(&job->params, job->points, n);
+    } else if (job->mode == MC_MODE_THREADS) {
+        hits = mc_pool_count(&job->params, job->points, n, job->workers);
+    } else {
+        mc_run_t run = mc_processes_run(&job->params, job->points, n, job->workers, 1);
+        hits = run.hits;
+    }
+    double elapsed = mc_now() - start;
+    if (elapsed > 0.0) *rate = (double)n / elapsed;
+
+    job->points += n;
+    job->hits += hits;
+    job->turn = ++sv->turn;
+    sv->counted += n;
+
+    if (job->points >= job->round_end) {
+        mc_serve_checkpoint(sv, job);
+        if (!job->active) return;
+    }
+    if (job->progress_every > 0.0 && mc_now() >= job->next_report) {
+        job->next_report = mc_now() + job->progress_every;
+        snprintf(line, sizeof(line), "PROGRESS %s %lld %lld %.17g %.6g\n", job->id, job->points,
+                 job->hits, mc_estimate_pi(&job->params, job->hits, job->points),
+                 mc_half_width(&job->params, job->hits, job->points, job->z));
+        mc_serve_send(sv, job->client, line);
     }
-    
-    // Sumar al contador compartido de forma sincronizada usando hMutexLocal
-    if (hMutexLocal) WaitForSingleObject(hMutexLocal, INFINITE);
-    shared->points_inside += local_inside;
-    if (hMutexLocal) ReleaseMutex(hMutexLocal);
-    
-    printf("Proceso %d (PID %lu): %lld puntos dentro\n", 
-           worker_id, GetCurrentProcessId(), local_inside);
 }
 
-// ==================== ALGORITMO NEEDLES ====================
-DWORD WINAPI needles_thread_worker(LPVOID lpParam) {
-    thread_data_t* data = (thread_data_t*)lpParam;
-    data->points_inside = 0;
-    
-    for (long long i = 0; i < data->points_per_thread; i++) {
-        double center_y = rand_double_win(&data->seed) * 1.0; // line_spacing = 1.0
-        double angle = rand_double_win(&data->seed) * 3.14159265358979323846;
-        
-        double half_length = 0.5; // needle_length = 1.0
-        double y_min = center_y - half_length * sin(angle);
-        double y_max = center_y + half_length * sin(angle);
-        
-        if (y_min <= 0.0 || y_max >= 1.0) {
-            data->points_inside++;
+// Proximo pedido a atender: el primer cliente con pedidos a partir de
+// 'next_client' y, de ese cliente, el que hace mas turnos que no se atiende
+static mc_serve_job_t* mc_serve_pick(mc_serve_t* sv) {
+    mc_serve_job_t* best = NULL;
+    int best_dist = MC_SERVE_MAX_CLIENTS;
+
+    for (int j = 0; j < MC_SERVE_MAX_JOBS; j++) {
+        mc_serve_job_t* job = &sv->jobs[j];
+        if (!job->active) continue;
+        int dist = (job->client - sv->next_client + MC_SERVE_MAX_CLIENTS) % MC_SERVE_MAX_CLIENTS;
+        if (dist < best_dist || (dist == best_dist && job->turn < best->turn)) {
+            best = job;
+            best_dist = dist;
         }
     }
-    
-    printf("Hilo %d completado: %lld cruces de %lld\n", 
-           data->thread_id, data->points_inside, data->points_per_thread);
-    
-    return 0;
+    if (best != NULL) sv->next_client = (best->client + 1) % MC_SERVE_MAX_CLIENTS;
+    return best;
 }
 
-// Recibe hMutexLocal para usarlo en la sincronización
-void needles_process_worker(int worker_id, shared_data_t* shared, HANDLE hMutexLocal) {
-    unsigned int seed = GetCurrentProcessId() ^ GetTickCount() ^ worker_id;
-    long long local_crossings = 0;
-    long long needles_per_process = shared->total_points / shared->num_workers;
-    
-    for (long long i = 0; i < needles_per_process; i++) {
-        double center_y = rand_double_win(&seed) * shared->line_spacing;
-        double angle = rand_double_win(&seed) * 3.14159265358979323846;
-        
-        double half_length = shared->needle_length / 2.0;
-        double y_min = center_y - half_length * sin(angle);
-        double y_max = center_y + half_length * sin(angle);
-        
-        if (y_min <= 0.0 || y_max >= shared->line_spacing) {
-            local_crossings++;
+// Parametros del flujo de un pedido: los de la sesion con las opciones del
+// pedido encima, sin modificar los de la sesion
+static int mc_serve_params(int method, unsigned long long seed, char** opts, int n,
+                           mc_params_t* out) {
+    int rng = g_rng, sampling = g_sampling, precision = g_precision;
+    double needle_length = g_needle_length, line_spacing = g_line_spacing;
+    unsigned long long session_seed = g_seed;
+    int status = 0;
+
+    g_seed = seed;
+    for (int i = 0; i < n && status == 0; i += 2) status = mc_session_option(opts[i], opts[i + 1]);
+    *out = mc_make_params(method);
+    out->precision = mc_effective_precision(out);
+    g_rng = rng;
+    g_sampling = sampling;
+    g_precision = precision;
+    g_needle_length = needle_length;
+    g_line_spacing = line_spacing;
+    g_seed = session_seed;
+    return status;
+}
+
+// ESTIMATE <id> <metodo> <puntos> <error> <semilla> <modo> [opcion valor]...
+static void mc_serve_estimate(mc_serve_t* sv, int client, char** argv, int argc) {
+    char* stream_opts[MC_SERVE_MAX_ARGS];
+    int num_stream = 0;
+    const char* id = argc > 1 ? argv[1] : "-";
+    mc_serve_job_t* job = NULL;
+
+    if (argc < 7 || (argc - 7) % 2 != 0) {
+        mc_serve_error(sv, client, id, "faltan_campos");
+        return;
+    }
+    if (strlen(id) >= MC_SERVE_ID) {
+        mc_serve_error(sv, client, "-", "id_demasiado_largo");
+        return;
+    }
+    for (int j = 0; j < MC_SERVE_MAX_JOBS; j++) {
+        mc_serve_job_t* other = &sv->jobs[j];
+        if (other->active && other->client == client && strcmp(other->id, id) == 0) {
+            mc_serve_error(sv, client, id, "id_en_uso");
+            return;
         }
+        if (!other->active && job == NULL) job = other;
+    }
+    if (job == NULL) {
+        mc_serve_error(sv, client, id, "servicio_ocupado");
+        return;
     }
-    
-    // Sumar al contador compartido de forma sincronizada
-    if (hMutexLocal) WaitForSingleObject(hMutexLocal, INFINITE);
-    shared->points_inside += local_crossings;
-    if (hMutexLocal) ReleaseMutex(hMutexLocal);
-    
-    printf("Proceso %d (PID %lu): %lld cruces\n", 
-           worker_id, GetCurrentProcessId(), local_crossings);
-}
 
-// ==================== IMPLEMENTACIÓN CON THREADS (Windows API) ====================
-double parallel_threads_monte_carlo(long long total_points, int num_threads, int method) {
-    HANDLE threads[MAX_THREADS];
-    thread_data_t thread_data[MAX_THREADS];
-    long long points_per_thread = total_points / num_threads;
-    long long total_inside = 0;
-    
-    printf("\n=== INICIANDO THREADS (%d hilos, %lld puntos totales) ===\n", 
-           num_threads, total_points);
-    
-    LARGE_INTEGER freq, start, end;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&start);
-    
-    // Crear threads
-    for (int i = 0; i < num_threads; i++) {
-        thread_data[i].points_per_thread = points_per_thread;
-        thread_data[i].seed = GetTickCount() ^ (i + 1) ^ GetCurrentThreadId();
-        thread_data[i].thread_id = i;
-        thread_data[i].method = method;
-        
-        if (method == 1) {
-            threads[i] = CreateThread(NULL, 0, dartboard_thread_worker, &thread_data[i], 0, NULL);
+    int method = mc_method_from_name(argv[2]);
+    double points = strtod(argv[3], NULL);
+    double target_error = strtod(argv[4], NULL);
+    unsigned long long seed = strtoull(argv[5], NULL, 0);
+    int mode = strcmp(argv[6], "auto") == 0 ? MC_MODE_AUTO : -1;
+    for (int m = MC_MODE_SERIAL; m <= MC_MODE_PROCESSES; m++) {
+        if (strcmp(argv[6], mc_mode_names[m]) == 0) mode = m;
+    }
+    if (method <= 0 || mode < 0 || !(points >= 0.0 && points < 9e18) ||
+        !(target_error >= 0.0) || (points < 1.0 && target_error == 0.0)) {
+        mc_serve_error(sv, client, id, "parametros_invalidos");
+        return;
+    }
+
+    memset(job, 0, sizeof(*job));
+    job->workers = mode == MC_MODE_PROCESSES ? sv->processes : mode == MC_MODE_THREADS ? sv->threads : 1;
+    job->z = mc_normal_quantile(0.95);
+    for (int i = 7; i < argc; i += 2) {
+        int ok = 1;
+        if (strcmp(argv[i], "--workers") == 0) {
+            job->workers = atoi(argv[i + 1]);
+            ok = job->workers >= 1 &&
+                 job->workers <= (mode == MC_MODE_PROCESSES ? MAX_PROCESSES : MC_MAX_POOL);
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            job->progress_every = strtod(argv[i + 1], NULL);
+            ok = job->progress_every >= 0.0;
+        } else if (strcmp(argv[i], "--confidence") == 0) {
+            double confidence = strtod(argv[i + 1], NULL);
+            ok = confidence > 0.0 && confidence < 1.0;
+            if (ok) job->z = mc_normal_quantile(confidence);
+        } else if (mc_is_stream_option(argv[i]) && strcmp(argv[i], "--seed") != 0) {
+            stream_opts[num_stream++] = argv[i];
+            stream_opts[num_stream++] = argv[i + 1];
         } else {
-            threads[i] = CreateThread(NULL, 0, needles_thread_worker, &thread_data[i], 0, NULL);
+            ok = 0;
         }
-        
-        if (threads[i] == NULL) {
-            fprintf(stderr, "Error creando thread %d: %lu\n", i, GetLastError());
-            exit(1);
+        if (!ok) {
+            mc_serve_error(sv, client, id, "opcion_invalida");
+            return;
         }
     }
-    
-    // Esperar a que todos los threads terminen
-    WaitForMultipleObjects(num_threads, threads, TRUE, INFINITE);
-    
-    QueryPerformanceCounter(&end);
-    double elapsed = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-    
-    // Recolectar resultados
-    for (int i = 0; i < num_threads; i++) {
-        total_inside += thread_data[i].points_inside;
-        CloseHandle(threads[i]);
+    if (mc_serve_params(method, seed, stream_opts, num_stream, &job->params) != 0) {
+        mc_serve_error(sv, client, id, "opcion_invalida");
+        return;
     }
-    
-    // Calcular π
-    double pi_estimate;
-    if (method == 1) {
-        pi_estimate = 4.0 * (double)total_inside / total_points;
-    } else {
-        // evitar división por cero
-        if (total_inside == 0) pi_estimate = 0.0;
-        else pi_estimate = (2.0 * 1.0 * total_points) / (1.0 * total_inside); // L = D = 1
+    // Con --replay el pedido tiene que caber en el flujo; sin tope, el tope es el flujo
+    if (g_replay != NULL) {
+        if (points < 1.0) points = (double)g_replay->header.points;
+        if (mc_replay_check(&job->params, (long long)points) != 0) {
+            mc_serve_error(sv, client, id, "flujo_insuficiente");
+            return;
+        }
+    }
+    if (mode == MC_MODE_AUTO) {
+        // Sin tope de puntos el tamano no se conoce: se elige como para uno grande
+        mc_auto_choice_t c = mc_auto_pick(&job->params, points >= 1.0 ? (long long)points : 1ll << 32);
+        mode = c.mode;
+        job->workers = c.workers;
     }
-    
-    printf("Tiempo con THREADS: %.6f segundos\n", elapsed);
-    printf("Puntos dentro/cruces: %lld de %lld\n", total_inside, total_points);
-    
-    return pi_estimate;
-}
 
-// ==================== IMPLEMENTACIÓN CON PROCESOS (Windows API) ====================
-double parallel_processes_monte_carlo(long long total_points, int num_processes, int method) {
-    char map_name[MAP_NAME_MAX];
-    HANDLE hMapFile = NULL;
-    shared_data_t* shared = NULL;
-    HANDLE hMutex = NULL;
-    PROCESS_INFORMATION pi[MAX_PROCESSES];
-    STARTUPINFO si;
-    
-    printf("\n=== INICIANDO PROCESOS (%d procesos, %lld puntos totales) ===\n", 
-           num_processes, total_points);
-    
-    // Crear nombre único para el file mapping
-    snprintf(map_name, MAP_NAME_MAX, "Local\\MonteCarloMap_%lu_%lu", 
-             GetCurrentProcessId(), GetTickCount());
-    
-    // Crear file mapping
-    hMapFile = CreateFileMappingA(
-        INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 
-        0, sizeof(shared_data_t), map_name);
-    
-    if (hMapFile == NULL) {
-        fprintf(stderr, "Error creando file mapping: %lu\n", GetLastError());
-        exit(1);
+    snprintf(job->id, sizeof(job->id), "%s", id);
+    job->client = client;
+    job->mode = mode;
+    job->max_points = (long long)points;
+    job->target_error = target_error;
+    job->start = mc_now();
+    job->next_report = job->start + job->progress_every;
+    job->turn = sv->turn;
+    job->active = 1;
+    sv->num_jobs++;
+    sv->requests++;
+
+    // Arrancar desde el prefijo guardado mas largo que sirva
+    mc_serve_entry_t* e = mc_serve_cache_find(sv, &job->params,
+                                              job->max_points > 0 ? job->max_points : 1ll << 62);
+    if (e != NULL) {
+        job->points = job->cached = e->points;
+        job->hits = e->hits;
+        sv->reused += e->points;
     }
-    
-    // Mapear memoria compartida
-    shared = (shared_data_t*)MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(shared_data_t));
-    if (shared == NULL) {
-        fprintf(stderr, "Error mapeando memoria: %lu\n", GetLastError());
-        CloseHandle(hMapFile);
-        exit(1);
+    if (target_error > 0.0) {
+        job->round_end = job->points > 0 ? job->points : MC_ADAPT_FIRST_ROUND;
+        if (job->max_points > 0 && job->round_end > job->max_points) job->round_end = job->max_points;
+    } else {
+        job->round_end = job->max_points;
     }
-    
-    // Crear nombre del mutex (único)
-    char mutex_name[128];
-    snprintf(mutex_name, sizeof(mutex_name), "Local\\MonteCarloMutex_%lu_%lu",
-             GetCurrentProcessId(), GetTickCount());
-    
-    // Crear mutex con nombre
-    hMutex = CreateMutexA(NULL, FALSE, mutex_name);
-    if (hMutex == NULL) {
-        fprintf(stderr, "Error creando mutex nombrado: %lu\n", GetLastError());
-        UnmapViewOfFile(shared);
-        CloseHandle(hMapFile);
-        exit(1);
+    if (job->points >= job->round_end) {
+        mc_serve_checkpoint(sv, job);
+        if (!job->active && job->cached == job->points) sv->cache_hits++;
     }
-    
-    // Inicializar datos compartidos (incluyendo el nombre del mutex)
-    shared->total_points = total_points;
-    shared->points_inside = 0;
-    shared->num_workers = num_processes;
-    shared->method = method;
-    shared->needle_length = 1.0;
-    shared->line_spacing = 1.0;
-    snprintf(shared->mutex_name, sizeof(shared->mutex_name), "%s", mutex_name);
-    
-    LARGE_INTEGER freq, start, end;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&start);
-    
-    // Inicializar estructura STARTUPINFO
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    
-    // Crear procesos hijos
-    for (int i = 0; i < num_processes; i++) {
-        char cmdline[1024];
-        char exe_path[MAX_PATH];
-        
-        // Obtener ruta del ejecutable actual
-        GetModuleFileNameA(NULL, exe_path, MAX_PATH);
-        
-        // Construir línea de comandos: exe child <worker_id> <total_points> <method> <map_name>
-        snprintf(cmdline, sizeof(cmdline), "\"%s\" child %d %lld %d %s", 
-                exe_path, i, total_points, method, map_name);
-        
-        ZeroMemory(&pi[i], sizeof(PROCESS_INFORMATION));
-        
-        if (!CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi[i])) {
-            fprintf(stderr, "Error creando proceso %d: %lu\n", i, GetLastError());
-            continue;
+}
+
+static void mc_serve_command(mc_serve_t* sv, int client, char* line) {
+    char* argv[MC_SERVE_MAX_ARGS];
+    int argc = 0;
+    char reply[MC_NET_LINE];
+
+    for (char* tok = strtok(line, " \t"); tok != NULL; tok = strtok(NULL, " \t")) {
+        if (argc == MC_SERVE_MAX_ARGS) {
+            mc_serve_error(sv, client, "-", "demasiados_campos");
+            return;
         }
-        
-        printf("Proceso hijo %d lanzado (PID: %lu)\n", i, pi[i].dwProcessId);
+        argv[argc++] = tok;
     }
-    
-    // Esperar a que todos los procesos hijos terminen
-    for (int i = 0; i < num_processes; i++) {
-        if (pi[i].hProcess) {
-            WaitForSingleObject(pi[i].hProcess, INFINITE);
-            CloseHandle(pi[i].hProcess);
-            CloseHandle(pi[i].hThread);
+    if (argc == 0) return;
+
+    if (strcmp(argv[0], "ESTIMATE") == 0) {
+        mc_serve_estimate(sv, client, argv, argc);
+    } else if (strcmp(argv[0], "CANCEL") == 0 && argc == 2) {
+        for (int j = 0; j < MC_SERVE_MAX_JOBS; j++) {
+            mc_serve_job_t* job = &sv->jobs[j];
+            if (job->active && job->client == client && strcmp(job->id, argv[1]) == 0) {
+                mc_serve_finish(sv, job, "cancelado");
+                return;
+            }
         }
-    }
-    
-    QueryPerformanceCounter(&end);
-    double elapsed = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-    
-    // Calcular π
-    double pi_estimate;
-    if (method == 1) {
-        pi_estimate = 4.0 * (double)shared->points_inside / total_points;
+        mc_serve_error(sv, client, argv[1], "id_desconocido");
+    } else if (strcmp(argv[0], "STATS") == 0) {
+        int entries = 0, clients = 0;
+        for (int i = 0; i < sv->cache_size; i++) entries += sv->cache[i].used != 0;
+        for (int i = 0; i < sv->num_clients; i++) clients += sv->conns[i].sock != MC_INVALID_SOCKET;
+        snprintf(reply, sizeof(reply), "STATS %d %d %d %lld %lld %lld %lld\n", clients, sv->num_jobs,
+                 entries, sv->requests, sv->cache_hits, sv->counted, sv->reused);
+        mc_serve_send(sv, client, reply);
     } else {
-        if (shared->points_inside == 0) pi_estimate = 0.0;
-        else pi_estimate = (2.0 * shared->needle_length * total_points) / 
-                     (shared->line_spacing * shared->points_inside);
+        mc_serve_error(sv, client, "-", "comando_desconocido");
     }
-    
-    printf("Tiempo con PROCESOS: %.6f segundos\n", elapsed);
-    printf("Puntos dentro/cruces: %lld de %lld\n", shared->points_inside, total_points);
-    
-    // Limpiar recursos
-    UnmapViewOfFile(shared);
-    CloseHandle(hMapFile);
-    if (hMutex) CloseHandle(hMutex);
-    
-    return pi_estimate;
 }
 
-// ==================== CÓDIGO PARA PROCESOS HIJOS ====================
-int run_as_child_process(int argc, char* argv[]) {
-    if (argc < 6) {
-        fprintf(stderr, "Uso: programa child worker_id total_points method map_name\n");
-        return 1;
+static void mc_serve_usage(void) {
+    fprintf(stderr, "Uso: programa serve [--socket RUTA] [--threads T] [--processes P] [--slice S] "
+                    "[--cache N]\n"
+                    "                    [--rng R] [--sampling S] [--precision P] [--placement P] "
+                    "[--profile ARCHIVO]\n");
+}
+
+int run_as_service(int argc, char* argv[]) {
+    static mc_serve_t sv;
+    const char* path = MC_SERVE_SOCKET;
+
+    memset(&sv, 0, sizeof(sv));
+    sv.threads = mc_cpu_count();
+    sv.processes = mc_cpu_count() < MAX_PROCESSES ? mc_cpu_count() : MAX_PROCESSES;
+    sv.slice = MC_SERVE_SLICE;
+    sv.cache_size = MC_SERVE_CACHE;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (value == NULL) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", name);
+            return 1;
+        }
+        if (strcmp(name, "--socket") == 0) {
+            path = value;
+        } else if (strcmp(name, "--threads") == 0) {
+            sv.threads = atoi(value);
+            ok = sv.threads >= 1 && sv.threads <= MC_MAX_POOL;
+        } else if (strcmp(name, "--processes") == 0) {
+            sv.processes = atoi(value);
+            ok = sv.processes >= 1 && sv.processes <= MAX_PROCESSES;
+        } else if (strcmp(name, "--slice") == 0) {
+            sv.slice = strtod(value, NULL);
+            ok = sv.slice > 0.0 && sv.slice <= 10.0;
+        } else if (strcmp(name, "--cache") == 0) {
+            sv.cache_size = atoi(value);
+            ok = sv.cache_size >= 1;
+        } else {
+            int status = mc_session_option(name, value);
+            if (status < 0) return 1;
+            if (status > 0) {
+                fprintf(stderr, "Opcion desconocida: %s\n", name);
+                mc_serve_usage();
+                return 1;
+            }
+        }
+        if (!ok) {
+            fprintf(stderr, "Valor invalido para %s: %s\n", name, value);
+            mc_serve_usage();
+            return 1;
+        }
     }
-    
-    int worker_id = atoi(argv[2]);
-    long long total_points = atoll(argv[3]);
-    int method = atoi(argv[4]);
-    char* map_name = argv[5];
-    
-    // Abrir file mapping existente
-    HANDLE hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, map_name);
-    if (hMapFile == NULL) {
-        fprintf(stderr, "Error abriendo file mapping: %lu\n", GetLastError());
+
+    sv.cache = (mc_serve_entry_t*)calloc(sv.cache_size, sizeof(mc_serve_entry_t));
+    if (sv.cache == NULL) {
+        fprintf(stderr, "Sin memoria para %d entradas de cache\n", sv.cache_size);
         return 1;
     }
-    
-    // Mapear memoria compartida
-    shared_data_t* shared = (shared_data_t*)MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(shared_data_t));
-    if (shared == NULL) {
-        fprintf(stderr, "Error mapeando memoria: %lu\n", GetLastError());
-        CloseHandle(hMapFile);
+    if (mc_net_init() != 0) {
+        fprintf(stderr, "Error iniciando sockets: %lu\n", mc_net_error());
         return 1;
     }
-    
-    // Abrir mutex por nombre (leído desde shared->mutex_name)
-    HANDLE hMutexLocal = NULL;
-    if (shared->mutex_name[0] != '\0') {
-        hMutexLocal = OpenMutexA(MUTEX_ALL_ACCESS, FALSE, shared->mutex_name);
-        if (hMutexLocal == NULL) {
-            // Si falla abrir, intentar crearlo con el mismo nombre (fallback)
-            hMutexLocal = CreateMutexA(NULL, FALSE, shared->mutex_name);
-            if (hMutexLocal == NULL) {
-                fprintf(stderr, "Error abriendo/creando mutex en child: %lu\n", GetLastError());
-                // Continuar sin sincronización no es recomendado, pero seguimos para no bloquear pruebas
-                hMutexLocal = NULL;
-            }
-        }
+    // Una ruta que nadie atiende es de un servicio anterior que no cerro bien
+    mc_socket_t probe = mc_local_connect(path);
+    if (probe != MC_INVALID_SOCKET) {
+        mc_socket_close(probe);
+        fprintf(stderr, "Ya hay un servicio escuchando en %s\n", path);
+        return 1;
     }
-    
-    // Ejecutar el trabajo (pasa hMutexLocal para sincronizar)
-    if (method == 1) {
-        dartboard_process_worker(worker_id, shared, hMutexLocal);
-    } else {
-        needles_process_worker(worker_id, shared, hMutexLocal);
+    mc_local_unlink(path);
+    mc_socket_t listener = mc_local_listen(path);
+    if (listener == MC_INVALID_SOCKET) {
+        fprintf(stderr, "Error escuchando en %s: %lu\n", path, mc_net_error());
+        return 1;
     }
-    
-    // Limpiar
-    if (hMutexLocal) CloseHandle(hMutexLocal);
-    UnmapViewOfFile(shared);
-    CloseHandle(hMapFile);
-    
-    return 0;
-}
+    signal(SIGINT, mc_serve_on_signal);
+    signal(SIGTERM, mc_serve_on_signal);
 
-// ==================== VERSIÓN SERIAL ====================
-double serial_monte_carlo(long long total_points, int method) {
-    long long count = 0;
-    unsigned int seed = GetTickCount();
-    
-    printf("\n=== INICIANDO VERSION SERIAL (%lld puntos) ===\n", total_points);
-    
-    LARGE_INTEGER freq, start, end;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&start);
-    
-    if (method == 1) {
-        // Dartboard
-        for (long long i = 0; i < total_points; i++) {
-            double x = rand_double_win(&seed);
-            double y = rand_double_win(&seed);
-            
-            if (x * x + y * y <= 1.0) {
-                count++;
+    g_quiet = 1;
+    g_progress_every = 0.0;
+    mc_pool_ensure(sv.threads);
+    for (int i = 0; i < MC_SERVE_MAX_CLIENTS; i++) sv.conns[i].sock = MC_INVALID_SOCKET;
+    printf("Servicio en %s: %d hilos, %d procesos, turnos de %.0f ms, cache de %d entradas\n",
+           path, sv.threads, sv.processes, sv.slice * 1000.0, sv.cache_size);
+    fflush(stdout);
+
+    while (!g_serve_stop) {
+        mc_socket_t socks[MC_SERVE_MAX_CLIENTS + 1];
+        int ready[MC_SERVE_MAX_CLIENTS + 1];
+        char line[MC_NET_LINE];
+
+        // Con pedidos en curso solo se mira el socket entre turno y turno
+        socks[0] = listener;
+        for (int i = 0; i < sv.num_clients; i++) socks[i + 1] = sv.conns[i].sock;
+        if (mc_socket_poll(socks, sv.num_clients + 1, ready, sv.num_jobs > 0 ? 0 : 200) < 0) continue;
+
+        if (ready[0]) {
+            mc_socket_t s = accept(listener, NULL, NULL);
+            int slot = -1;
+            for (int i = 0; i < sv.num_clients && slot < 0; i++) {
+                if (sv.conns[i].sock == MC_INVALID_SOCKET) slot = i;
+            }
+            if (slot < 0 && sv.num_clients < MC_SERVE_MAX_CLIENTS) slot = sv.num_clients++;
+            if (s != MC_INVALID_SOCKET && slot < 0) {
+                mc_socket_close(s);
+            } else if (s != MC_INVALID_SOCKET) {
+                memset(&sv.conns[slot], 0, sizeof(sv.conns[slot]));
+                sv.conns[slot].sock = s;
             }
         }
-    } else {
-        // Needles
-        for (long long i = 0; i < total_points; i++) {
-            double center_y = rand_double_win(&seed) * 1.0;
-            double angle = rand_double_win(&seed) * 3.14159265358979323846;
-            
-            double half_length = 0.5;
-            double y_min = center_y - half_length * sin(angle);
-            double y_max = center_y + half_length * sin(angle);
-            
-            if (y_min <= 0.0 || y_max >= 1.0) {
-                count++;
+
+        for (int i = 0; i < sv.num_clients; i++) {
+            if (!ready[i + 1] || sv.conns[i].sock == MC_INVALID_SOCKET) continue;
+            if (mc_conn_fill(&sv.conns[i]) <= 0) {
+                mc_serve_drop(&sv, i);
+                continue;
+            }
+            while (sv.conns[i].sock != MC_INVALID_SOCKET &&
+                   mc_conn_take_line(&sv.conns[i], line, sizeof(line))) {
+                mc_serve_command(&sv, i, line);
             }
         }
-    }
-    
-    QueryPerformanceCounter(&end);
-    double elapsed = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-    
-    double pi_estimate;
-    if (method == 1) {
-        pi_estimate = 4.0 * (double)count / total_points;
-    } else {
-        if (count == 0) pi_estimate = 0.0;
-        else pi_estimate = (2.0 * 1.0 * total_points) / (1.0 * count);
-    }
-    
-    printf("Tiempo SERIAL: %.6f segundos\n", elapsed);
-    printf("Puntos dentro/cruces: %lld de %lld\n", count, total_points);
-    
-    return pi_estimate;
-}
 
-// ==================== FUNCIONES AUXILIARES ====================
-void print_results(double computed_pi, double actual_pi, long long iterations, 
-                  double time_taken, const char* method) {
-    double error = fabs(computed_pi - actual_pi);
-    double relative_error = (error / actual_pi) * 100;
-    
-    printf("\n=== RESULTADOS %s ===\n", method);
-    printf("Pi calculado:  %.10f\n", computed_pi);
-    printf("Pi real:       %.10f\n", actual_pi);
-    printf("Error absoluto: %.2e\n", error);
-    printf("Error relativo: %.6f%%\n", relative_error);
-    printf("Iteraciones:   %lld\n", iterations);
-    printf("Tiempo:        %.6f segundos\n", time_taken);
-    if (time_taken > 0) {
-        printf("Iteraciones/segundo: %.0f\n", iterations / time_taken);
+        mc_serve_job_t* job = mc_serve_pick(&sv);
+        if (job != NULL) mc_serve_slice(&sv, job);
+        fflush(stdout);
     }
-    printf("===================================\n");
-}
 
-void benchmark_method(long long points, int method, const char* method_name) {
-    const double ACTUAL_PI = 3.14159265358979323846;
-    
-    printf("\n\n**************************************************");
-    printf("\n* BENCHMARK: %s", method_name);
-    printf("\n**************************************************");
-    
-    // Serial
-    LARGE_INTEGER freq, start, end;
-    QueryPerformanceFrequency(&freq);
-    
-    QueryPerformanceCounter(&start);
-    double pi_serial = serial_monte_carlo(points, method);
-    QueryPerformanceCounter(&end);
-    double time_serial = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-    
-    print_results(pi_serial, ACTUAL_PI, points, time_serial, "SERIAL");
-    
-    // Threads (2, 4, 8)
-    int thread_counts[] = {2, 4, 8};
-    for (int i = 0; i < 3; i++) {
-        QueryPerformanceCounter(&start);
-        double pi_threads = parallel_threads_monte_carlo(points, thread_counts[i], method);
-        QueryPerformanceCounter(&end);
-        double time_threads = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-        
-        const char* labels[3] = {"2 THREADS", "4 THREADS", "8 THREADS"};
-        print_results(pi_threads, ACTUAL_PI, points, time_threads, labels[i]);
-        printf("Speedup: %.2fx\n", time_serial / time_threads);
-    }
-    
-    // Procesos (2, 4)
-    int process_counts[] = {2, 4};
-    for (int i = 0; i < 2; i++) {
-        QueryPerformanceCounter(&start);
-        double pi_processes = parallel_processes_monte_carlo(points, process_counts[i], method);
-        QueryPerformanceCounter(&end);
-        double time_processes = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
-        
-        const char* plabels[2] = {"2 PROCESOS", "4 PROCESOS"};
-        print_results(pi_processes, ACTUAL_PI, points, time_processes, plabels[i]);
-        printf("Speedup: %.2fx\n", time_serial / time_processes);
+    for (int i = 0; i < sv.num_clients; i++) {
+        if (sv.conns[i].sock != MC_INVALID_SOCKET) mc_serve_drop(&sv, i);
     }
+    mc_socket_close(listener);
+    mc_local_unlink(path);
+    free(sv.cache);
+    printf("Servicio detenido: %lld pedidos, %lld servidos de cache\n", sv.requests, sv.cache_hits);
+    return 0;
 }
 
 // ==================== PROGRAMA PRINCIPAL ====================
 // ==================== PROGRAMA PRINCIPAL ====================
 int main(int argc, char* argv[]) {
+    mc_select_kernels();
+    
     // Si se ejecuta como proceso hijo
     if (argc >= 2 && strcmp(argv[1], "child") == 0) {
         return run_as_child_process(argc, argv);
     }
 
+    // Opciones de la sesion: --seed N --rng philox|xoshiro|lcg
+    //                        --needle-length L --line-spacing D
+    //                        --sampling mc|sobol|halton|stratified|lhs|antithetic
+    //                        --precision double|float|int
+    //                        --placement none|compact|scatter|core
+    //                        --progress S (informe de avance cada S segundos)
+    //                        --profile ARCHIVO (perfil de 'programa tune' para el modo auto)
+    g_seed = ((unsigned long long)time(NULL) << 20) ^ mc_process_id() ^ mc_tick_count();
+
+    // Benchmark no interactivo: programa bench [opciones]
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return run_benchmark_suite(argc - 2, argv + 2);
+    }
+
+    // Microbenchmarks de generadores y kernels: programa micro [opciones]
+    if (argc >= 2 && strcmp(argv[1], "micro") == 0) {
+        return run_microbenchmarks(argc - 2, argv + 2);
+    }
+
+    // Autoajuste a esta maquina para el modo auto: programa tune [opciones]
+    if (argc >= 2 && strcmp(argv[1], "tune") == 0) {
+        return run_autotuner(argc - 2, argv + 2);
+    }
+
+    // Distribucion del estimador: programa trials --trials K --points N [opciones]
+    if (argc >= 2 && strcmp(argv[1], "trials") == 0) {
+        return run_trials(argc - 2, argv + 2);
+    }
+
+    // Grabacion de un flujo para --replay: programa record --output ARCHIVO [opciones]
+    if (argc >= 2 && strcmp(argv[1], "record") == 0) {
+        return run_stream_recorder(argc - 2, argv + 2);
+    }
+
+    // Corrida larga con registro persistente: programa run --ledger ARCHIVO [opciones]
+    if (argc >= 2 && strcmp(argv[1], "run") == 0) {
+        return run_with_ledger(argc - 2, argv + 2);
+    }
+
+    // Modo distribuido: programa coordinator [opciones] / programa worker [opciones]
+    if (argc >= 2 && strcmp(argv[1], "coordinator") == 0) {
+        return run_as_coordinator(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "worker") == 0) {
+        return run_as_net_worker(argc - 2, argv + 2);
+    }
+
+    // Servicio local de estimaciones: programa serve [--socket RUTA] [opciones]
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        return run_as_service(argc - 2, argv + 2);
+    }
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Falta el valor de la opcion %s\n", argv[i]);
+            return 1;
+        }
+        int status = mc_session_option(argv[i], argv[i + 1]);
+        if (status < 0) return 1;
+        if (status > 0) {
+            fprintf(stderr, "Opcion desconocida: %s\n", argv[i]);
+            fprintf(stderr, "Uso: programa [--seed N] [--rng philox|xoshiro|lcg] "
+                            "[--needle-length L] [--line-spacing D]\n"
+                            "               [--sampling mc|sobol|halton|stratified|lhs|antithetic]\n"
+                            "               [--precision double|float|int] [--placement none|compact|scatter|core]\n"
+                            "               [--progress S] [--replay ARCHIVO] [--profile ARCHIVO]\n"
+                            "       programa bench [opciones] | programa micro [opciones]\n"
+                            "       programa tune [opciones] | programa trials [opciones]\n"
+                            "       programa record --output ARCHIVO [opciones]\n"
+                            "       programa run --ledger ARCHIVO [opciones]\n"
+                            "       programa coordinator [opciones] | programa worker [opciones]\n"
+                            "       programa serve [opciones]\n");
+            return 1;
+        }
+    }
+
     while (1) {
         long long points;
         int choice;
 
         printf("\n=========================================\n");
-        printf("=== CALCULO DE PI - PARALELISMO WINDOWS ===\n");
+        printf("=== CALCULO DE PI - PARALELISMO " MC_PLATFORM_NAME " ===\n");
+        printf("Kernel vectorial: %s\n", mc_isa_names[g_isa]);
+        printf("Generador: %s, muestreo: %s, precision: %s, semilla: %llu\n",
+               mc_rng_names[g_rng], mc_sampling_names[g_sampling], mc_precision_names[g_precision],
+               g_seed);
+        printf("Needles: L = %g, D = %g\n", g_needle_length, g_line_spacing);
+        printf("Ubicacion de workers: %s (%d CPUs, %d nucleos, %d nodos NUMA)\n",
+               mc_placement_names[g_placement], mc_topology()->count, mc_topology()->cores,
+               mc_topology()->nodes);
+        if (g_replay != NULL) {
+            printf("Flujo grabado: %s (%lld muestras, %d dimensiones, %s; %s)\n", g_replay->path,
+                   g_replay->header.points, g_replay->header.dims,
+                   mc_replay_format_names[g_replay->header.format], g_replay->header.source);
+        }
         printf("Seleccione metodo:\n");
         printf("1. Benchmark completo Dartboard\n");
         printf("2. Benchmark completo Needles\n");
         printf("3. Ejecucion simple\n");
         printf("4. Salir\n");
+        printf("5. Ejecucion adaptativa (error objetivo)\n");
         printf("Opcion: ");
         if (scanf("%d", &choice) != 1) return 1;
 
@@ -524,51 +8376,104 @@ int main(int argc, char* argv[]) {
             if (scanf("%lld", &points) != 1) return 1;
 
             printf("Seleccione metodo:\n");
-            printf("1. Dartboard\n");
-            printf("2. Needles\n");
+            for (int m = 1; m < MC_METHOD_COUNT; m++) printf("%d. %s\n", m, mc_integrands[m].title);
             printf("Opcion: ");
             int method;
             if (scanf("%d", &method) != 1) return 1;
+            if (!mc_method_valid(method)) {
+                printf("Opcion no valida!\n");
+                continue;
+            }
+            if (mc_replay_fits(method, points) != 0) continue;
 
             printf("Seleccione implementacion:\n");
             printf("1. Serial\n");
             printf("2. Threads (4)\n");
             printf("3. Procesos (4)\n");
+            printf("4. Automatico (perfil de la maquina)\n");
+            printf("5. Hibrido (2 procesos x 2 hilos)\n");
             printf("Opcion: ");
             int impl;
             if (scanf("%d", &impl) != 1) return 1;
 
             const double ACTUAL_PI = 3.14159265358979323846;
-            double pi_result;
+            mc_run_t run;
 
-            LARGE_INTEGER freq, start, end;
-            QueryPerformanceFrequency(&freq);
-            QueryPerformanceCounter(&start);
+            if (impl == 4) {
+                mc_params_t params = mc_make_params(method);
+                mc_auto_choice_t c = mc_auto_pick(&params, points);
+                printf("Automatico: %s con %d workers", mc_mode_names[c.mode], c.workers);
+                if (c.predicted > 0.0) printf(" (previsto %.6f segundos)", c.predicted);
+                printf("\n");
+                run = mc_bench_once(c.mode, method, c.workers, 1, points);
+                print_results(run.pi, ACTUAL_PI, run.points, run.elapsed, "AUTOMATICO");
+                continue;
+            }
 
             switch (impl) {
                 case 1:
-                    pi_result = serial_monte_carlo(points, method);
+                    run = serial_monte_carlo(points, method);
                     break;
                 case 2:
-                    pi_result = parallel_threads_monte_carlo(points, 4, method);
+                    run = parallel_threads_monte_carlo(points, 4, method);
                     break;
                 case 3:
-                    pi_result = parallel_processes_monte_carlo(points, 4, method);
+                    run = parallel_processes_monte_carlo(points, 4, method);
+                    break;
+                case 5:
+                    run = parallel_hybrid_monte_carlo(points, 2, 2, method);
                     break;
                 default:
                     printf("Opcion no valida!\n");
                     continue;
             }
 
-            QueryPerformanceCounter(&end);
-            double elapsed = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+            print_results(run.pi, ACTUAL_PI, run.points, run.elapsed,
+                (impl == 1) ? "SERIAL" : (impl == 2) ? "THREADS" : (impl == 3) ? "PROCESOS" : "HIBRIDO");
+
+        } else if (choice == 5) {
+            int method, threads;
+            double target, confidence, max_seconds;
+            long long max_points;
+
+            printf("Seleccione metodo:\n");
+            for (int m = 1; m < MC_METHOD_COUNT; m++) printf("%d. %s\n", m, mc_integrands[m].title);
+            printf("Opcion: ");
+            if (scanf("%d", &method) != 1) return 1;
+            printf("Error absoluto objetivo (ej. 1e-4): ");
+            if (scanf("%lf", &target) != 1) return 1;
+            printf("Nivel de confianza en %% (ej. 95): ");
+            if (scanf("%lf", &confidence) != 1) return 1;
+            printf("Numero de hilos: ");
+            if (scanf("%d", &threads) != 1) return 1;
+            printf("Puntos maximos (0 = sin limite): ");
+            if (scanf("%lld", &max_points) != 1) return 1;
+            printf("Segundos maximos (0 = sin limite): ");
+            if (scanf("%lf", &max_seconds) != 1) return 1;
+
+            if (!mc_method_valid(method) || !(target > 0.0) ||
+                !(confidence > 0.0 && confidence < 100.0)) {
+                printf("Parametros no validos!\n");
+                continue;
+            }
+            // Con un flujo grabado las rondas no pueden pasar del final del archivo
+            if (g_replay != NULL && (max_points <= 0 || max_points > g_replay->header.points)) {
+                max_points = g_replay->header.points;
+                printf("Tope de puntos: %lld (largo del flujo grabado)\n", max_points);
+            }
+            if (mc_replay_fits(method, max_points) != 0) continue;
 
-            print_results(pi_result, ACTUAL_PI, points, elapsed,
-                (impl == 1) ? "SERIAL" : (impl == 2) ? "THREADS" : "PROCESOS");
+            mc_adaptive_result_t res = adaptive_monte_carlo(method, threads, target,
+                                                            confidence / 100.0,
+                                                            max_points, max_seconds);
+            printf("\nPi = %.10f +- %.2e (confianza %.2f%%)\n",
+                   res.pi, res.half_width, confidence);
+            print_results(res.pi, 3.14159265358979323846, res.points, res.elapsed, "ADAPTATIVO");
 
         } else if (choice == 1 || choice == 2) {
             printf("Ingrese numero de puntos para benchmark: ");
             if (scanf("%lld", &points) != 1) return 1;
+            if (mc_replay_fits(choice, points) != 0) continue;
 
             if (choice == 1) {
                 benchmark_method(points, 1, "DARTBOARD");